@@ -0,0 +1,288 @@
+/* @file bench_buffer.cpp
+ * @brief Benchmarks of the buffer module.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "buffer/buffer_headers.hpp"
+
+#include "bench_common.hpp"
+
+namespace storedata
+{
+namespace bench
+{
+
+namespace
+{
+
+/** @brief Payload sizes used by the benchmarks
+*/
+const size_t kPayloadSizes[] = { 64, 1024, 16 * 1024, 256 * 1024,
+	4 * 1024 * 1024 };
+
+/** @brief Number of items pushed in a desynchronizer run (about 256MB of
+           data, between 64 and 200000 items)
+*/
+size_t num_items_for(size_t payload_bytes) {
+	size_t n = (256 * 1024 * 1024) / payload_bytes;
+	return (std::min)((std::max)(n, static_cast<size_t>(64)),
+		static_cast<size_t>(200000));
+}
+
+/** @brief It waits until the callback processed num_items
+*/
+void wait_processed(std::atomic<size_t> &num_processed, size_t num_items) {
+	while (num_processed < num_items) {
+		std::this_thread::yield();
+	}
+}
+
+/** @brief It adds the desynchronizer metrics to the result
+*/
+void add_metrics(const DesynchronizerMetricsSnapshot &s, BenchResult &r) {
+	r.extra.push_back(std::make_pair("p50_queue_us", s.time_in_queue.p50_us));
+	r.extra.push_back(std::make_pair("p99_queue_us", s.time_in_queue.p99_us));
+	r.extra.push_back(std::make_pair("max_depth",
+		static_cast<double>(s.queue_depth_high_water)));
+}
+
+/** @brief Data of the inherit desynchronizer
+*/
+class BenchDataInherit : public AtomicContainerDataInherit
+{
+public:
+	BenchDataInherit(const char* src, size_t size_bytes) :
+		data_(src, src + size_bytes) {}
+
+	virtual void* getObject(int which) {
+		return which == 0 ? &data_ : nullptr;
+	}
+
+	virtual void dispose() {
+		std::vector<char>().swap(data_);
+	}
+
+private:
+	std::vector<char> data_;
+};
+
+//-----------------------------------------------------------------------------
+void bench_desync_generic(const BenchContext &ctx, size_t payload_bytes) {
+	std::vector<char> payload(payload_bytes, 1);
+	size_t num_items = num_items_for(payload_bytes);
+	std::atomic<size_t> num_processed(0);
+
+	DataDesynchronizerGeneric dd;
+	dd.set_cbk_func([&](const std::string &msg, AtomicContainerData &rcd) {
+		++num_processed;
+	});
+	dd.start();
+
+	BenchTimer timer;
+	for (size_t i = 0; i < num_items; ++i) {
+		AtomicContainerData rcd;
+		rcd.copyFrom(payload.data(), payload_bytes);
+		dd.push("bench", rcd);
+	}
+	wait_processed(num_processed, num_items);
+
+	BenchResult r;
+	r.name = "desync_generic";
+	r.seconds = timer.seconds();
+	r.params.push_back(std::make_pair("payload_bytes",
+		static_cast<double>(payload_bytes)));
+	r.iterations = num_items;
+	r.bytes = num_items * payload_bytes;
+	add_metrics(dd.metrics(), r);
+	dd.close();
+	ctx.report(r);
+}
+//-----------------------------------------------------------------------------
+void bench_desync_faster(const BenchContext &ctx, size_t payload_bytes,
+	DesynchronizerQueueMode mode) {
+	std::vector<char> payload(payload_bytes, 1);
+	size_t num_items = num_items_for(payload_bytes);
+	std::atomic<size_t> num_processed(0);
+
+	DesynchronizerRingParams ring_params;
+	ring_params.mode = mode;
+	ring_params.full_policy = DesynchronizerFullPolicy::Block;
+	ring_params.block_timeout_ms = -1;
+	DataDesynchronizerGenericFaster dd(ring_params);
+	dd.set_cbk_func_faster(
+		[&](std::unique_ptr<AtomicContainerDataFaster> &rcd) {
+		++num_processed;
+	});
+	dd.start();
+
+	BenchTimer timer;
+	for (size_t i = 0; i < num_items; ++i) {
+		std::unique_ptr<AtomicContainerDataFaster> rcd(
+			new AtomicContainerDataFaster());
+		rcd->copyFrom(payload.data(), payload_bytes);
+		dd.push(rcd);
+	}
+	wait_processed(num_processed, num_items);
+
+	BenchResult r;
+	r.name = mode == DesynchronizerQueueMode::Mutex ? "desync_faster" :
+		mode == DesynchronizerQueueMode::RingSPSC ? "desync_faster_spsc" :
+		"desync_faster_mpsc";
+	r.seconds = timer.seconds();
+	r.params.push_back(std::make_pair("payload_bytes",
+		static_cast<double>(payload_bytes)));
+	r.iterations = num_items;
+	r.bytes = num_items * payload_bytes;
+	add_metrics(dd.metrics(), r);
+	dd.close();
+	ctx.report(r);
+}
+//-----------------------------------------------------------------------------
+void bench_desync_inherit(const BenchContext &ctx, size_t payload_bytes) {
+	std::vector<char> payload(payload_bytes, 1);
+	size_t num_items = num_items_for(payload_bytes);
+	std::atomic<size_t> num_processed(0);
+
+	DataDesynchronizerGenericInherit dd;
+	dd.set_cbk_func_inherit(
+		[&](std::unique_ptr<AtomicContainerDataInherit> &rcd) {
+		rcd->dispose();
+		++num_processed;
+	});
+	dd.start();
+
+	BenchTimer timer;
+	for (size_t i = 0; i < num_items; ++i) {
+		std::unique_ptr<AtomicContainerDataInherit> rcd(
+			new BenchDataInherit(payload.data(), payload_bytes));
+		dd.push(rcd);
+	}
+	wait_processed(num_processed, num_items);
+
+	BenchResult r;
+	r.name = "desync_inherit";
+	r.seconds = timer.seconds();
+	r.params.push_back(std::make_pair("payload_bytes",
+		static_cast<double>(payload_bytes)));
+	r.iterations = num_items;
+	r.bytes = num_items * payload_bytes;
+	add_metrics(dd.metrics(), r);
+	dd.close();
+	ctx.report(r);
+}
+//-----------------------------------------------------------------------------
+void bench_copy_from(const BenchContext &ctx, size_t payload_bytes,
+	BufferPool *buffer_pool) {
+	std::vector<char> payload(payload_bytes, 1);
+	AtomicContainerData rcd;
+	rcd.set_buffer_pool(buffer_pool);
+
+	BenchResult r;
+	r.name = buffer_pool ? "copy_from_pool" : "copy_from";
+	r.params.push_back(std::make_pair("payload_bytes",
+		static_cast<double>(payload_bytes)));
+	BenchTimer timer;
+	// Check the time every batch of copies
+	size_t batch = (std::max)(static_cast<size_t>(1),
+		(16 * 1024 * 1024) / payload_bytes);
+	while (timer.seconds() < ctx.min_time_s) {
+		for (size_t i = 0; i < batch; ++i) {
+			rcd.copyFrom(payload.data(), payload_bytes);
+			rcd.dispose();
+		}
+		r.iterations += batch;
+	}
+	r.seconds = timer.seconds();
+	r.bytes = r.iterations * payload_bytes;
+	ctx.report(r);
+}
+//-----------------------------------------------------------------------------
+void bench_volatile_timed_buffer(const BenchContext &ctx) {
+	// 10 seconds of data at 30fps, the data older than 1s is removed
+	const size_t kNumItems = 300;
+	const double kFrameTime = 1.0 / 30.0;
+	auto obj = std::make_shared<vb::MicroBufferObjBase>();
+
+	BenchResult r_add, r_clean;
+	r_add.name = "volatile_timed_buffer_add";
+	r_clean.name = "volatile_timed_buffer_clean";
+	BenchTimer timer;
+	while (timer.seconds() < ctx.min_time_s) {
+		vb::VolatileTimedBuffer vtb;
+		BenchTimer t;
+		for (size_t i = 0; i < kNumItems; ++i) {
+			vtb.add_forceexpand(i * kFrameTime, obj);
+		}
+		r_add.seconds += t.seconds();
+		r_add.iterations += kNumItems;
+
+		t.reset();
+		for (size_t i = 0; i < kNumItems; ++i) {
+			vtb.clean_buffer(i * kFrameTime, 1.0);
+		}
+		r_clean.seconds += t.seconds();
+		r_clean.iterations += kNumItems;
+	}
+	ctx.report(r_add);
+	ctx.report(r_clean);
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+void run_buffer_benchmarks(const BenchContext &ctx) {
+	for (size_t payload_bytes : kPayloadSizes) {
+		if (ctx.enabled("desync_generic")) {
+			bench_desync_generic(ctx, payload_bytes);
+		}
+		if (ctx.enabled("desync_faster")) {
+			bench_desync_faster(ctx, payload_bytes,
+				DesynchronizerQueueMode::Mutex);
+			bench_desync_faster(ctx, payload_bytes,
+				DesynchronizerQueueMode::RingSPSC);
+			bench_desync_faster(ctx, payload_bytes,
+				DesynchronizerQueueMode::RingMPSC);
+		}
+		if (ctx.enabled("desync_inherit")) {
+			bench_desync_inherit(ctx, payload_bytes);
+		}
+	}
+
+	BufferPool buffer_pool;
+	for (size_t payload_bytes : kPayloadSizes) {
+		if (ctx.enabled("copy_from")) {
+			bench_copy_from(ctx, payload_bytes, nullptr);
+			bench_copy_from(ctx, payload_bytes, &buffer_pool);
+		}
+	}
+
+	if (ctx.enabled("volatile_timed_buffer")) {
+		bench_volatile_timed_buffer(ctx);
+	}
+}
+
+} // namespace bench
+} // namespace storedata
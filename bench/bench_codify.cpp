@@ -0,0 +1,102 @@
+/* @file bench_codify.cpp
+ * @brief Benchmarks of the codify module.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "codify/codify.hpp"
+
+#include "bench_common.hpp"
+
+namespace storedata
+{
+namespace bench
+{
+
+namespace
+{
+
+//-----------------------------------------------------------------------------
+void bench_codify_image(const BenchContext &ctx, size_t data_bytes) {
+	// Same block size and offset of sample_codify
+	const int k = 1;
+	const int offset = 1;
+	cv::Mat frame(480, 640, CV_8UC3, cv::Scalar::all(0));
+	cv::Mat m;
+	codify::CodifyImage::estimate_data_size(frame, data_bytes + sizeof(size_t),
+		k, offset, m);
+
+	std::vector<unsigned char> data(data_bytes);
+	for (size_t i = 0; i < data_bytes; ++i) {
+		data[i] = static_cast<unsigned char>(i);
+	}
+	std::vector<unsigned char> data_out(data_bytes);
+
+	BenchResult r_enc, r_dec;
+	r_enc.name = "codify_data2image";
+	r_dec.name = "codify_image2data";
+	r_enc.params.push_back(std::make_pair("data_bytes",
+		static_cast<double>(data_bytes)));
+	r_dec.params = r_enc.params;
+	size_t num_errors = 0;
+	BenchTimer timer;
+	while (timer.seconds() < ctx.min_time_s) {
+		int x = offset, y = offset;
+		BenchTimer t;
+		codify::CodifyImage::data2image(data.data(), data_bytes, k, offset,
+			m, x, y);
+		r_enc.seconds += t.seconds();
+		++r_enc.iterations;
+
+		x = offset;
+		y = offset;
+		size_t len = 0;
+		t.reset();
+		codify::CodifyImage::image2data(m, x, y, k, offset, sizeof(size_t),
+			data_out.data(), data_out.size(), len);
+		r_dec.seconds += t.seconds();
+		++r_dec.iterations;
+		if (len != data_bytes || data_out != data) ++num_errors;
+	}
+	r_enc.bytes = r_enc.iterations * data_bytes;
+	r_dec.bytes = r_dec.iterations * data_bytes;
+	r_dec.extra.push_back(std::make_pair("errors",
+		static_cast<double>(num_errors)));
+	ctx.report(r_enc);
+	ctx.report(r_dec);
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+void run_codify_benchmarks(const BenchContext &ctx) {
+	const size_t kDataSizes[] = { 64, 512, 2048 };
+	for (size_t data_bytes : kDataSizes) {
+		if (ctx.enabled("codify")) {
+			bench_codify_image(ctx, data_bytes);
+		}
+	}
+}
+
+} // namespace bench
+} // namespace storedata
@@ -0,0 +1,151 @@
+/**
+* @file bench_common.hpp
+* @brief Helpers shared by the benchmarks.
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_BENCH_BENCH_COMMON_HPP__
+#define STOREDATA_BENCH_BENCH_COMMON_HPP__
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <utility>
+
+#include "version/version.hpp"
+
+namespace storedata
+{
+namespace bench
+{
+
+/** @brief Result of a benchmark. It is written as one JSON object per line.
+*/
+struct BenchResult
+{
+	/** @brief Name of the benchmark (e.g. desync_generic)
+	*/
+	std::string name;
+	/** @brief Parameters of the run (e.g. payload_bytes)
+	*/
+	std::vector<std::pair<std::string, double>> params;
+	/** @brief Number of operations executed
+	*/
+	size_t iterations;
+	/** @brief Bytes processed by all the operations
+	*/
+	size_t bytes;
+	/** @brief Elapsed time
+	*/
+	double seconds;
+	/** @brief Additional measures (e.g. p99_queue_us)
+	*/
+	std::vector<std::pair<std::string, double>> extra;
+
+	BenchResult() : iterations(0), bytes(0), seconds(0) {}
+};
+
+/** @brief Options of the run
+*/
+struct BenchContext
+{
+	/** @brief Only the benchmarks which name contains the filter are run
+	*/
+	std::string filter;
+	/** @brief Minimum time of each measure
+	*/
+	double min_time_s;
+	/** @brief Where the results are written (JSON lines)
+	*/
+	std::ostream *out;
+
+	BenchContext() : min_time_s(0.5), out(&std::cout) {}
+
+	/** @brief It returns true if the benchmark has to be run
+	*/
+	bool enabled(const std::string &name) const {
+		return filter.empty() || name.find(filter) != std::string::npos;
+	}
+
+	/** @brief It writes the result as a JSON line
+	*/
+	void report(const BenchResult &r) const {
+		std::ostringstream ss;
+		ss.precision(12);
+		ss << "{\"name\":\"" << r.name << "\",\"version\":\"" << 
+			SD_VERSION << "\",\"params\":{";
+		for (size_t i = 0; i < r.params.size(); ++i) {
+			ss << (i ? "," : "") << "\"" << r.params[i].first << "\":" <<
+				r.params[i].second;
+		}
+		double ns_per_op = r.iterations > 0 ? 
+			r.seconds * 1e9 / r.iterations : 0;
+		double ops_per_s = r.seconds > 0 ? r.iterations / r.seconds : 0;
+		double mb_per_s = r.seconds > 0 ? 
+			r.bytes / (1024.0 * 1024.0) / r.seconds : 0;
+		ss << "},\"iterations\":" << r.iterations << ",\"seconds\":" << 
+			r.seconds << ",\"ns_per_op\":" << ns_per_op << 
+			",\"ops_per_s\":" << ops_per_s << ",\"mb_per_s\":" << mb_per_s;
+		for (auto &it : r.extra) {
+			ss << ",\"" << it.first << "\":" << it.second;
+		}
+		ss << "}";
+		(*out) << ss.str() << std::endl;
+	}
+};
+
+/** @brief Monotonic stopwatch
+*/
+class BenchTimer
+{
+public:
+	BenchTimer() : start_(std::chrono::steady_clock::now()) {}
+
+	void reset() {
+		start_ = std::chrono::steady_clock::now();
+	}
+
+	double seconds() const {
+		return std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start_).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start_;
+};
+
+/** @brief Benchmarks of the buffer module
+*/
+void run_buffer_benchmarks(const BenchContext &ctx);
+
+/** @brief Benchmarks of the record module
+*/
+void run_record_benchmarks(const BenchContext &ctx);
+
+/** @brief Benchmarks of the codify module
+*/
+void run_codify_benchmarks(const BenchContext &ctx);
+
+} // namespace bench
+} // namespace storedata
+
+#endif // STOREDATA_BENCH_BENCH_COMMON_HPP__
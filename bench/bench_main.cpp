@@ -0,0 +1,67 @@
+/* @file bench_main.cpp
+ * @brief Entry point of the benchmarks. The results are written as JSON lines.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+
+#include "bench_common.hpp"
+
+/** @brief It displays the usage
+*/
+void help() {
+	std::cout << "storedata_bench [options]" << std::endl;
+	std::cout << "  --filter <text>    run only the benchmarks containing text" << std::endl;
+	std::cout << "  --min-time <s>     minimum time of each measure (0.5)" << std::endl;
+	std::cout << "  --out <file>       append the JSON lines to file (stdout)" << std::endl;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[]) {
+	storedata::bench::BenchContext ctx;
+	std::ofstream fout;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc) {
+			ctx.filter = argv[++i];
+		} else if (arg == "--min-time" && i + 1 < argc) {
+			ctx.min_time_s = std::atof(argv[++i]);
+		} else if (arg == "--out" && i + 1 < argc) {
+			fout.open(argv[++i], std::ios::app);
+			if (!fout.is_open()) {
+				std::cerr << "Cannot open: " << argv[i] << std::endl;
+				return 1;
+			}
+			ctx.out = &fout;
+		} else {
+			help();
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+
+	storedata::bench::run_buffer_benchmarks(ctx);
+	storedata::bench::run_record_benchmarks(ctx);
+	storedata::bench::run_codify_benchmarks(ctx);
+	return 0;
+}
@@ -0,0 +1,105 @@
+/* @file bench_record.cpp
+ * @brief Benchmarks of the record module.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include <vector>
+#include <map>
+
+#define BOOST_BUILD
+#include <boost/filesystem.hpp>
+
+#include "record/record_headers.hpp"
+
+#include "bench_common.hpp"
+
+namespace storedata
+{
+namespace bench
+{
+
+namespace
+{
+
+//-----------------------------------------------------------------------------
+void bench_file_generator_async(const BenchContext &ctx,
+	size_t payload_bytes) {
+	boost::filesystem::path folder = boost::filesystem::temp_directory_path() /
+		boost::filesystem::unique_path("storedata_bench_%%%%%%%%");
+	boost::filesystem::create_directories(folder);
+
+	{
+		FileGeneratorManagerAsync fgm;
+		std::map<int, FileGeneratorParams> fgp;
+		fgp.insert(std::make_pair(0, FileGeneratorParams()));
+		fgp[0].set_filename((folder / "bench_").string());
+		fgp[0].set_dot_extension(".dat");
+		// New file every 64MB, no frame rate limit
+		fgm.setup(64 * 1024 * 1024, fgp, -1);
+
+		std::map<int, std::vector<char> > data;
+		data[0] = std::vector<char>(payload_bytes, 1);
+
+		BenchResult r;
+		r.name = "file_generator_async";
+		r.params.push_back(std::make_pair("payload_bytes",
+			static_cast<double>(payload_bytes)));
+		size_t num_rejected = 0;
+		BenchTimer timer;
+		while (timer.seconds() < ctx.min_time_s) {
+			if (fgm.push_data_write_not_guarantee_can_replace(data) ==
+				kSuccess) {
+				++r.iterations;
+			} else {
+				++num_rejected;
+			}
+		}
+		// The pending data is written before close returns
+		fgm.close();
+		r.seconds = timer.seconds();
+		// A data replaced before the writer took it is lost
+		size_t num_lost = num_rejected + fgm.num_replaced();
+		size_t num_written = r.iterations - fgm.num_replaced();
+		r.bytes = num_written * payload_bytes;
+		r.extra.push_back(std::make_pair("written",
+			static_cast<double>(num_written)));
+		r.extra.push_back(std::make_pair("lost",
+			static_cast<double>(num_lost)));
+		ctx.report(r);
+	}
+
+	boost::system::error_code ec;
+	boost::filesystem::remove_all(folder, ec);
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+void run_record_benchmarks(const BenchContext &ctx) {
+	const size_t kPayloadSizes[] = { 4 * 1024, 64 * 1024, 1024 * 1024 };
+	for (size_t payload_bytes : kPayloadSizes) {
+		if (ctx.enabled("file_generator_async")) {
+			bench_file_generator_async(ctx, payload_bytes);
+		}
+	}
+}
+
+} // namespace bench
+} // namespace storedata
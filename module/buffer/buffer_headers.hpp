@@ -26,6 +26,10 @@
 
 #include "buffer/inc/buffer/MicroBuffer.hpp"
 #include "buffer/inc/buffer/VolatileTimedBuffer.hpp"
+#include "buffer/inc/buffer/BufferPool.hpp"
+#include "buffer/inc/buffer/wait_deadline.hpp"
+#include "buffer/inc/buffer/CallbackWorkerPool.hpp"
+#include "buffer/inc/buffer/DesynchronizerMetrics.hpp"
 #include "buffer/inc/buffer/DataDesynchronizerGeneric.hpp"
 #include "buffer/inc/buffer/DataDesynchronizerGenericFaster.hpp"
 #include "buffer/inc/buffer/DataDesynchronizerGenericInherit.hpp"
@@ -26,8 +26,10 @@
 #define STOREDATA_BUFFER_ATOMICCONTAINERDATA_HPP__
 
 #include <cstring>
+#include <cstdint>
 #include <memory>
 #include "buffer_defines.hpp"
+#include "BufferPool.hpp"
 
 namespace storedata
 {
@@ -39,16 +41,34 @@ class AtomicContainerData
 public:
 
 	STOREDATA_BUFFER_EXPORT AtomicContainerData();
+	/** @brief It sets the pool used to allocate the data. If nullptr the
+	           data is allocated with malloc.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_buffer_pool(BufferPool* buffer_pool);
+	/** @brief It allocates a buffer of size_bytes to be filled in place.
+	*/
+	STOREDATA_BUFFER_EXPORT void* allocate(size_t size_bytes);
 	STOREDATA_BUFFER_EXPORT void copyFrom(const void* src, size_t src_size_bytes);
 	STOREDATA_BUFFER_EXPORT void copyFrom(AtomicContainerData &obj);
 	STOREDATA_BUFFER_EXPORT void dispose();
 	STOREDATA_BUFFER_EXPORT void* data();
 	STOREDATA_BUFFER_EXPORT size_t size_bytes();
+	/** @brief Time of the push in a desynchronizer (microseconds, see
+	           DesynchronizerMetrics::now_us).
+	*/
+	STOREDATA_BUFFER_EXPORT void set_enqueue_time_us(int64_t enqueue_time_us);
+	STOREDATA_BUFFER_EXPORT int64_t enqueue_time_us();
 
 private:
 
 	void* data_;
 	size_t size_bytes_;
+	// Real size of the allocated buffer
+	size_t capacity_bytes_;
+	// Pool that owns the buffer (nullptr if allocated with malloc)
+	BufferPool* buffer_pool_;
+	// Time of the push
+	int64_t enqueue_time_us_;
 
 };
 
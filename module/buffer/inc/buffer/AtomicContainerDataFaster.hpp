@@ -26,9 +26,14 @@
 #define STOREDATA_BUFFER_ATOMICCONTAINERDATAFASTER_HPP__
 
 #include <cstring>
+#include <cstdint>
 #include <string>
 #include <memory>
+
+#include <opencv2/opencv.hpp>
+
 #include "buffer_defines.hpp"
+#include "BufferPool.hpp"
 
 namespace storedata
 {
@@ -43,14 +48,48 @@ public:
 
 	STOREDATA_BUFFER_EXPORT void set_unique_msg(const std::string &unique_msg);
 
+	/** @brief It sets the pool used to allocate the copied data. If nullptr
+	           the data is allocated with malloc.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_buffer_pool(BufferPool* buffer_pool);
+
+	/** @brief It allocates a buffer of size_bytes to be filled in place.
+	*/
+	STOREDATA_BUFFER_EXPORT void* allocate(size_t src_size_bytes);
+
 	STOREDATA_BUFFER_EXPORT void copyFrom(const void* src, size_t src_size_bytes);
 
 	STOREDATA_BUFFER_EXPORT void copyFrom(AtomicContainerDataFaster &obj);
 
 	STOREDATA_BUFFER_EXPORT void assignFrom(void* src, size_t src_size_bytes);
 
+	/** @brief It shares the data of obj. If obj holds a reference counted 
+	           payload, the reference is shared too.
+	*/
 	STOREDATA_BUFFER_EXPORT void assignFrom(AtomicContainerDataFaster &obj);
 
+	/** @brief It keeps a reference to the image without copying the pixels.
+
+		The image memory is released when the last reference (the caller or
+		this container) is released. A not continuous image is copied.
+	*/
+	STOREDATA_BUFFER_EXPORT void assignFrom(const cv::Mat &img);
+
+	/** @brief It keeps the holder alive until the data is disposed.
+
+		The holder custom deleter releases the memory (e.g. it returns a
+		buffer to the camera driver).
+		@param[in] holder Owner of the memory pointed by src.
+		@param[in] src Pointer to the data.
+		@param[in] src_size_bytes Size of the data.
+	*/
+	STOREDATA_BUFFER_EXPORT void assignFrom(std::shared_ptr<void> holder,
+		void* src, size_t src_size_bytes);
+
+	/** @brief It returns the image passed with assignFrom (empty otherwise).
+	*/
+	STOREDATA_BUFFER_EXPORT const cv::Mat& mat();
+
 	STOREDATA_BUFFER_EXPORT void dispose();
 
 	STOREDATA_BUFFER_EXPORT std::string unique_msg();
@@ -61,13 +100,29 @@ public:
 
 	STOREDATA_BUFFER_EXPORT bool safe_dispose();
 
+	/** @brief Time of the push in a desynchronizer (microseconds, see
+	           DesynchronizerMetrics::now_us).
+	*/
+	STOREDATA_BUFFER_EXPORT void set_enqueue_time_us(int64_t enqueue_time_us);
+	STOREDATA_BUFFER_EXPORT int64_t enqueue_time_us();
+
 private:
 
 	// Associated unique message to the container data
 	std::string unique_msg_;
 	void* data_;
 	size_t size_bytes_;
+	// Real size of the allocated buffer
+	size_t capacity_bytes_;
+	// Pool that owns the buffer (nullptr if allocated with malloc)
+	BufferPool* buffer_pool_;
 	bool safe_dispose_;
+	// Reference counted image (zero copy)
+	cv::Mat mat_;
+	// Reference counted owner of the data (zero copy)
+	std::shared_ptr<void> holder_;
+	// Time of the push
+	int64_t enqueue_time_us_;
 };
 
 } // namespace storedata
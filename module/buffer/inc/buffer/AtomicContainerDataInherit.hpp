@@ -25,6 +25,7 @@
 #ifndef STOREDATA_BUFFER_ATOMICCONTAINERDATAINHERIT_HPP__
 #define STOREDATA_BUFFER_ATOMICCONTAINERDATAINHERIT_HPP__
 
+#include <cstdint>
 #include <string>
 #include <memory>
 #include "buffer_defines.hpp"
@@ -38,10 +39,29 @@ class STOREDATA_BUFFER_EXPORT AtomicContainerDataInherit
 {
 public:
 
+	AtomicContainerDataInherit() : enqueue_time_us_(0) {}
 	virtual ~AtomicContainerDataInherit() {}
 	virtual void* getObject(int which) = 0;
 
 	virtual void dispose() = 0;
+
+	/** @brief Key used to keep the order of the data processed by a pool of
+	           threads. The data with the same key is processed in order.
+	*/
+	virtual std::string unique_msg() { return std::string(); }
+
+	/** @brief Time of the push in a desynchronizer (microseconds, see
+	           DesynchronizerMetrics::now_us).
+	*/
+	void set_enqueue_time_us(int64_t enqueue_time_us) {
+		enqueue_time_us_ = enqueue_time_us;
+	}
+	int64_t enqueue_time_us() { return enqueue_time_us_; }
+
+private:
+
+	// Time of the push
+	int64_t enqueue_time_us_;
 };
 
 } // namespace storedata
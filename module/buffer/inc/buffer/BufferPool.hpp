@@ -0,0 +1,157 @@
+/**
+* @file BufferPool.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+
+#ifndef STOREDATA_BUFFER_BUFFERPOOL_HPP__
+#define STOREDATA_BUFFER_BUFFERPOOL_HPP__
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+
+#include "buffer_defines.hpp"
+
+namespace storedata
+{
+
+/** @brief Statistics of a buffer pool
+*/
+struct BufferPoolStats
+{
+	/** @brief Number of acquire served by a cached buffer
+	*/
+	size_t hits;
+	/** @brief Number of acquire that required a new allocation
+	*/
+	size_t misses;
+	/** @brief Bytes acquired and not released yet
+	*/
+	size_t bytes_in_use;
+	/** @brief Maximum value reached by bytes_in_use
+	*/
+	size_t bytes_in_use_high_water;
+	/** @brief Bytes kept in the free lists
+	*/
+	size_t bytes_cached;
+	/** @brief Maximum value reached by bytes_cached
+	*/
+	size_t bytes_cached_high_water;
+
+	BufferPoolStats() : hits(0), misses(0), bytes_in_use(0),
+		bytes_in_use_high_water(0), bytes_cached(0),
+		bytes_cached_high_water(0) {}
+};
+
+/** @brief Thread safe pool of memory buffers divided in size classes.
+
+	A request is rounded up to its size class (four classes for each power
+	of two, so that the wasted memory is less than 25%). The released
+	buffers are kept in a free list for each class and returned by the next
+	acquire of the same class. When the cached memory exceeds the maximum,
+	the released buffers are freed.
+*/
+class BufferPool
+{
+public:
+
+	/** @brief It creates the pool.
+
+		@param[in] max_cached_bytes Maximum bytes kept in the free lists.
+	*/
+	STOREDATA_BUFFER_EXPORT explicit BufferPool(
+		size_t max_cached_bytes = 512 * 1024 * 1024);
+
+	STOREDATA_BUFFER_EXPORT ~BufferPool();
+
+	/** @brief It returns a buffer of at least size_bytes.
+
+		@param[in] size_bytes Requested size.
+		@param[out] capacity_bytes Real size of the buffer. It must be passed
+		            to release.
+		@return It returns the buffer. Nullptr if the allocation fails.
+	*/
+	STOREDATA_BUFFER_EXPORT void* acquire(size_t size_bytes,
+		size_t &capacity_bytes);
+
+	/** @brief It returns a buffer to the pool.
+
+		@param[in] ptr Buffer obtained with acquire.
+		@param[in] capacity_bytes Capacity returned by acquire.
+	*/
+	STOREDATA_BUFFER_EXPORT void release(void* ptr, size_t capacity_bytes);
+
+	/** @brief It frees all the cached buffers.
+	*/
+	STOREDATA_BUFFER_EXPORT void clear();
+
+	/** @brief It sets the maximum bytes kept in the free lists.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_max_cached_bytes(size_t max_cached_bytes);
+
+	/** @brief It returns a snapshot of the statistics.
+	*/
+	STOREDATA_BUFFER_EXPORT BufferPoolStats stats();
+
+	/** @brief It returns the capacity of the size class used for size_bytes.
+	*/
+	STOREDATA_BUFFER_EXPORT static size_t capacity_for(size_t size_bytes);
+
+private:
+
+	/** @brief Free list of a size class
+	*/
+	struct SizeClass
+	{
+		std::mutex mtx;
+		std::vector<void*> free_list;
+	};
+
+	/** @brief Size classes (indexed by class_index)
+	*/
+	std::unique_ptr<SizeClass[]> classes_;
+	/** @brief Maximum bytes kept in the free lists
+	*/
+	std::atomic<size_t> max_cached_bytes_;
+
+	std::atomic<size_t> hits_;
+	std::atomic<size_t> misses_;
+	std::atomic<size_t> bytes_in_use_;
+	std::atomic<size_t> bytes_in_use_high_water_;
+	std::atomic<size_t> bytes_cached_;
+	std::atomic<size_t> bytes_cached_high_water_;
+
+	/** @brief It returns the index of the size class and its capacity.
+	*/
+	static size_t class_index(size_t size_bytes, size_t &capacity_bytes);
+
+	/** @brief It updates a high water mark.
+	*/
+	static void update_high_water(std::atomic<size_t> &high_water,
+		size_t value);
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_BUFFER_BUFFERPOOL_HPP__
@@ -0,0 +1,155 @@
+/**
+* @file CallbackWorkerPool.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+
+#ifndef STOREDATA_BUFFER_CALLBACKWORKERPOOL_HPP__
+#define STOREDATA_BUFFER_CALLBACKWORKERPOOL_HPP__
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <thread>             // std::thread
+#include <mutex>              // std::mutex, std::unique_lock
+#include <condition_variable> // std::condition_variable
+
+#include "buffer_defines.hpp"
+
+namespace storedata
+{
+
+/** @brief Pool of threads that runs the callbacks of a desynchronizer.
+
+	The pool has one or more lanes. Each lane is a bounded FIFO queue of
+	tasks: dispatch waits while the lane is full, so the data waits in the
+	queue of the caller (i.e. subject to its backpressure).
+	- Unordered: one lane shared by all the workers. The tasks are executed
+	  as soon as a worker is free (no order guarantee).
+	- Ordered: one lane for each worker. A task is assigned to the lane
+	  selected by the hash of its key, so the tasks with the same key are
+	  executed in the same order they were dispatched.
+*/
+class CallbackWorkerPool
+{
+public:
+
+	STOREDATA_BUFFER_EXPORT CallbackWorkerPool();
+
+	STOREDATA_BUFFER_EXPORT ~CallbackWorkerPool();
+
+	/** @brief It starts the workers.
+
+		@param[in] num_workers Number of threads (at least 1).
+		@param[in] ordered If true the tasks with the same key keep the order.
+		@param[in] max_tasks_per_worker Max tasks queued in a lane for each
+		           worker of the lane (0 unbounded).
+		@return It returns true in case of success. False if already running.
+	*/
+	STOREDATA_BUFFER_EXPORT bool start(size_t num_workers, bool ordered,
+		size_t max_tasks_per_worker = 2);
+
+	/** @brief It waits until all the dispatched tasks are executed and it
+	           joins the workers.
+	*/
+	STOREDATA_BUFFER_EXPORT void stop();
+
+	/** @brief It adds a task to execute.
+
+		If the pool is not running, the task is executed by the caller. If
+		the lane is full, it waits until a worker takes a task.
+		@param[in] key Key used to select the lane in ordered mode.
+		@param[in] task Task to execute.
+	*/
+	STOREDATA_BUFFER_EXPORT void dispatch(const std::string &key,
+		std::function<void()> task);
+
+	/** @brief It blocks until all the dispatched tasks are executed.
+	*/
+	STOREDATA_BUFFER_EXPORT void wait_until_idle();
+
+	/** @brief It returns the number of tasks queued or under execution.
+	*/
+	STOREDATA_BUFFER_EXPORT size_t size_about();
+
+	/** @brief It returns true if the workers are running.
+	*/
+	STOREDATA_BUFFER_EXPORT bool is_running();
+
+	/** @brief It sets the function called by a worker after the last
+	           pending task is executed. It must be set before start.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_idle_callback(
+		std::function<void()> callback);
+
+private:
+
+	/** @brief Queue of tasks served by one or more workers
+	*/
+	struct Lane
+	{
+		std::mutex mtx;
+		std::condition_variable cond;
+		/** @brief The dispatch waits for space
+		*/
+		std::condition_variable cond_space;
+		std::deque<std::function<void()>> tasks;
+		/** @brief Max queued tasks (0 unbounded)
+		*/
+		size_t max_tasks;
+
+		Lane() : max_tasks(0) {}
+	};
+
+	/** @brief Lanes (one if unordered, one for each worker if ordered)
+	*/
+	std::vector<std::unique_ptr<Lane>> lanes_;
+	/** @brief Worker threads
+	*/
+	std::vector<std::thread> workers_;
+	/** @brief Tasks queued or under execution
+	*/
+	std::atomic<size_t> num_pending_;
+	/** @brief If false the workers quit when their lane is empty
+	*/
+	std::atomic<bool> continue_run_;
+	/** @brief True between start and stop
+	*/
+	std::atomic<bool> is_running_;
+	/** @brief Used to wait until all the tasks are executed
+	*/
+	std::mutex mtx_idle_;
+	std::condition_variable cond_idle_;
+	/** @brief Called when num_pending_ becomes 0
+	*/
+	std::function<void()> idle_callback_;
+
+	/** @brief Function executed by each worker
+	*/
+	void worker_thread(Lane *lane);
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_BUFFER_CALLBACKWORKERPOOL_HPP__
@@ -31,11 +31,15 @@
 #include <thread>             // std::thread, std::this_thread::yield
 #include <mutex>              // std::mutex, std::unique_lock
 #include <condition_variable> // std::condition_variable
+#include <atomic>
 
 #include <opencv2/opencv.hpp>
 
 #include "logger/inc/logger/log.hpp"
 #include "AtomicContainerData.hpp"
+#include "CallbackWorkerPool.hpp"
+#include "DesynchronizerMetrics.hpp"
+#include "wait_deadline.hpp"
 
 namespace storedata
 {
@@ -46,6 +50,66 @@ namespace storedata
 */
 typedef std::function<void(const std::string &msg, AtomicContainerData &rcd)> cbk_func;
 
+/** @brief Function to process a batch of data
+
+	Callback function to process all the data pending in the queue.
+*/
+typedef std::function<void(std::vector<std::pair<std::string, AtomicContainerData>> &batch)> cbk_func_batch;
+
+/** @brief What push does when the queue is at capacity.
+*/
+enum class BackpressurePolicy : int
+{
+	None = 0,         // Unbounded queue (capacity ignored)
+	BlockTimeout = 1, // Wait for space, drop the new data on timeout
+	DropNewest = 2,   // Drop the new data
+	DropOldest = 3,   // Drop the oldest queued data to make space
+	KeepEveryNth = 4  // Keep one new data every N (dropping the oldest)
+};
+
+/** @brief Capacity of the queue and behaviour when it is full.
+*/
+struct BackpressureParams
+{
+	BackpressurePolicy policy;
+	/** @brief Maximum number of queued items (0 no limit)
+	*/
+	size_t max_items;
+	/** @brief Maximum number of queued bytes (0 no limit)
+	*/
+	size_t max_bytes;
+	/** @brief Maximum wait for BlockTimeout. Negative waits forever.
+	*/
+	int block_timeout_ms;
+	/** @brief N for KeepEveryNth
+	*/
+	size_t keep_every_nth;
+
+	BackpressureParams() : policy(BackpressurePolicy::None), max_items(0),
+		max_bytes(0), block_timeout_ms(100), keep_every_nth(2) {}
+};
+
+/** @brief Counters of the backpressure.
+*/
+struct BackpressureStats
+{
+	/** @brief Items dropped because the queue was full
+	*/
+	size_t dropped_items;
+	/** @brief Bytes dropped because the queue was full
+	*/
+	size_t dropped_bytes;
+	/** @brief Push calls that waited for space (BlockTimeout)
+	*/
+	size_t blocked_pushes;
+	/** @brief Bytes currently queued
+	*/
+	size_t queued_bytes;
+
+	BackpressureStats() : dropped_items(0), dropped_bytes(0),
+		blocked_pushes(0), queued_bytes(0) {}
+};
+
 
 /** @brief Class to record all the frames currently captured
 */
@@ -56,9 +120,32 @@ public:
 
 	STOREDATA_BUFFER_EXPORT DataDesynchronizerGeneric();
 
+	/** @brief It stops and joins the internal thread.
+	*/
+	STOREDATA_BUFFER_EXPORT ~DataDesynchronizerGeneric();
+
 	/** @brief It push a new frame to save
+
+		The queue takes the ownership of the data. If the data is dropped
+		by the backpressure policy, it is disposed. A push blocked by
+		BlockTimeout drops the data when the desynchronizer is stopped.
+		@return It returns true if the data is queued. False if dropped.
+	*/
+	STOREDATA_BUFFER_EXPORT bool push(const std::string &msg, AtomicContainerData &rcd);
+
+	/** @brief It sets the capacity of the queue and the policy used when
+	           it is full.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_backpressure(
+		const BackpressureParams &backpressure_params);
+
+	/** @brief It returns the backpressure counters.
 	*/
-	STOREDATA_BUFFER_EXPORT void push(const std::string &msg, AtomicContainerData &rcd);
+	STOREDATA_BUFFER_EXPORT BackpressureStats backpressure_stats();
+
+	/** @brief It resets the dropped and blocked counters.
+	*/
+	STOREDATA_BUFFER_EXPORT void reset_backpressure_stats();
 
 	/** @brief It starts the thread
 	*/
@@ -68,6 +155,16 @@ public:
 	*/
 	STOREDATA_BUFFER_EXPORT void stop();
 
+	/** @brief It processes the queued data, then it stops and joins the 
+	           internal thread.
+
+		@param[in] deadline Maximum time to wait. If expired, the thread
+		           stops after the current data and it is not joined.
+		@return It returns true if the thread is joined before the deadline.
+	*/
+	STOREDATA_BUFFER_EXPORT bool drain_and_join(
+		std::chrono::steady_clock::time_point deadline);
+
 	/** @brief It close the recording files
 	*/
 	STOREDATA_BUFFER_EXPORT void close();
@@ -78,29 +175,63 @@ public:
 
 	/** @brief It sets the save boosting. If true it use multiple threads to
 	save.
+
+		The internal thread dispatches the callbacks to a pool of
+		max_threads workers. The callback must be thread safe. When it is
+		disabled, the workers are stopped after the dispatched data.
 	*/
 	STOREDATA_BUFFER_EXPORT void set_save_boost(bool save_boost);
 
-	/** @brief It returns the about size of the writing queue
+	/** @brief It sets the maximum number of threads used with the save
+	           boosting. It is applied at the next pool start.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_max_threads(int max_threads);
+
+	/** @brief If true, with the save boosting the data with the same unique
+	           message is processed in the same order it was pushed.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_save_boost_ordered(bool ordered);
+
+	/** @brief It returns the exact number of data queued, under 
+	           processing or dispatched to the save boosting pool.
 	*/
 	STOREDATA_BUFFER_EXPORT size_t size_about();
 
+	/** @brief It returns a snapshot of the counters and histograms (rate,
+	           depth, time in queue, callback duration, drops).
+	*/
+	STOREDATA_BUFFER_EXPORT DesynchronizerMetricsSnapshot metrics();
+
+	/** @brief It resets the counters and histograms.
+	*/
+	STOREDATA_BUFFER_EXPORT void reset_metrics();
+
+	/** @brief It writes the metrics with LogMS every period_ms (0 disables).
+
+		The log is written by the internal thread after a processed data.
+		@param[in] name Name written in the log.
+		@param[in] period_ms Period of the log.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_metrics_log(const std::string &name,
+		int period_ms);
+
 	/** @brief It returns the running status
 	*/
 	STOREDATA_BUFFER_EXPORT bool is_running();
 
-	/** @brief Since the internal thread is detached, it is necessary to 
-	           wait until is not ready.
+	/** @brief It waits until the internal thread is not running.
 
-		The function try to stop for n iterations and wait m ms.
+		The maximum wait is num_iterations * sleep_ms milliseconds (see
+		wait_deadline).
 		@return It returns true in case of success. False otherwise.
 	*/
 	STOREDATA_BUFFER_EXPORT bool wait_until_is_not_ready(size_t num_iterations, int sleep_ms);
 
-	/** @brief Since the internal thread is detached, it is necessary to
-		   wait until is not ready.
+	/** @brief It waits until all the queued data is processed (or the
+	           internal thread is not running).
 
-		The function try to stop for n iterations and wait m ms.
+		The maximum wait is num_iterations * sleep_ms milliseconds (see
+		wait_deadline).
 		@return It returns true in case of success. False otherwise.
 	*/
 	STOREDATA_BUFFER_EXPORT bool wait_until_buffer_is_empty(size_t num_iterations, int sleep_ms);
@@ -110,6 +241,16 @@ public:
 	STOREDATA_BUFFER_EXPORT void set_cbk_func(
 		cbk_func callback_func);
 
+	/** @brief It sets the callback that receives all the pending data at once
+
+		If set, it is used instead of the single element callback. The
+		internal thread takes the whole queue with a single lock and passes
+		it as one batch. The data is disposed after the callback.
+		The batch is processed by the internal thread (no save boosting).
+	*/
+	STOREDATA_BUFFER_EXPORT void set_cbk_func_batch(
+		cbk_func_batch callback_func);
+
 private:
 
 	/** @brief Mutex to prevent race condition
@@ -121,10 +262,21 @@ private:
 	/** @brief Var used to the condition variable
 	*/
 	bool data_ready_ = false;
-	/** @brief Number of threads that are writing (it does not include the
-	class internal thread)
+	/** @brief Producers wait for space (BackpressurePolicy::BlockTimeout)
+	*/
+	std::condition_variable cond_space_;
+	/** @brief Capacity and policy of the queue
+	*/
+	BackpressureParams backpressure_params_;
+	/** @brief Backpressure counters (queued_bytes included)
 	*/
-	int num_threads_;
+	BackpressureStats backpressure_stats_;
+	/** @brief Counter of the push on a full queue (KeepEveryNth)
+	*/
+	size_t num_push_full_;
+	/** @brief Counters and histograms
+	*/
+	DesynchronizerMetrics metrics_;
 	/** @brief Maximum numbers of threads that can be run (except the
 	internal thread)
 	*/
@@ -133,13 +285,30 @@ private:
 	/** @brief If true it creates as many threads as possible
 	*/
 	bool save_boost_;
+	/** @brief If true the pool keeps the order for the same unique message
+	*/
+	bool save_boost_ordered_;
+	/** @brief Threads used to run the callback with the save boosting
+	*/
+	CallbackWorkerPool worker_pool_;
 
 	/** @brief If true it continues to save the data
 	*/
-	bool continue_save_;
+	std::atomic<bool> continue_save_;
 	/** @brief If true is running the internal thread
 	*/
-	bool is_running_;
+	std::atomic<bool> is_running_;
+	/** @brief If true the internal thread processes all the queued data
+	           before to quit
+	*/
+	std::atomic<bool> drain_on_stop_;
+	/** @brief Internal thread
+	*/
+	std::thread thread_;
+	/** @brief Notified when the internal thread quits or the queued data
+	           is processed (see notify_if_empty)
+	*/
+	std::condition_variable cond_state_;
 
 	/** @brief Container with the data to save and a message associated
 	*/
@@ -148,6 +317,36 @@ private:
 	/** @brief Callback recorder function
 	*/
 	cbk_func callback_func_;
+	/** @brief Callback recorder function for a batch of data
+	*/
+	cbk_func_batch callback_func_batch_;
+	/** @brief Batch passed to the callback (reused to avoid allocations)
+	*/
+	std::vector<std::pair<std::string, AtomicContainerData>> batch_;
+	/** @brief Queue swapped with the container to take the pending data
+	*/
+	std::queue<std::pair<std::string, AtomicContainerData>> container_swap_;
+
+	/** @brief It calls the callback and dispose the data
+	*/
+	void process(std::pair<std::string, AtomicContainerData> &tuple);
+	/** @brief It waits for data and it passes all the pending data to the
+	           batch callback.
+
+		@return It returns false if the stop is requested and there is no
+		        data to process.
+	*/
+	bool process_batch();
+	/** @brief It notifies cond_state_ if there is no data to process.
+	*/
+	void notify_if_empty();
+	/** @brief It returns true if the queue cannot accept size_bytes more.
+	           The mutex must be locked.
+	*/
+	bool is_full(size_t size_bytes);
+	/** @brief It drops the oldest queued data. The mutex must be locked.
+	*/
+	void drop_oldest();
 };
 
 
@@ -31,11 +31,16 @@
 #include <thread>             // std::thread, std::this_thread::yield
 #include <mutex>              // std::mutex, std::unique_lock
 #include <condition_variable> // std::condition_variable
+#include <atomic>
 
 #include <opencv2/opencv.hpp>
 
 #include "logger/inc/logger/log.hpp"
 #include "AtomicContainerDataFaster.hpp"
+#include "CallbackWorkerPool.hpp"
+#include "DesynchronizerMetrics.hpp"
+#include "wait_deadline.hpp"
+#include "RingBufferLockFree.hpp"
 
 namespace storedata
 {
@@ -46,6 +51,51 @@ namespace storedata
 */
 typedef std::function<void(std::unique_ptr<AtomicContainerDataFaster> &rcd)> cbk_func_faster;
 
+/** @brief Function to process a batch of data
+
+	Callback function to process all the data pending in the queue.
+*/
+typedef std::function<void(std::vector<std::unique_ptr<AtomicContainerDataFaster>> &batch)> cbk_func_faster_batch;
+
+/** @brief Queue used to pass the data to the internal thread.
+*/
+enum class DesynchronizerQueueMode : int
+{
+	Mutex = 0,    // std::queue protected by a mutex (unbounded)
+	RingSPSC = 1, // Lock-free ring buffer, one producer thread only
+	RingMPSC = 2  // Lock-free ring buffer, many producer threads
+};
+
+/** @brief What push does when the ring buffer is full.
+*/
+enum class DesynchronizerFullPolicy : int
+{
+	Drop = 0, // push returns false immediately
+	Block = 1 // push waits until there is space (or the timeout expires)
+};
+
+/** @brief Parameters for the bounded lock-free mode.
+*/
+struct DesynchronizerRingParams
+{
+	DesynchronizerQueueMode mode;
+	/** @brief Maximum number of elements (rounded to a power of two)
+	*/
+	size_t capacity;
+	DesynchronizerFullPolicy full_policy;
+	/** @brief Maximum wait for the Block policy. Negative waits forever.
+	*/
+	int block_timeout_ms;
+
+	DesynchronizerRingParams() : mode(DesynchronizerQueueMode::Mutex),
+		capacity(256), full_policy(DesynchronizerFullPolicy::Drop),
+		block_timeout_ms(-1) {}
+	DesynchronizerRingParams(DesynchronizerQueueMode _mode, size_t _capacity,
+		DesynchronizerFullPolicy _full_policy = DesynchronizerFullPolicy::Drop,
+		int _block_timeout_ms = -1) : mode(_mode), capacity(_capacity),
+		full_policy(_full_policy), block_timeout_ms(_block_timeout_ms) {}
+};
+
 
 /** @brief Class to record all the frames currently captured
 */
@@ -56,9 +106,25 @@ public:
 
 	STOREDATA_BUFFER_EXPORT DataDesynchronizerGenericFaster();
 
+	/** @brief It stops and joins the internal thread.
+	*/
+	STOREDATA_BUFFER_EXPORT ~DataDesynchronizerGenericFaster();
+
+	/** @brief It creates the object with the selected queue.
+
+		With a ring mode the queue is bounded and push does not take the
+		mutex. The callback contract is the same of the default mode.
+	*/
+	STOREDATA_BUFFER_EXPORT explicit DataDesynchronizerGenericFaster(
+		const DesynchronizerRingParams &ring_params);
+
 	/** @brief It push a new frame to save
+
+		@return It returns true if the data is queued (rcd is moved). False
+		        if the ring buffer is full and the data is dropped (rcd is
+				not moved).
 	*/
-	STOREDATA_BUFFER_EXPORT void push(std::unique_ptr<AtomicContainerDataFaster> &rcd);
+	STOREDATA_BUFFER_EXPORT bool push(std::unique_ptr<AtomicContainerDataFaster> &rcd);
 
 	/** @brief It starts the thread
 	*/
@@ -68,6 +134,16 @@ public:
 	*/
 	STOREDATA_BUFFER_EXPORT void stop();
 
+	/** @brief It processes the queued data, then it stops and joins the 
+	           internal thread.
+
+		@param[in] deadline Maximum time to wait. If expired, the thread
+		           stops after the current data and it is not joined.
+		@return It returns true if the thread is joined before the deadline.
+	*/
+	STOREDATA_BUFFER_EXPORT bool drain_and_join(
+		std::chrono::steady_clock::time_point deadline);
+
 	/** @brief It close the recording files
 	*/
 	STOREDATA_BUFFER_EXPORT void close();
@@ -78,29 +154,63 @@ public:
 
 	/** @brief It sets the save boosting. If true it use multiple threads to
 	save.
+
+		The internal thread dispatches the callbacks to a pool of
+		max_threads workers. The callback must be thread safe. When it is
+		disabled, the workers are stopped after the dispatched data.
 	*/
 	STOREDATA_BUFFER_EXPORT void set_save_boost(bool save_boost);
 
-	/** @brief It returns the about size of the writing queue
+	/** @brief It sets the maximum number of threads used with the save
+	           boosting. It is applied at the next pool start.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_max_threads(int max_threads);
+
+	/** @brief If true, with the save boosting the data with the same unique
+	           message is processed in the same order it was pushed.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_save_boost_ordered(bool ordered);
+
+	/** @brief It returns the exact number of data queued, under 
+	           processing or dispatched to the save boosting pool.
 	*/
 	STOREDATA_BUFFER_EXPORT size_t size_about();
 
+	/** @brief It returns a snapshot of the counters and histograms (rate,
+	           depth, time in queue, callback duration, drops).
+	*/
+	STOREDATA_BUFFER_EXPORT DesynchronizerMetricsSnapshot metrics();
+
+	/** @brief It resets the counters and histograms.
+	*/
+	STOREDATA_BUFFER_EXPORT void reset_metrics();
+
+	/** @brief It writes the metrics with LogMS every period_ms (0 disables).
+
+		The log is written by the internal thread after a processed data.
+		@param[in] name Name written in the log.
+		@param[in] period_ms Period of the log.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_metrics_log(const std::string &name,
+		int period_ms);
+
 	/** @brief It returns the running status
 	*/
 	STOREDATA_BUFFER_EXPORT bool is_running();
 
-	/** @brief Since the internal thread is detached, it is necessary to 
-	           wait until is not ready.
+	/** @brief It waits until the internal thread is not running.
 
-		The function try to stop for n iterations and wait m ms.
+		The maximum wait is num_iterations * sleep_ms milliseconds (see
+		wait_deadline).
 		@return It returns true in case of success. False otherwise.
 	*/
 	STOREDATA_BUFFER_EXPORT bool wait_until_is_not_ready(size_t num_iterations, int sleep_ms);
 
-	/** @brief Since the internal thread is detached, it is necessary to
-		   wait until is not ready.
+	/** @brief It waits until all the queued data is processed (or the
+	           internal thread is not running).
 
-		The function try to stop for n iterations and wait m ms.
+		The maximum wait is num_iterations * sleep_ms milliseconds (see
+		wait_deadline).
 		@return It returns true in case of success. False otherwise.
 	*/
 	STOREDATA_BUFFER_EXPORT bool wait_until_buffer_is_empty(size_t num_iterations, int sleep_ms);
@@ -110,6 +220,16 @@ public:
 	STOREDATA_BUFFER_EXPORT void set_cbk_func_faster(
 		cbk_func_faster callback_func);
 
+	/** @brief It sets the callback that receives all the pending data at once
+
+		If set, it is used instead of the single element callback. The
+		internal thread takes the whole queue with a single lock and passes
+		it as one batch. The data is disposed after the callback.
+		The batch is processed by the internal thread (no save boosting).
+	*/
+	STOREDATA_BUFFER_EXPORT void set_cbk_func_batch(
+		cbk_func_faster_batch callback_func);
+
 private:
 
 	/** @brief Mutex to prevent race condition
@@ -121,25 +241,42 @@ private:
 	/** @brief Var used to the condition variable
 	*/
 	bool data_ready_ = false;
-	/** @brief Number of threads that are writing (it does not include the
-	class internal thread)
-	*/
-	int num_threads_;
 	/** @brief Maximum numbers of threads that can be run (except the
 	internal thread)
 	*/
 	int max_threads_;
 
-	/** @brief If true it creates as many threads as possible
+	/** @brief If true it creates as many threads as possible (read without
+	           lock in the ring modes)
 	*/
-	bool save_boost_;
+	std::atomic<bool> save_boost_;
+	/** @brief If true the pool keeps the order for the same unique message
+	*/
+	bool save_boost_ordered_;
+	/** @brief Threads used to run the callback with the save boosting
+	*/
+	CallbackWorkerPool worker_pool_;
+	/** @brief Counters and histograms
+	*/
+	DesynchronizerMetrics metrics_;
 
 	/** @brief If true it continues to save the data
 	*/
-	bool continue_save_;
+	std::atomic<bool> continue_save_;
 	/** @brief If true is running the internal thread
 	*/
-	bool is_running_;
+	std::atomic<bool> is_running_;
+	/** @brief If true the internal thread processes all the queued data
+	           before to quit
+	*/
+	std::atomic<bool> drain_on_stop_;
+	/** @brief Internal thread
+	*/
+	std::thread thread_;
+	/** @brief Notified when the internal thread quits or the queued data
+	           is processed (see notify_if_empty)
+	*/
+	std::condition_variable cond_state_;
 
 	/** @brief Container with the data to save and a message associated
 	*/
@@ -148,6 +285,58 @@ private:
 	/** @brief Callback recorder function
 	*/
 	cbk_func_faster callback_func_;
+	/** @brief Callback recorder function for a batch of data
+	*/
+	cbk_func_faster_batch callback_func_batch_;
+	/** @brief Batch passed to the callback (reused to avoid allocations)
+	*/
+	std::vector<std::unique_ptr<AtomicContainerDataFaster>> batch_;
+	/** @brief Queue swapped with the container to take the pending data
+	*/
+	std::queue<std::unique_ptr<AtomicContainerDataFaster>> container_swap_;
+
+	/** @brief Selected queue and policy
+	*/
+	DesynchronizerRingParams ring_params_;
+	/** @brief Ring buffer used with DesynchronizerQueueMode::RingSPSC
+	*/
+	std::unique_ptr<RingBufferSPSC<std::unique_ptr<AtomicContainerDataFaster>>> ring_spsc_;
+	/** @brief Ring buffer used with DesynchronizerQueueMode::RingMPSC
+	*/
+	std::unique_ptr<RingBufferMPSC<std::unique_ptr<AtomicContainerDataFaster>>> ring_mpsc_;
+	/** @brief True while the internal thread sleeps on the condition 
+	           variable (ring modes only). Producers notify only in this case.
+	*/
+	std::atomic<bool> consumer_waiting_;
+
+	/** @brief It tries to push in the ring buffer
+	*/
+	bool ring_try_push(std::unique_ptr<AtomicContainerDataFaster> &rcd);
+	/** @brief It tries to pop from the ring buffer
+	*/
+	bool ring_try_pop(std::unique_ptr<AtomicContainerDataFaster> &rcd);
+	/** @brief Elements in the ring buffer
+	*/
+	size_t ring_size();
+	/** @brief It wakes up the internal thread if it is sleeping
+	*/
+	void ring_notify();
+	/** @brief It sleeps until the ring buffer has data (or a timeout)
+	*/
+	void ring_wait();
+	/** @brief It calls the callback and dispose the element
+	*/
+	void process(std::unique_ptr<AtomicContainerDataFaster> &element);
+	/** @brief It waits for data and it passes all the pending data to the
+	           batch callback.
+
+		@return It returns false if the stop is requested and there is no
+		        data to process.
+	*/
+	bool process_batch();
+	/** @brief It notifies cond_state_ if there is no data to process.
+	*/
+	void notify_if_empty();
 };
 
 
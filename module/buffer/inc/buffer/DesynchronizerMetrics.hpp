@@ -0,0 +1,248 @@
+/**
+* @file DesynchronizerMetrics.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+
+#ifndef STOREDATA_BUFFER_DESYNCHRONIZERMETRICS_HPP__
+#define STOREDATA_BUFFER_DESYNCHRONIZERMETRICS_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include "buffer_defines.hpp"
+
+namespace storedata
+{
+
+/** @brief Summary of a latency histogram (microseconds).
+*/
+struct LatencyStats
+{
+	/** @brief Number of samples
+	*/
+	size_t count;
+	double mean_us;
+	/** @brief Percentiles (upper bound of the histogram bin)
+	*/
+	double p50_us;
+	double p99_us;
+	double max_us;
+
+	LatencyStats() : count(0), mean_us(0), p50_us(0), p99_us(0),
+		max_us(0) {}
+};
+
+/** @brief Snapshot of the metrics of a desynchronizer.
+*/
+struct DesynchronizerMetricsSnapshot
+{
+	/** @brief Seconds since the creation (or the last reset)
+	*/
+	double elapsed_s;
+	/** @brief Data accepted by push
+	*/
+	size_t pushed_items;
+	size_t pushed_bytes;
+	/** @brief Data passed to the callback
+	*/
+	size_t processed_items;
+	size_t processed_bytes;
+	/** @brief Data dropped (full queue)
+	*/
+	size_t dropped_items;
+	size_t dropped_bytes;
+	/** @brief Data queued or under processing by the internal thread
+	*/
+	size_t queue_depth;
+	/** @brief Maximum queue_depth
+	*/
+	size_t queue_depth_high_water;
+	/** @brief Average queue_depth seen by the push
+	*/
+	double queue_depth_mean;
+	/** @brief Pushed items per second
+	*/
+	double enqueue_rate;
+	/** @brief Processed bytes per second
+	*/
+	double processed_bytes_rate;
+	/** @brief Time between the push and the callback
+	*/
+	LatencyStats time_in_queue;
+	/** @brief Duration of the callback (one sample for each batch in batch
+	           mode)
+	*/
+	LatencyStats callback_duration;
+
+	DesynchronizerMetricsSnapshot() : elapsed_s(0), pushed_items(0),
+		pushed_bytes(0), processed_items(0), processed_bytes(0),
+		dropped_items(0), dropped_bytes(0), queue_depth(0),
+		queue_depth_high_water(0), queue_depth_mean(0), enqueue_rate(0),
+		processed_bytes_rate(0) {}
+};
+
+/** @brief Lock free histogram of latencies with power of two bins.
+
+	The bin i counts the samples in [2^(i-1), 2^i) microseconds (bin 0 
+	is less than 1us, the last bin has no upper bound).
+*/
+class LatencyHistogram
+{
+public:
+
+	static const size_t kNumBins = 32;
+
+	STOREDATA_BUFFER_EXPORT LatencyHistogram();
+
+	/** @brief It adds a sample.
+	*/
+	STOREDATA_BUFFER_EXPORT void add(int64_t us);
+
+	STOREDATA_BUFFER_EXPORT void reset();
+
+	STOREDATA_BUFFER_EXPORT LatencyStats stats();
+
+private:
+
+	std::atomic<size_t> bins_[kNumBins];
+	std::atomic<size_t> count_;
+	std::atomic<int64_t> sum_us_;
+	std::atomic<int64_t> max_us_;
+
+	/** @brief It returns the value below which there is the fraction q of 
+	           the samples.
+	*/
+	double percentile(double q, size_t count);
+};
+
+/** @brief Counters and histograms of a desynchronizer.
+
+	The producers call on_push/on_drop, the internal thread calls the
+	other functions. All the counters are atomic (relaxed), so the
+	snapshot can be taken by any thread. The snapshot is not atomic as a 
+	whole.
+*/
+class DesynchronizerMetrics
+{
+public:
+
+	STOREDATA_BUFFER_EXPORT DesynchronizerMetrics();
+
+	/** @brief It returns a monotonic time in microseconds. It is used to
+	           mark the time of the push.
+	*/
+	STOREDATA_BUFFER_EXPORT static int64_t now_us();
+
+	/** @brief A data is queued.
+	*/
+	STOREDATA_BUFFER_EXPORT void on_push(size_t size_bytes);
+
+	/** @brief A data counted by on_push could not be queued (e.g. full
+	           lock-free buffer). It is counted as dropped.
+	*/
+	STOREDATA_BUFFER_EXPORT void on_push_rejected(size_t size_bytes);
+
+	/** @brief A data is dropped.
+
+		@param[in] size_bytes Size of the data.
+		@param[in] was_queued True if the data was in the queue (e.g. drop
+		           of the oldest).
+	*/
+	STOREDATA_BUFFER_EXPORT void on_drop(size_t size_bytes, bool was_queued);
+
+	/** @brief A data waited from enqueue_us to now before the processing.
+	*/
+	STOREDATA_BUFFER_EXPORT void on_dequeue(int64_t enqueue_us, int64_t now_us);
+
+	/** @brief The callback processed num_items data in callback_us.
+	*/
+	STOREDATA_BUFFER_EXPORT void on_processed(size_t num_items,
+		size_t size_bytes, int64_t callback_us);
+
+	/** @brief num_items data left the internal thread (processed or 
+	           dispatched to the pool).
+	*/
+	STOREDATA_BUFFER_EXPORT void on_release(size_t num_items);
+
+	/** @brief It returns the exact number of data queued or under
+	           processing by the internal thread.
+	*/
+	STOREDATA_BUFFER_EXPORT size_t depth();
+
+	STOREDATA_BUFFER_EXPORT DesynchronizerMetricsSnapshot snapshot();
+
+	/** @brief It resets the counters (the depth is kept).
+	*/
+	STOREDATA_BUFFER_EXPORT void reset();
+
+	/** @brief It sets the name used in the log.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_name(const std::string &name);
+
+	/** @brief It sets the period of the log. 0 or negative disables it.
+	*/
+	STOREDATA_BUFFER_EXPORT void set_log_period(int period_ms);
+
+	/** @brief It writes the snapshot with LogMS if the period is expired.
+	*/
+	STOREDATA_BUFFER_EXPORT void log_if_due();
+
+	/** @brief It writes the snapshot with LogMS.
+	*/
+	STOREDATA_BUFFER_EXPORT void log();
+
+private:
+
+	std::atomic<int64_t> start_us_;
+	std::atomic<size_t> pushed_items_;
+	std::atomic<size_t> pushed_bytes_;
+	std::atomic<size_t> processed_items_;
+	std::atomic<size_t> processed_bytes_;
+	std::atomic<size_t> dropped_items_;
+	std::atomic<size_t> dropped_bytes_;
+	std::atomic<size_t> depth_;
+	std::atomic<size_t> depth_high_water_;
+	/** @brief Sum and number of the depths sampled at each push (for the
+	           mean)
+	*/
+	std::atomic<size_t> depth_sum_;
+	std::atomic<size_t> depth_samples_;
+	LatencyHistogram time_in_queue_;
+	LatencyHistogram callback_duration_;
+
+	/** @brief Log period (0 disabled) and time of the last log
+	*/
+	std::atomic<int> log_period_ms_;
+	std::atomic<int64_t> last_log_us_;
+	/** @brief Name used in the log
+	*/
+	std::mutex mtx_name_;
+	std::string name_;
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_BUFFER_DESYNCHRONIZERMETRICS_HPP__
@@ -0,0 +1,227 @@
+/**
+* @file RingBufferLockFree.hpp
+* @brief Bounded lock-free ring buffers used to pass data between threads.
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+
+#ifndef STOREDATA_BUFFER_RINGBUFFERLOCKFREE_HPP__
+#define STOREDATA_BUFFER_RINGBUFFERLOCKFREE_HPP__
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace storedata
+{
+
+/** @brief Size of a cache line. Used to keep producer and consumer indexes
+           on separate lines.
+*/
+const size_t kRingBufferCacheLine = 64;
+
+/** @brief It returns the smallest power of two greater or equal to value.
+*/
+inline size_t ring_buffer_capacity_pow2(size_t value) {
+	size_t capacity = 2;
+	while (capacity < value) capacity <<= 1;
+	return capacity;
+}
+
+/** @brief Bounded single producer single consumer ring buffer.
+
+	The capacity is rounded to the next power of two.
+	@thread Safe for exactly one producer thread and one consumer thread.
+*/
+template <typename _Ty>
+class RingBufferSPSC
+{
+public:
+
+	explicit RingBufferSPSC(size_t capacity) :
+		capacity_(ring_buffer_capacity_pow2(capacity)),
+		mask_(capacity_ - 1),
+		buffer_(capacity_) {
+		head_.store(0, std::memory_order_relaxed);
+		tail_.store(0, std::memory_order_relaxed);
+	}
+
+	/** @brief It tries to push the element.
+
+		@return It returns true in case of success. False if the buffer is
+		        full (the element is not moved).
+	*/
+	bool try_push(_Ty &element) {
+		const size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail - head_.load(std::memory_order_acquire) >= capacity_) {
+			return false;
+		}
+		buffer_[tail & mask_] = std::move(element);
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** @brief It tries to pop the oldest element.
+
+		@return It returns true in case of success. False if empty.
+	*/
+	bool try_pop(_Ty &element) {
+		const size_t head = head_.load(std::memory_order_relaxed);
+		if (head == tail_.load(std::memory_order_acquire)) {
+			return false;
+		}
+		element = std::move(buffer_[head & mask_]);
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** @brief It returns the number of elements in the buffer.
+	*/
+	size_t size() const {
+		return tail_.load(std::memory_order_acquire) -
+			head_.load(std::memory_order_acquire);
+	}
+
+	/** @brief It returns the maximum number of elements.
+	*/
+	size_t capacity() const {
+		return capacity_;
+	}
+
+private:
+
+	const size_t capacity_;
+	const size_t mask_;
+	std::vector<_Ty> buffer_;
+	/** @brief Next position to read (written only by the consumer)
+	*/
+	alignas(kRingBufferCacheLine) std::atomic<size_t> head_;
+	/** @brief Next position to write (written only by the producer)
+	*/
+	alignas(kRingBufferCacheLine) std::atomic<size_t> tail_;
+};
+
+
+/** @brief Bounded multiple producers single consumer ring buffer.
+
+	Each slot carries a sequence number so that producers can reserve a
+	position with a single compare and swap and publish it independently.
+	The capacity is rounded to the next power of two.
+	@thread Safe for many producer threads and one consumer thread.
+*/
+template <typename _Ty>
+class RingBufferMPSC
+{
+public:
+
+	explicit RingBufferMPSC(size_t capacity) :
+		capacity_(ring_buffer_capacity_pow2(capacity)),
+		mask_(capacity_ - 1),
+		buffer_(new Slot[capacity_]) {
+		for (size_t i = 0; i < capacity_; ++i) {
+			buffer_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		head_.store(0, std::memory_order_relaxed);
+		tail_.store(0, std::memory_order_relaxed);
+	}
+
+	/** @brief It tries to push the element.
+
+		@return It returns true in case of success. False if the buffer is
+		        full (the element is not moved).
+	*/
+	bool try_push(_Ty &element) {
+		size_t pos = tail_.load(std::memory_order_relaxed);
+		for (;;) {
+			Slot &slot = buffer_[pos & mask_];
+			const size_t seq = slot.sequence.load(std::memory_order_acquire);
+			const intptr_t diff = static_cast<intptr_t>(seq) -
+				static_cast<intptr_t>(pos);
+			if (diff == 0) {
+				// The slot is free, try to reserve it
+				if (tail_.compare_exchange_weak(pos, pos + 1,
+					std::memory_order_relaxed)) {
+					slot.value = std::move(element);
+					slot.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				// The consumer did not release the slot yet: full
+				return false;
+			} else {
+				pos = tail_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/** @brief It tries to pop the oldest element.
+
+		@return It returns true in case of success. False if empty.
+	*/
+	bool try_pop(_Ty &element) {
+		const size_t pos = head_.load(std::memory_order_relaxed);
+		Slot &slot = buffer_[pos & mask_];
+		const size_t seq = slot.sequence.load(std::memory_order_acquire);
+		if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) {
+			return false;
+		}
+		element = std::move(slot.value);
+		slot.sequence.store(pos + capacity_, std::memory_order_release);
+		head_.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** @brief It returns the approximate number of elements in the buffer.
+	*/
+	size_t size() const {
+		const size_t tail = tail_.load(std::memory_order_acquire);
+		const size_t head = head_.load(std::memory_order_acquire);
+		return tail > head ? tail - head : 0;
+	}
+
+	/** @brief It returns the maximum number of elements.
+	*/
+	size_t capacity() const {
+		return capacity_;
+	}
+
+private:
+
+	struct Slot {
+		std::atomic<size_t> sequence;
+		_Ty value;
+	};
+
+	const size_t capacity_;
+	const size_t mask_;
+	std::unique_ptr<Slot[]> buffer_;
+	/** @brief Next position to read (written only by the consumer)
+	*/
+	alignas(kRingBufferCacheLine) std::atomic<size_t> head_;
+	/** @brief Next position to reserve (shared by the producers)
+	*/
+	alignas(kRingBufferCacheLine) std::atomic<size_t> tail_;
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_BUFFER_RINGBUFFERLOCKFREE_HPP__
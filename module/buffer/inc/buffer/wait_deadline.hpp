@@ -0,0 +1,54 @@
+/**
+* @file wait_deadline.hpp
+* @brief Header of the defined function
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_BUFFER_WAIT_DEADLINE_HPP__
+#define STOREDATA_BUFFER_WAIT_DEADLINE_HPP__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace storedata
+{
+
+/** @brief It returns the deadline of a wait of num_iterations * sleep_ms
+           milliseconds from now.
+
+	The wait is clamped to one day, so the product does not overflow. A
+	negative sleep_ms does not wait.
+*/
+inline std::chrono::steady_clock::time_point wait_deadline(
+	size_t num_iterations, int sleep_ms) {
+	const int64_t kMaxWaitMs = 24LL * 60 * 60 * 1000;
+	int64_t wait_ms = 0;
+	if (sleep_ms > 0) {
+		wait_ms = num_iterations < static_cast<size_t>(kMaxWaitMs / sleep_ms) ?
+			static_cast<int64_t>(num_iterations) * sleep_ms : kMaxWaitMs;
+	}
+	return std::chrono::steady_clock::now() +
+		std::chrono::milliseconds(wait_ms);
+}
+
+} // namespace storedata
+
+#endif // STOREDATA_BUFFER_WAIT_DEADLINE_HPP__
@@ -30,24 +30,50 @@ namespace storedata
 //-----------------------------------------------------------------------------
 AtomicContainerData::AtomicContainerData() {
 	data_ = nullptr;
+	size_bytes_ = 0;
+	capacity_bytes_ = 0;
+	buffer_pool_ = nullptr;
+	enqueue_time_us_ = 0;
 }
 //-----------------------------------------------------------------------------
-void AtomicContainerData::copyFrom(const void* src, size_t src_size_bytes) {
+void AtomicContainerData::set_buffer_pool(BufferPool* buffer_pool) {
 	if (data_) dispose();
-	size_bytes_ = src_size_bytes;
-	data_ = malloc(size_bytes_);
-	std::memcpy(data_, src, size_bytes_);
+	buffer_pool_ = buffer_pool;
 }
 //-----------------------------------------------------------------------------
-void AtomicContainerData::copyFrom(AtomicContainerData &obj) {
+void* AtomicContainerData::allocate(size_t size_bytes) {
 	if (data_) dispose();
-	size_bytes_ = obj.size_bytes();
-	data_ = malloc(size_bytes_);
-	memcpy(data_, obj.data(), size_bytes_);
+	size_bytes_ = size_bytes;
+	if (buffer_pool_) {
+		data_ = buffer_pool_->acquire(size_bytes_, capacity_bytes_);
+	} else {
+		data_ = malloc(size_bytes_);
+		capacity_bytes_ = size_bytes_;
+	}
+	return data_;
+}
+//-----------------------------------------------------------------------------
+void AtomicContainerData::copyFrom(const void* src, size_t src_size_bytes) {
+	if (allocate(src_size_bytes)) {
+		std::memcpy(data_, src, size_bytes_);
+	}
+}
+//-----------------------------------------------------------------------------
+void AtomicContainerData::copyFrom(AtomicContainerData &obj) {
+	if (allocate(obj.size_bytes())) {
+		memcpy(data_, obj.data(), size_bytes_);
+	}
 }
 //-----------------------------------------------------------------------------
 void AtomicContainerData::dispose() {
-	if (data_) { free(data_); data_ = nullptr; }
+	if (data_) {
+		if (buffer_pool_) {
+			buffer_pool_->release(data_, capacity_bytes_);
+		} else {
+			free(data_);
+		}
+		data_ = nullptr;
+	}
 }
 //-----------------------------------------------------------------------------
 void* AtomicContainerData::data() {
@@ -57,5 +83,13 @@ void* AtomicContainerData::data() {
 size_t AtomicContainerData::size_bytes() {
 	return size_bytes_;
 }
+//-----------------------------------------------------------------------------
+void AtomicContainerData::set_enqueue_time_us(int64_t enqueue_time_us) {
+	enqueue_time_us_ = enqueue_time_us;
+}
+//-----------------------------------------------------------------------------
+int64_t AtomicContainerData::enqueue_time_us() {
+	return enqueue_time_us_;
+}
 
 } // namespace storedata
@@ -28,27 +28,46 @@ namespace storedata
 //-----------------------------------------------------------------------------
 AtomicContainerDataFaster::AtomicContainerDataFaster() {
 	data_ = nullptr;
+	size_bytes_ = 0;
+	capacity_bytes_ = 0;
+	buffer_pool_ = nullptr;
+	safe_dispose_ = false;
+	enqueue_time_us_ = 0;
 }
 //-----------------------------------------------------------------------------
 void AtomicContainerDataFaster::set_unique_msg(const std::string &unique_msg) {
 	unique_msg_ = unique_msg;
 }
 //-----------------------------------------------------------------------------
-void AtomicContainerDataFaster::copyFrom(const void* src, 
-	size_t src_size_bytes) {
+void AtomicContainerDataFaster::set_buffer_pool(BufferPool* buffer_pool) {
+	if (data_) dispose();
+	buffer_pool_ = buffer_pool;
+}
+//-----------------------------------------------------------------------------
+void* AtomicContainerDataFaster::allocate(size_t src_size_bytes) {
 	if (data_) dispose();
 	size_bytes_ = src_size_bytes;
-	data_ = malloc(size_bytes_);
-	std::memcpy(data_, src, size_bytes_);
+	if (buffer_pool_) {
+		data_ = buffer_pool_->acquire(size_bytes_, capacity_bytes_);
+	} else {
+		data_ = malloc(size_bytes_);
+		capacity_bytes_ = size_bytes_;
+	}
 	safe_dispose_ = true;
+	return data_;
+}
+//-----------------------------------------------------------------------------
+void AtomicContainerDataFaster::copyFrom(const void* src, 
+	size_t src_size_bytes) {
+	if (allocate(src_size_bytes)) {
+		std::memcpy(data_, src, size_bytes_);
+	}
 }
 //-----------------------------------------------------------------------------
 void AtomicContainerDataFaster::copyFrom(AtomicContainerDataFaster &obj) {
-	if (data_) dispose();
-	size_bytes_ = obj.size_bytes();
-	data_ = malloc(size_bytes_);
-	memcpy(data_, obj.data(), obj.size_bytes());
-	safe_dispose_ = true;
+	if (allocate(obj.size_bytes())) {
+		memcpy(data_, obj.data(), size_bytes_);
+	}
 }
 //-----------------------------------------------------------------------------
 void AtomicContainerDataFaster::assignFrom(void* src, size_t src_size_bytes) {
@@ -62,11 +81,47 @@ void AtomicContainerDataFaster::assignFrom(AtomicContainerDataFaster &obj) {
 	if (data_) dispose();
 	size_bytes_ = obj.size_bytes();
 	data_ = obj.data();
+	mat_ = obj.mat_;
+	holder_ = obj.holder_;
+	safe_dispose_ = false;
+}
+//-----------------------------------------------------------------------------
+void AtomicContainerDataFaster::assignFrom(const cv::Mat &img) {
+	if (data_) dispose();
+	mat_ = img.isContinuous() ? img : img.clone();
+	size_bytes_ = mat_.total() * mat_.elemSize();
+	data_ = mat_.data;
 	safe_dispose_ = false;
 }
 //-----------------------------------------------------------------------------
+void AtomicContainerDataFaster::assignFrom(std::shared_ptr<void> holder,
+	void* src, size_t src_size_bytes) {
+	if (data_) dispose();
+	holder_ = holder;
+	size_bytes_ = src_size_bytes;
+	data_ = src;
+	safe_dispose_ = false;
+}
+//-----------------------------------------------------------------------------
+const cv::Mat& AtomicContainerDataFaster::mat() {
+	return mat_;
+}
+//-----------------------------------------------------------------------------
 void AtomicContainerDataFaster::dispose() {
-	if (safe_dispose_ && data_) { free(data_); data_ = nullptr; }
+	if (safe_dispose_ && data_) {
+		if (buffer_pool_) {
+			buffer_pool_->release(data_, capacity_bytes_);
+		} else {
+			free(data_);
+		}
+		data_ = nullptr;
+	}
+	// Release the reference counted payload
+	if (!mat_.empty() || holder_) {
+		mat_.release();
+		holder_.reset();
+		data_ = nullptr;
+	}
 }
 //-----------------------------------------------------------------------------
 std::string AtomicContainerDataFaster::unique_msg() {
@@ -84,5 +139,13 @@ size_t AtomicContainerDataFaster::size_bytes() {
 bool AtomicContainerDataFaster::safe_dispose() {
 	return safe_dispose_;
 }
+//-----------------------------------------------------------------------------
+void AtomicContainerDataFaster::set_enqueue_time_us(int64_t enqueue_time_us) {
+	enqueue_time_us_ = enqueue_time_us;
+}
+//-----------------------------------------------------------------------------
+int64_t AtomicContainerDataFaster::enqueue_time_us() {
+	return enqueue_time_us_;
+}
 
 } // namespace storedata
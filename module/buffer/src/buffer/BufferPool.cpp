@@ -0,0 +1,167 @@
+/* @file BufferPool.cpp
+ * @brief Implementation of the pool of memory buffers.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include <cstdlib>
+
+#include "buffer/inc/buffer/BufferPool.hpp"
+
+namespace storedata
+{
+
+namespace
+{
+/** @brief Smallest class is 2^kMinShift bytes
+*/
+const size_t kMinShift = 8;
+/** @brief Number of classes for each power of two
+*/
+const size_t kClassesPerPower = 4;
+/** @brief Number of size classes (up to 2^63)
+*/
+const size_t kNumClasses = (64 - kMinShift) * kClassesPerPower + 1;
+} // namespace
+
+//-----------------------------------------------------------------------------
+BufferPool::BufferPool(size_t max_cached_bytes) :
+	classes_(new SizeClass[kNumClasses]) {
+	max_cached_bytes_ = max_cached_bytes;
+	hits_ = 0;
+	misses_ = 0;
+	bytes_in_use_ = 0;
+	bytes_in_use_high_water_ = 0;
+	bytes_cached_ = 0;
+	bytes_cached_high_water_ = 0;
+}
+//-----------------------------------------------------------------------------
+BufferPool::~BufferPool() {
+	clear();
+}
+//-----------------------------------------------------------------------------
+size_t BufferPool::class_index(size_t size_bytes, size_t &capacity_bytes) {
+	size_t size = size_bytes < (size_t(1) << kMinShift) ?
+		(size_t(1) << kMinShift) : size_bytes;
+	// 2^k <= size < 2^(k+1)
+	size_t k = kMinShift;
+	while (k + 1 < 64 && (size_t(1) << (k + 1)) <= size) ++k;
+	// Round up to a quarter of the power of two
+	size_t step = (size_t(1) << k) / kClassesPerPower;
+	size_t m = (size - (size_t(1) << k) + step - 1) / step;
+	capacity_bytes = (size_t(1) << k) + m * step;
+	return (k - kMinShift) * kClassesPerPower + m;
+}
+//-----------------------------------------------------------------------------
+size_t BufferPool::capacity_for(size_t size_bytes) {
+	size_t capacity_bytes = 0;
+	class_index(size_bytes, capacity_bytes);
+	return capacity_bytes;
+}
+//-----------------------------------------------------------------------------
+void BufferPool::update_high_water(std::atomic<size_t> &high_water,
+	size_t value) {
+	size_t current = high_water.load(std::memory_order_relaxed);
+	while (value > current &&
+		!high_water.compare_exchange_weak(current, value,
+			std::memory_order_relaxed)) {
+	}
+}
+//-----------------------------------------------------------------------------
+void* BufferPool::acquire(size_t size_bytes, size_t &capacity_bytes) {
+	size_t index = class_index(size_bytes, capacity_bytes);
+	void* ptr = nullptr;
+	{
+		SizeClass &sc = classes_[index];
+		std::lock_guard<std::mutex> lk(sc.mtx);
+		if (!sc.free_list.empty()) {
+			ptr = sc.free_list.back();
+			sc.free_list.pop_back();
+		}
+	}
+	if (ptr) {
+		++hits_;
+		bytes_cached_ -= capacity_bytes;
+	} else {
+		++misses_;
+		ptr = malloc(capacity_bytes);
+		if (!ptr) {
+			capacity_bytes = 0;
+			return nullptr;
+		}
+	}
+	update_high_water(bytes_in_use_high_water_,
+		bytes_in_use_ += capacity_bytes);
+	return ptr;
+}
+//-----------------------------------------------------------------------------
+void BufferPool::release(void* ptr, size_t capacity_bytes) {
+	if (!ptr) return;
+	bytes_in_use_ -= capacity_bytes;
+
+	// Too much memory kept by the pool
+	if (bytes_cached_ + capacity_bytes > max_cached_bytes_) {
+		free(ptr);
+		return;
+	}
+
+	size_t capacity_class = 0;
+	size_t index = class_index(capacity_bytes, capacity_class);
+	{
+		SizeClass &sc = classes_[index];
+		std::lock_guard<std::mutex> lk(sc.mtx);
+		sc.free_list.push_back(ptr);
+	}
+	update_high_water(bytes_cached_high_water_,
+		bytes_cached_ += capacity_bytes);
+}
+//-----------------------------------------------------------------------------
+void BufferPool::clear() {
+	// The last class (2^64) cannot be allocated
+	for (size_t i = 0; i + 1 < kNumClasses; ++i) {
+		// Capacity of the class i
+		size_t k = kMinShift + i / kClassesPerPower;
+		size_t capacity_bytes = (size_t(1) << k) +
+			(i % kClassesPerPower) * ((size_t(1) << k) / kClassesPerPower);
+		SizeClass &sc = classes_[i];
+		std::lock_guard<std::mutex> lk(sc.mtx);
+		for (auto &ptr : sc.free_list) {
+			free(ptr);
+		}
+		bytes_cached_ -= sc.free_list.size() * capacity_bytes;
+		sc.free_list.clear();
+	}
+}
+//-----------------------------------------------------------------------------
+void BufferPool::set_max_cached_bytes(size_t max_cached_bytes) {
+	max_cached_bytes_ = max_cached_bytes;
+}
+//-----------------------------------------------------------------------------
+BufferPoolStats BufferPool::stats() {
+	BufferPoolStats s;
+	s.hits = hits_;
+	s.misses = misses_;
+	s.bytes_in_use = bytes_in_use_;
+	s.bytes_in_use_high_water = bytes_in_use_high_water_;
+	s.bytes_cached = bytes_cached_;
+	s.bytes_cached_high_water = bytes_cached_high_water_;
+	return s;
+}
+
+} // namespace storedata
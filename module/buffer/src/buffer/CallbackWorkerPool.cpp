@@ -0,0 +1,139 @@
+/* @file CallbackWorkerPool.cpp
+ * @brief Implementation of the pool of threads used to run the callbacks.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include "buffer/inc/buffer/CallbackWorkerPool.hpp"
+
+namespace storedata
+{
+
+//-----------------------------------------------------------------------------
+CallbackWorkerPool::CallbackWorkerPool() {
+	num_pending_ = 0;
+	continue_run_ = false;
+	is_running_ = false;
+}
+//-----------------------------------------------------------------------------
+CallbackWorkerPool::~CallbackWorkerPool() {
+	stop();
+}
+//-----------------------------------------------------------------------------
+bool CallbackWorkerPool::start(size_t num_workers, bool ordered,
+	size_t max_tasks_per_worker) {
+	if (is_running_) return false;
+	if (num_workers == 0) num_workers = 1;
+
+	lanes_.clear();
+	size_t num_lanes = ordered ? num_workers : 1;
+	for (size_t i = 0; i < num_lanes; ++i) {
+		lanes_.push_back(std::unique_ptr<Lane>(new Lane()));
+		lanes_.back()->max_tasks = max_tasks_per_worker * num_workers /
+			num_lanes;
+	}
+	continue_run_ = true;
+	for (size_t i = 0; i < num_workers; ++i) {
+		workers_.push_back(std::thread(&CallbackWorkerPool::worker_thread,
+			this, lanes_[i % num_lanes].get()));
+	}
+	is_running_ = true;
+	return true;
+}
+//-----------------------------------------------------------------------------
+void CallbackWorkerPool::stop() {
+	if (!is_running_) return;
+	continue_run_ = false;
+	for (auto &lane : lanes_) {
+		std::lock_guard<std::mutex> lk(lane->mtx);
+		lane->cond.notify_all();
+	}
+	// The workers quit only when their lane is empty
+	for (auto &worker : workers_) {
+		if (worker.joinable()) worker.join();
+	}
+	workers_.clear();
+	lanes_.clear();
+	is_running_ = false;
+}
+//-----------------------------------------------------------------------------
+void CallbackWorkerPool::dispatch(const std::string &key,
+	std::function<void()> task) {
+	if (!is_running_) {
+		task();
+		return;
+	}
+	Lane *lane = lanes_.size() == 1 ? lanes_[0].get() :
+		lanes_[std::hash<std::string>()(key) % lanes_.size()].get();
+	{
+		std::unique_lock<std::mutex> lk(lane->mtx);
+		// The workers empty the lane also while stopping
+		lane->cond_space.wait(lk, [lane] {
+			return lane->max_tasks == 0 ||
+				lane->tasks.size() < lane->max_tasks; });
+		++num_pending_;
+		lane->tasks.push_back(std::move(task));
+	}
+	lane->cond.notify_one();
+}
+//-----------------------------------------------------------------------------
+void CallbackWorkerPool::wait_until_idle() {
+	std::unique_lock<std::mutex> lk(mtx_idle_);
+	cond_idle_.wait(lk, [this] { return num_pending_ == 0; });
+}
+//-----------------------------------------------------------------------------
+size_t CallbackWorkerPool::size_about() {
+	return num_pending_;
+}
+//-----------------------------------------------------------------------------
+bool CallbackWorkerPool::is_running() {
+	return is_running_;
+}
+//-----------------------------------------------------------------------------
+void CallbackWorkerPool::set_idle_callback(std::function<void()> callback) {
+	idle_callback_ = callback;
+}
+//-----------------------------------------------------------------------------
+void CallbackWorkerPool::worker_thread(Lane *lane) {
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lk(lane->mtx);
+			lane->cond.wait(lk, [this, lane] {
+				return !lane->tasks.empty() || !continue_run_; });
+			// Stop requested and nothing left to execute
+			if (lane->tasks.empty()) break;
+			task = std::move(lane->tasks.front());
+			lane->tasks.pop_front();
+		}
+		lane->cond_space.notify_one();
+
+		task();
+
+		if (--num_pending_ == 0) {
+			{
+				std::lock_guard<std::mutex> lk(mtx_idle_);
+				cond_idle_.notify_all();
+			}
+			if (idle_callback_) idle_callback_();
+		}
+	}
+}
+
+} // namespace storedata
@@ -27,56 +27,212 @@ namespace storedata
 
 //-----------------------------------------------------------------------------
 DataDesynchronizerGeneric::DataDesynchronizerGeneric() {
-	num_threads_ = 0;
-	max_threads_ = 1;
+	max_threads_ = (std::max)(1, static_cast<int>(
+		std::thread::hardware_concurrency()));
+	save_boost_ = false;
+	save_boost_ordered_ = false;
 	is_running_ = false;
+	continue_save_ = false;
+	drain_on_stop_ = false;
+	num_push_full_ = 0;
+	// The last task of the pool may complete the wait for the empty queue
+	worker_pool_.set_idle_callback([this] { notify_if_empty(); });
 }
 //-----------------------------------------------------------------------------
-void DataDesynchronizerGeneric::push(const std::string &msg, AtomicContainerData &rcd) {
+DataDesynchronizerGeneric::~DataDesynchronizerGeneric() {
+	stop();
+	if (thread_.joinable()) thread_.join();
+	// Release the data not processed
+	while (!container_.empty()) {
+		if (container_.front().second.data()) {
+			container_.front().second.dispose();
+		}
+		container_.pop();
+	}
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGeneric::push(const std::string &msg, AtomicContainerData &rcd) {
 	{
-		std::lock_guard<std::mutex> lk(mtx_);
+		std::unique_lock<std::mutex> lk(mtx_);
+		size_t size_bytes = rcd.size_bytes();
+
+		if (is_full(size_bytes)) {
+			bool accept = false;
+			switch (backpressure_params_.policy) {
+			case BackpressurePolicy::BlockTimeout:
+			{
+				++backpressure_stats_.blocked_pushes;
+				// A stopped desynchronizer does not free space
+				auto is_ready = [this, size_bytes] {
+					return !continue_save_ || !is_full(size_bytes); };
+				if (backpressure_params_.block_timeout_ms < 0) {
+					cond_space_.wait(lk, is_ready);
+				} else {
+					cond_space_.wait_for(lk, std::chrono::milliseconds(
+						backpressure_params_.block_timeout_ms), is_ready);
+				}
+				accept = continue_save_ && !is_full(size_bytes);
+				break;
+			}
+			case BackpressurePolicy::DropOldest:
+				while (is_full(size_bytes)) drop_oldest();
+				accept = true;
+				break;
+			case BackpressurePolicy::KeepEveryNth:
+				if (++num_push_full_ % (std::max)(static_cast<size_t>(1),
+					backpressure_params_.keep_every_nth) == 0) {
+					while (is_full(size_bytes)) drop_oldest();
+					accept = true;
+				}
+				break;
+			default:
+				break;
+			}
+
+			if (!accept) {
+				++backpressure_stats_.dropped_items;
+				backpressure_stats_.dropped_bytes += size_bytes;
+				metrics_.on_drop(size_bytes, false);
+				if (rcd.data()) rcd.dispose();
+				return false;
+			}
+		}
+
 		// Add the data
+		rcd.set_enqueue_time_us(DesynchronizerMetrics::now_us());
 		container_.push(std::make_pair(msg, rcd));
+		backpressure_stats_.queued_bytes += size_bytes;
+		metrics_.on_push(size_bytes);
 		data_ready_ = true;
 	}
 
 	cond_.notify_one();
+	return true;
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGeneric::is_full(size_t size_bytes) {
+	if (backpressure_params_.policy == BackpressurePolicy::None ||
+		container_.empty()) {
+		return false;
+	}
+	if (backpressure_params_.max_items > 0 &&
+		container_.size() >= backpressure_params_.max_items) {
+		return true;
+	}
+	if (backpressure_params_.max_bytes > 0 &&
+		backpressure_stats_.queued_bytes + size_bytes >
+		backpressure_params_.max_bytes) {
+		return true;
+	}
+	return false;
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGeneric::drop_oldest() {
+	std::pair<std::string, AtomicContainerData> &tuple = container_.front();
+	size_t size_bytes = tuple.second.size_bytes();
+	++backpressure_stats_.dropped_items;
+	backpressure_stats_.dropped_bytes += size_bytes;
+	backpressure_stats_.queued_bytes -= size_bytes;
+	metrics_.on_drop(size_bytes, true);
+	if (tuple.second.data()) tuple.second.dispose();
+	container_.pop();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGeneric::set_backpressure(
+	const BackpressureParams &backpressure_params) {
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		backpressure_params_ = backpressure_params;
+	}
+	// The new capacity may be larger
+	cond_space_.notify_all();
+}
+//-----------------------------------------------------------------------------
+BackpressureStats DataDesynchronizerGeneric::backpressure_stats() {
+	std::lock_guard<std::mutex> lk(mtx_);
+	return backpressure_stats_;
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGeneric::reset_backpressure_stats() {
+	std::lock_guard<std::mutex> lk(mtx_);
+	backpressure_stats_.dropped_items = 0;
+	backpressure_stats_.dropped_bytes = 0;
+	backpressure_stats_.blocked_pushes = 0;
 }
 //-----------------------------------------------------------------------------
 bool DataDesynchronizerGeneric::start() {
 	std::lock_guard<std::mutex> lk(mtx_);
 	if (is_running_) return false;
+	// Release the thread of the previous session (it is quitting)
+	if (thread_.joinable()) thread_.join();
 	continue_save_ = true;
-	std::thread t1(&DataDesynchronizerGeneric::internal_thread, this);
-	t1.detach();
+	drain_on_stop_ = false;
+	is_running_ = true;
+	thread_ = std::thread(&DataDesynchronizerGeneric::internal_thread, this);
 	return true;
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGeneric::stop() {
-	continue_save_ = false;
-	cond_.notify_one();
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		continue_save_ = false;
+	}
+	cond_.notify_all();
+	// The blocked producers quit
+	cond_space_.notify_all();
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGeneric::drain_and_join(
+	std::chrono::steady_clock::time_point deadline) {
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		drain_on_stop_ = true;
+		continue_save_ = false;
+	}
+	cond_.notify_all();
+	cond_space_.notify_all();
+
+	bool is_stopped = false;
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		is_stopped = cond_state_.wait_until(lk, deadline,
+			[this] { return !is_running_; });
+		// Too late, quit after the current data
+		if (!is_stopped) drain_on_stop_ = false;
+	}
+	if (is_stopped && thread_.joinable()) thread_.join();
+	return is_stopped;
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGeneric::close() {
-	stop();
-	wait_until_is_not_ready(10, 100);
-	wait_until_buffer_is_empty(10, 100);
+	drain_and_join(std::chrono::steady_clock::now() +
+		std::chrono::seconds(2));
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGeneric::internal_thread() {
 
-	is_running_ = true;
-	while (continue_save_) {
+	while (continue_save_ || drain_on_stop_) {
+
+		// All the pending data is passed at once
+		if (callback_func_batch_) {
+			if (!process_batch()) break;
+			continue;
+		}
 
 		// Digest the main buffer frames (it it exist)
 		std::pair<std::string, AtomicContainerData> tuple;
+		bool save_boost = false;
+		bool is_popped = false;
 		{
 			std::unique_lock<std::mutex> lk(mtx_);
 			// no data to save
 			if (container_.size() == 0) {
+				// Stop requested and all the data is processed
+				if (!continue_save_) break;
 				data_ready_ = false;
 				//std::cout << "wait: " << data_ready_ << std::endl;
-				cond_.wait(lk, [this] { return data_ready_; });
+				cond_.wait(lk, [this] {
+					return data_ready_ || !continue_save_; });
 				//std::cout << "end wait: " << data_ready_ << std::endl;
 			}
 			// Pop the data
@@ -85,18 +241,37 @@ void DataDesynchronizerGeneric::internal_thread() {
 			if (container_.size() > 0) {
 				tuple = container_.front();
 				container_.pop();
+				backpressure_stats_.queued_bytes -= tuple.second.size_bytes();
+				is_popped = true;
 			}
+			save_boost = save_boost_;
 		}
+		cond_space_.notify_all();
+		if (!is_popped) continue;
+		metrics_.on_dequeue(tuple.second.enqueue_time_us(),
+			DesynchronizerMetrics::now_us());
 
-		// if the callback function does exist
-		if (callback_func_) {
-			callback_func_(tuple.first, tuple.second);
-
-			// dispose the data
-			if (tuple.second.data()) {
-				tuple.second.dispose();
-			}
+		if (save_boost && !worker_pool_.is_running()) {
+			std::lock_guard<std::mutex> lk(mtx_);
+			worker_pool_.start(max_threads_, save_boost_ordered_);
+		} else if (!save_boost && worker_pool_.is_running()) {
+			// The dispatched data is completed before the next one is
+			// processed by this thread
+			worker_pool_.stop();
 		}
+		if (worker_pool_.is_running() && tuple.second.data()) {
+			// The pool copies the task, so the data is shared
+			auto shared_tuple = std::make_shared<
+				std::pair<std::string, AtomicContainerData>>(tuple);
+			worker_pool_.dispatch(tuple.first, [this, shared_tuple] {
+				process(*shared_tuple); });
+		} else {
+			process(tuple);
+		}
+		// The dispatched data is counted by the pool
+		metrics_.on_release(1);
+		metrics_.log_if_due();
+		notify_if_empty();
 
 		//// Process the data
 		//if (tuple.second.data) {
@@ -138,7 +313,74 @@ void DataDesynchronizerGeneric::internal_thread() {
 		//	tuple.second.dispose();
 		//}
 	}
-	is_running_ = false;
+	// Complete the dispatched callbacks
+	worker_pool_.stop();
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		is_running_ = false;
+	}
+	cond_state_.notify_all();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGeneric::process(
+	std::pair<std::string, AtomicContainerData> &tuple) {
+	// if the callback function does exist
+	if (callback_func_) {
+		size_t size_bytes = tuple.second.size_bytes();
+		int64_t t0 = DesynchronizerMetrics::now_us();
+		callback_func_(tuple.first, tuple.second);
+		metrics_.on_processed(1, size_bytes,
+			DesynchronizerMetrics::now_us() - t0);
+
+		// dispose the data
+		if (tuple.second.data()) {
+			tuple.second.dispose();
+		}
+	}
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGeneric::process_batch() {
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		// no data to save
+		if (container_.size() == 0) {
+			if (!continue_save_) return false;
+			data_ready_ = false;
+			cond_.wait(lk, [this] { return data_ready_ || !continue_save_; });
+		}
+		// Take all the pending data with a single lock
+		std::swap(container_, container_swap_);
+		backpressure_stats_.queued_bytes = 0;
+	}
+	cond_space_.notify_all();
+
+	batch_.clear();
+	size_t size_bytes = 0;
+	int64_t t0 = DesynchronizerMetrics::now_us();
+	while (!container_swap_.empty()) {
+		metrics_.on_dequeue(container_swap_.front().second.enqueue_time_us(),
+			t0);
+		size_bytes += container_swap_.front().second.size_bytes();
+		batch_.push_back(std::move(container_swap_.front()));
+		container_swap_.pop();
+	}
+	if (batch_.empty()) return true;
+
+	callback_func_batch_(batch_);
+	metrics_.on_processed(batch_.size(), size_bytes,
+		DesynchronizerMetrics::now_us() - t0);
+	metrics_.on_release(batch_.size());
+	metrics_.log_if_due();
+
+	// dispose the data
+	for (auto &it : batch_) {
+		if (it.second.data()) {
+			it.second.dispose();
+		}
+	}
+	batch_.clear();
+	notify_if_empty();
+	return true;
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGeneric::set_save_boost(bool save_boost) {
@@ -146,45 +388,72 @@ void DataDesynchronizerGeneric::set_save_boost(bool save_boost) {
 	save_boost_ = save_boost;
 }
 //-----------------------------------------------------------------------------
+void DataDesynchronizerGeneric::set_max_threads(int max_threads) {
+	std::lock_guard<std::mutex> lk(mtx_);
+	max_threads_ = (std::max)(1, max_threads);
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGeneric::set_save_boost_ordered(bool ordered) {
+	std::lock_guard<std::mutex> lk(mtx_);
+	save_boost_ordered_ = ordered;
+}
+//-----------------------------------------------------------------------------
 size_t DataDesynchronizerGeneric::size_about() {
-	return container_.size();
+	return metrics_.depth() + worker_pool_.size_about();
+}
+//-----------------------------------------------------------------------------
+DesynchronizerMetricsSnapshot DataDesynchronizerGeneric::metrics() {
+	return metrics_.snapshot();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGeneric::reset_metrics() {
+	metrics_.reset();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGeneric::set_metrics_log(const std::string &name,
+	int period_ms) {
+	metrics_.set_name(name);
+	metrics_.set_log_period(period_ms);
 }
 //-----------------------------------------------------------------------------
 bool DataDesynchronizerGeneric::is_running() {
 	return is_running_;
 }
 //-----------------------------------------------------------------------------
-bool DataDesynchronizerGeneric::wait_until_is_not_ready(size_t num_iterations, int sleep_ms) {
-	for (size_t i = 0; i < num_iterations; ++i) {
-		if (is_running()) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-		}
-		else {
-			return true;
-		}
-	}
-	return false;
+bool DataDesynchronizerGeneric::wait_until_is_not_ready(
+	size_t num_iterations, 
+	int sleep_ms) {
+	auto deadline = wait_deadline(num_iterations, sleep_ms);
+	std::unique_lock<std::mutex> lk(mtx_);
+	return cond_state_.wait_until(lk, deadline,
+		[this] { return !is_running_; });
 }
 //-----------------------------------------------------------------------------
 bool DataDesynchronizerGeneric::wait_until_buffer_is_empty(
 	size_t num_iterations, 
 	int sleep_ms) {
-	for (size_t i = 0; i < num_iterations; ++i) {
-		std::cout << "iA: " << i << " " << (size_about() > 0) << " ";
-		if (is_running() && (size_about() > 0)) {
-			std::cout << size_about() << std::endl;
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-		}
-		else {
-			return true;
-		}
-	}
-	return false;
+	auto deadline = wait_deadline(num_iterations, sleep_ms);
+	std::unique_lock<std::mutex> lk(mtx_);
+	// Woken up when the last data is processed or the thread quits
+	return cond_state_.wait_until(lk, deadline,
+		[this] { return !is_running_ || size_about() == 0; });
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGeneric::notify_if_empty() {
+	if (size_about() > 0) return;
+	// The waiters test size_about under mtx_
+	std::lock_guard<std::mutex> lk(mtx_);
+	cond_state_.notify_all();
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGeneric::set_cbk_func(
 	cbk_func callback_func) {
 	callback_func_ = callback_func;
 }
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGeneric::set_cbk_func_batch(
+	cbk_func_batch callback_func) {
+	callback_func_batch_ = callback_func;
+}
 
 } // namespace storedata
\ No newline at end of file
@@ -27,57 +27,219 @@ namespace storedata
 
 //-----------------------------------------------------------------------------
 DataDesynchronizerGenericFaster::DataDesynchronizerGenericFaster() {
-	num_threads_ = 0;
-	max_threads_ = 1;
+	max_threads_ = (std::max)(1, static_cast<int>(
+		std::thread::hardware_concurrency()));
+	save_boost_ = false;
+	save_boost_ordered_ = false;
 	is_running_ = false;
+	continue_save_ = false;
+	drain_on_stop_ = false;
+	consumer_waiting_ = false;
+	// The last task of the pool may complete the wait for the empty queue
+	worker_pool_.set_idle_callback([this] { notify_if_empty(); });
+}
+//-----------------------------------------------------------------------------
+DataDesynchronizerGenericFaster::~DataDesynchronizerGenericFaster() {
+	stop();
+	if (thread_.joinable()) thread_.join();
+	// Release the data not processed
+	std::unique_ptr<AtomicContainerDataFaster> element;
+	while (!container_.empty()) {
+		element = std::move(container_.front());
+		container_.pop();
+		if (element && element->data()) element->dispose();
+	}
+	while (ring_params_.mode != DesynchronizerQueueMode::Mutex &&
+		ring_try_pop(element)) {
+		if (element && element->data()) element->dispose();
+	}
 }
 //-----------------------------------------------------------------------------
-void DataDesynchronizerGenericFaster::push(
+DataDesynchronizerGenericFaster::DataDesynchronizerGenericFaster(
+	const DesynchronizerRingParams &ring_params) :
+	DataDesynchronizerGenericFaster() {
+	ring_params_ = ring_params;
+	switch (ring_params_.mode) {
+	case DesynchronizerQueueMode::RingSPSC:
+		ring_spsc_.reset(new RingBufferSPSC<
+			std::unique_ptr<AtomicContainerDataFaster>>(ring_params_.capacity));
+		break;
+	case DesynchronizerQueueMode::RingMPSC:
+		ring_mpsc_.reset(new RingBufferMPSC<
+			std::unique_ptr<AtomicContainerDataFaster>>(ring_params_.capacity));
+		break;
+	default:
+		break;
+	}
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGenericFaster::push(
 	std::unique_ptr<AtomicContainerDataFaster> &rcd) {
-	{
-		std::lock_guard<std::mutex> lk(mtx_);
-		// Add the data
-		container_.push(std::move(rcd));
-		data_ready_ = true;
+	size_t size_bytes = rcd ? rcd->size_bytes() : 0;
+	if (rcd) rcd->set_enqueue_time_us(DesynchronizerMetrics::now_us());
+
+	if (ring_params_.mode == DesynchronizerQueueMode::Mutex) {
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			// Add the data
+			container_.push(std::move(rcd));
+			metrics_.on_push(size_bytes);
+			data_ready_ = true;
+		}
+
+		cond_.notify_one();
+		return true;
 	}
 
-	cond_.notify_one();
+	// Lock-free path
+	// Counted before the push, so that the consumer never sees a negative
+	// depth.
+	metrics_.on_push(size_bytes);
+	if (ring_try_push(rcd)) {
+		ring_notify();
+		return true;
+	}
+	if (ring_params_.full_policy == DesynchronizerFullPolicy::Drop) {
+		metrics_.on_push_rejected(size_bytes);
+		return false;
+	}
+
+	// Block until the consumer frees a slot
+	auto t_start = std::chrono::steady_clock::now();
+	size_t num_attempts = 0;
+	while (!ring_try_push(rcd)) {
+		if (ring_params_.block_timeout_ms >= 0 &&
+			std::chrono::steady_clock::now() - t_start >=
+			std::chrono::milliseconds(ring_params_.block_timeout_ms)) {
+			metrics_.on_push_rejected(size_bytes);
+			return false;
+		}
+		// Make sure that the consumer is not sleeping on a full buffer
+		ring_notify();
+		if (++num_attempts < 64) {
+			std::this_thread::yield();
+		} else {
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+	ring_notify();
+	return true;
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGenericFaster::ring_try_push(
+	std::unique_ptr<AtomicContainerDataFaster> &rcd) {
+	if (ring_spsc_) return ring_spsc_->try_push(rcd);
+	return ring_mpsc_->try_push(rcd);
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGenericFaster::ring_try_pop(
+	std::unique_ptr<AtomicContainerDataFaster> &rcd) {
+	if (ring_spsc_) return ring_spsc_->try_pop(rcd);
+	return ring_mpsc_->try_pop(rcd);
+}
+//-----------------------------------------------------------------------------
+size_t DataDesynchronizerGenericFaster::ring_size() {
+	if (ring_spsc_) return ring_spsc_->size();
+	return ring_mpsc_->size();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericFaster::ring_notify() {
+	// Pairs with the fence in internal_thread: either the consumer sees the
+	// new element or the producer sees the consumer waiting.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (consumer_waiting_.load(std::memory_order_relaxed)) {
+		std::lock_guard<std::mutex> lk(mtx_);
+		cond_.notify_one();
+	}
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericFaster::ring_wait() {
+	std::unique_lock<std::mutex> lk(mtx_);
+	consumer_waiting_.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	// The timeout covers a stop request without notification
+	cond_.wait_for(lk, std::chrono::milliseconds(10), [this] {
+		return ring_size() > 0 || !continue_save_; });
+	consumer_waiting_.store(false, std::memory_order_relaxed);
 }
 //-----------------------------------------------------------------------------
 bool DataDesynchronizerGenericFaster::start() {
 	std::lock_guard<std::mutex> lk(mtx_);
 	if (is_running_) return false;
+	// Release the thread of the previous session (it is quitting)
+	if (thread_.joinable()) thread_.join();
 	continue_save_ = true;
-	std::thread t1(&DataDesynchronizerGenericFaster::internal_thread, this);
-	t1.detach();
+	drain_on_stop_ = false;
+	is_running_ = true;
+	thread_ = std::thread(&DataDesynchronizerGenericFaster::internal_thread, this);
 	return true;
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericFaster::stop() {
-	continue_save_ = false;
-	cond_.notify_one();
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		continue_save_ = false;
+	}
+	cond_.notify_all();
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGenericFaster::drain_and_join(
+	std::chrono::steady_clock::time_point deadline) {
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		drain_on_stop_ = true;
+		continue_save_ = false;
+	}
+	cond_.notify_all();
+
+	bool is_stopped = false;
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		is_stopped = cond_state_.wait_until(lk, deadline,
+			[this] { return !is_running_; });
+		// Too late, quit after the current data
+		if (!is_stopped) drain_on_stop_ = false;
+	}
+	if (is_stopped && thread_.joinable()) thread_.join();
+	return is_stopped;
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericFaster::close() {
-	stop();
-	wait_until_is_not_ready(10, 100);
-	wait_until_buffer_is_empty(10, 100);
+	drain_and_join(std::chrono::steady_clock::now() +
+		std::chrono::seconds(2));
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericFaster::internal_thread() {
 
-	is_running_ = true;
-	while (continue_save_) {
+	while (continue_save_ || drain_on_stop_) {
+
+		// All the pending data is passed at once
+		if (callback_func_batch_) {
+			if (!process_batch()) break;
+			continue;
+		}
 
 		// Digest the main buffer frames (it it exist)
 		std::unique_ptr<AtomicContainerDataFaster> element;
-		{
+		bool is_popped = false;
+		if (ring_params_.mode != DesynchronizerQueueMode::Mutex) {
+			if (!ring_try_pop(element)) {
+				// Stop requested and all the data is processed
+				if (!continue_save_) break;
+				ring_wait();
+				continue;
+			}
+			is_popped = true;
+		} else {
 			std::unique_lock<std::mutex> lk(mtx_);
 			// no data to save
 			if (container_.size() == 0) {
+				// Stop requested and all the data is processed
+				if (!continue_save_) break;
 				data_ready_ = false;
 				//std::cout << "wait: " << data_ready_ << std::endl;
-				cond_.wait(lk, [this] { return data_ready_; });
+				cond_.wait(lk, [this] {
+					return data_ready_ || !continue_save_; });
 				//std::cout << "end wait: " << data_ready_ << std::endl;
 			}
 			// Pop the data
@@ -86,20 +248,123 @@ void DataDesynchronizerGenericFaster::internal_thread() {
 			if (container_.size() > 0) {
 				element = std::move(container_.front());
 				container_.pop();
+				is_popped = true;
+			}
+		}
+		if (!element) {
+			// A null data was pushed
+			if (is_popped) {
+				metrics_.on_release(1);
+				notify_if_empty();
 			}
+			continue;
 		}
+		metrics_.on_dequeue(element->enqueue_time_us(),
+			DesynchronizerMetrics::now_us());
 
-		// if the callback function does exist
-		if (callback_func_) {
-			callback_func_(element);
+		if (save_boost_ && !worker_pool_.is_running()) {
+			std::lock_guard<std::mutex> lk(mtx_);
+			worker_pool_.start(max_threads_, save_boost_ordered_);
+		} else if (!save_boost_ && worker_pool_.is_running()) {
+			// The dispatched data is completed before the next one is
+			// processed by this thread
+			worker_pool_.stop();
+		}
+		if (worker_pool_.is_running() && element) {
+			// The pool copies the task, so the ownership is shared
+			std::string key = element->unique_msg();
+			auto shared_element = std::make_shared<
+				std::unique_ptr<AtomicContainerDataFaster>>(std::move(element));
+			worker_pool_.dispatch(key, [this, shared_element] {
+				process(*shared_element); });
+		} else {
+			process(element);
+		}
+		// The dispatched data is counted by the pool
+		metrics_.on_release(1);
+		metrics_.log_if_due();
+		notify_if_empty();
+	}
+	// Complete the dispatched callbacks
+	worker_pool_.stop();
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		is_running_ = false;
+	}
+	cond_state_.notify_all();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericFaster::process(
+	std::unique_ptr<AtomicContainerDataFaster> &element) {
+	// if the callback function does exist
+	if (element && callback_func_) {
+		size_t size_bytes = element->size_bytes();
+		int64_t t0 = DesynchronizerMetrics::now_us();
+		callback_func_(element);
+		metrics_.on_processed(1, size_bytes,
+			DesynchronizerMetrics::now_us() - t0);
 
-			// dispose the data
-			if (element->data()) {
-				element->dispose();
+		// dispose the data (the callback may have taken the ownership)
+		if (element && element->data()) {
+			element->dispose();
+		}
+	}
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGenericFaster::process_batch() {
+	batch_.clear();
+	if (ring_params_.mode != DesynchronizerQueueMode::Mutex) {
+		// Take all the data currently in the ring buffer
+		std::unique_ptr<AtomicContainerDataFaster> element;
+		while (ring_try_pop(element)) {
+			batch_.push_back(std::move(element));
+		}
+		if (batch_.empty()) {
+			if (!continue_save_) return false;
+			ring_wait();
+			return true;
+		}
+	} else {
+		{
+			std::unique_lock<std::mutex> lk(mtx_);
+			// no data to save
+			if (container_.size() == 0) {
+				if (!continue_save_) return false;
+				data_ready_ = false;
+				cond_.wait(lk, [this] {
+					return data_ready_ || !continue_save_; });
 			}
+			// Take all the pending data with a single lock
+			std::swap(container_, container_swap_);
 		}
+		while (!container_swap_.empty()) {
+			batch_.push_back(std::move(container_swap_.front()));
+			container_swap_.pop();
+		}
+		if (batch_.empty()) return true;
 	}
-	is_running_ = false;
+
+	size_t size_bytes = 0;
+	int64_t t0 = DesynchronizerMetrics::now_us();
+	for (auto &it : batch_) {
+		if (!it) continue;
+		metrics_.on_dequeue(it->enqueue_time_us(), t0);
+		size_bytes += it->size_bytes();
+	}
+	callback_func_batch_(batch_);
+	metrics_.on_processed(batch_.size(), size_bytes,
+		DesynchronizerMetrics::now_us() - t0);
+	metrics_.on_release(batch_.size());
+	metrics_.log_if_due();
+
+	// dispose the data (the callback may have taken the ownership)
+	for (auto &it : batch_) {
+		if (it && it->data()) {
+			it->dispose();
+		}
+	}
+	batch_.clear();
+	return true;
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericFaster::set_save_boost(bool save_boost) {
@@ -107,46 +372,73 @@ void DataDesynchronizerGenericFaster::set_save_boost(bool save_boost) {
 	save_boost_ = save_boost;
 }
 //-----------------------------------------------------------------------------
+void DataDesynchronizerGenericFaster::set_max_threads(int max_threads) {
+	std::lock_guard<std::mutex> lk(mtx_);
+	max_threads_ = (std::max)(1, max_threads);
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericFaster::set_save_boost_ordered(bool ordered) {
+	std::lock_guard<std::mutex> lk(mtx_);
+	save_boost_ordered_ = ordered;
+}
+//-----------------------------------------------------------------------------
 size_t DataDesynchronizerGenericFaster::size_about() {
-	return container_.size();
+	return metrics_.depth() + worker_pool_.size_about();
+}
+//-----------------------------------------------------------------------------
+DesynchronizerMetricsSnapshot DataDesynchronizerGenericFaster::metrics() {
+	return metrics_.snapshot();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericFaster::reset_metrics() {
+	metrics_.reset();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericFaster::set_metrics_log(const std::string &name,
+	int period_ms) {
+	metrics_.set_name(name);
+	metrics_.set_log_period(period_ms);
 }
 //-----------------------------------------------------------------------------
 bool DataDesynchronizerGenericFaster::is_running() {
 	return is_running_;
 }
 //-----------------------------------------------------------------------------
-bool DataDesynchronizerGenericFaster::wait_until_is_not_ready(size_t num_iterations, int sleep_ms) {
-	for (size_t i = 0; i < num_iterations; ++i) {
-		if (is_running()) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-		}
-		else {
-			return true;
-		}
-	}
-	return false;
+bool DataDesynchronizerGenericFaster::wait_until_is_not_ready(
+	size_t num_iterations, 
+	int sleep_ms) {
+	auto deadline = wait_deadline(num_iterations, sleep_ms);
+	std::unique_lock<std::mutex> lk(mtx_);
+	return cond_state_.wait_until(lk, deadline,
+		[this] { return !is_running_; });
 }
 //-----------------------------------------------------------------------------
 bool DataDesynchronizerGenericFaster::wait_until_buffer_is_empty(
 	size_t num_iterations, 
 	int sleep_ms) {
-	for (size_t i = 0; i < num_iterations; ++i) {
-		std::cout << "iA: " << i << " " << (size_about() > 0) << " ";
-		if (is_running() && (size_about() > 0)) {
-			std::cout << size_about() << std::endl;
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-		}
-		else {
-			return true;
-		}
-	}
-	return false;
+	auto deadline = wait_deadline(num_iterations, sleep_ms);
+	std::unique_lock<std::mutex> lk(mtx_);
+	// Woken up when the last data is processed or the thread quits
+	return cond_state_.wait_until(lk, deadline,
+		[this] { return !is_running_ || size_about() == 0; });
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericFaster::notify_if_empty() {
+	if (size_about() > 0) return;
+	// The waiters test size_about under mtx_
+	std::lock_guard<std::mutex> lk(mtx_);
+	cond_state_.notify_all();
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericFaster::set_cbk_func_faster(
 	cbk_func_faster callback_func) {
 	callback_func_ = callback_func;
 }
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericFaster::set_cbk_func_batch(
+	cbk_func_faster_batch callback_func) {
+	callback_func_batch_ = callback_func;
+}
 
 
 
@@ -27,9 +27,20 @@ namespace storedata
 
 //-----------------------------------------------------------------------------
 	DataDesynchronizerGenericInherit::DataDesynchronizerGenericInherit() {
-	num_threads_ = 0;
-	max_threads_ = 1;
+	max_threads_ = (std::max)(1, static_cast<int>(
+		std::thread::hardware_concurrency()));
+	save_boost_ = false;
+	save_boost_ordered_ = false;
 	is_running_ = false;
+	continue_save_ = false;
+	drain_on_stop_ = false;
+	// The last task of the pool may complete the wait for the empty queue
+	worker_pool_.set_idle_callback([this] { notify_if_empty(); });
+}
+//-----------------------------------------------------------------------------
+DataDesynchronizerGenericInherit::~DataDesynchronizerGenericInherit() {
+	stop();
+	if (thread_.joinable()) thread_.join();
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericInherit::push(
@@ -37,7 +48,10 @@ void DataDesynchronizerGenericInherit::push(
 	{
 		std::lock_guard<std::mutex> lk(mtx_);
 		// Add the data
+		if (rcd) rcd->set_enqueue_time_us(DesynchronizerMetrics::now_us());
 		container_.push(std::move(rcd));
+		// The size of the data is not known
+		metrics_.on_push(0);
 		data_ready_ = true;
 	}
 
@@ -47,37 +61,73 @@ void DataDesynchronizerGenericInherit::push(
 bool DataDesynchronizerGenericInherit::start() {
 	std::lock_guard<std::mutex> lk(mtx_);
 	if (is_running_) return false;
+	// Release the thread of the previous session (it is quitting)
+	if (thread_.joinable()) thread_.join();
 	continue_save_ = true;
-	std::thread t1(&DataDesynchronizerGenericInherit::internal_thread, this);
-	t1.detach();
+	drain_on_stop_ = false;
+	is_running_ = true;
+	thread_ = std::thread(&DataDesynchronizerGenericInherit::internal_thread, this);
 	return true;
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericInherit::stop() {
-	continue_save_ = false;
-	cond_.notify_one();
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		continue_save_ = false;
+	}
+	cond_.notify_all();
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGenericInherit::drain_and_join(
+	std::chrono::steady_clock::time_point deadline) {
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		drain_on_stop_ = true;
+		continue_save_ = false;
+	}
+	cond_.notify_all();
+
+	bool is_stopped = false;
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		is_stopped = cond_state_.wait_until(lk, deadline,
+			[this] { return !is_running_; });
+		// Too late, quit after the current data
+		if (!is_stopped) drain_on_stop_ = false;
+	}
+	if (is_stopped && thread_.joinable()) thread_.join();
+	return is_stopped;
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericInherit::close() {
-	stop();
-	wait_until_is_not_ready(10, 100);
-	wait_until_buffer_is_empty(10, 100);
+	drain_and_join(std::chrono::steady_clock::now() +
+		std::chrono::seconds(2));
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericInherit::internal_thread() {
 
-	is_running_ = true;
-	while (continue_save_) {
+	while (continue_save_ || drain_on_stop_) {
+
+		// All the pending data is passed at once
+		if (callback_func_batch_) {
+			if (!process_batch()) break;
+			continue;
+		}
 
 		// Digest the main buffer frames (it it exist)
 		std::unique_ptr<AtomicContainerDataInherit> element;
+		bool save_boost = false;
+		bool is_popped = false;
 		{
 			std::unique_lock<std::mutex> lk(mtx_);
 			// no data to save
 			if (container_.size() == 0) {
+				// Stop requested and all the data is processed
+				if (!continue_save_) break;
 				data_ready_ = false;
 				//std::cout << "wait: " << data_ready_ << std::endl;
-				cond_.wait(lk, [this] { return data_ready_; });
+				cond_.wait(lk, [this] {
+					return data_ready_ || !continue_save_; });
 				//std::cout << "end wait: " << data_ready_ << std::endl;
 			}
 			// Pop the data
@@ -86,22 +136,97 @@ void DataDesynchronizerGenericInherit::internal_thread() {
 			if (container_.size() > 0) {
 				element = std::move(container_.front());
 				container_.pop();
+				is_popped = true;
 			}
+			save_boost = save_boost_;
+		}
+		if (!is_popped) continue;
+		if (element) {
+			metrics_.on_dequeue(element->enqueue_time_us(),
+				DesynchronizerMetrics::now_us());
+		}
+
+		if (save_boost && !worker_pool_.is_running()) {
+			std::lock_guard<std::mutex> lk(mtx_);
+			worker_pool_.start(max_threads_, save_boost_ordered_);
+		} else if (!save_boost && worker_pool_.is_running()) {
+			// The dispatched data is completed before the next one is
+			// processed by this thread
+			worker_pool_.stop();
 		}
+		if (worker_pool_.is_running() && element) {
+			// The pool copies the task, so the ownership is shared
+			std::string key = element->unique_msg();
+			auto shared_element = std::make_shared<
+				std::unique_ptr<AtomicContainerDataInherit>>(std::move(element));
+			worker_pool_.dispatch(key, [this, shared_element] {
+				process(*shared_element); });
+		} else {
+			process(element);
+		}
+		// The dispatched data is counted by the pool
+		metrics_.on_release(1);
+		metrics_.log_if_due();
+		notify_if_empty();
+	}
+	// Complete the dispatched callbacks
+	worker_pool_.stop();
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		is_running_ = false;
+	}
+	cond_state_.notify_all();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericInherit::process(
+	std::unique_ptr<AtomicContainerDataInherit> &element) {
+	// if the callback function does exist
+	if (callback_func_) {
+		int64_t t0 = DesynchronizerMetrics::now_us();
+		callback_func_(element);
+		metrics_.on_processed(1, 0, DesynchronizerMetrics::now_us() - t0);
+		//element->dispose();
+		//element.reset();
 
-		// if the callback function does exist
-		if (callback_func_) {
-			callback_func_(element);
-			//element->dispose();
-			//element.reset();
+		//// dispose the data (no need)
+		//if (element->data) {
+		//	element->dispose();
+		//}
+	}
+}
+//-----------------------------------------------------------------------------
+bool DataDesynchronizerGenericInherit::process_batch() {
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		// no data to save
+		if (container_.size() == 0) {
+			if (!continue_save_) return false;
+			data_ready_ = false;
+			cond_.wait(lk, [this] { return data_ready_ || !continue_save_; });
+		}
+		// Take all the pending data with a single lock
+		std::swap(container_, container_swap_);
+	}
 
-			//// dispose the data (no need)
-			//if (element->data) {
-			//	element->dispose();
-			//}
+	batch_.clear();
+	int64_t t0 = DesynchronizerMetrics::now_us();
+	while (!container_swap_.empty()) {
+		if (container_swap_.front()) {
+			metrics_.on_dequeue(container_swap_.front()->enqueue_time_us(), t0);
 		}
+		batch_.push_back(std::move(container_swap_.front()));
+		container_swap_.pop();
 	}
-	is_running_ = false;
+	if (batch_.empty()) return true;
+
+	callback_func_batch_(batch_);
+	metrics_.on_processed(batch_.size(), 0,
+		DesynchronizerMetrics::now_us() - t0);
+	metrics_.on_release(batch_.size());
+	metrics_.log_if_due();
+	batch_.clear();
+	notify_if_empty();
+	return true;
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericInherit::set_save_boost(bool save_boost) {
@@ -109,46 +234,73 @@ void DataDesynchronizerGenericInherit::set_save_boost(bool save_boost) {
 	save_boost_ = save_boost;
 }
 //-----------------------------------------------------------------------------
+void DataDesynchronizerGenericInherit::set_max_threads(int max_threads) {
+	std::lock_guard<std::mutex> lk(mtx_);
+	max_threads_ = (std::max)(1, max_threads);
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericInherit::set_save_boost_ordered(bool ordered) {
+	std::lock_guard<std::mutex> lk(mtx_);
+	save_boost_ordered_ = ordered;
+}
+//-----------------------------------------------------------------------------
 size_t DataDesynchronizerGenericInherit::size_about() {
-	return container_.size();
+	return metrics_.depth() + worker_pool_.size_about();
+}
+//-----------------------------------------------------------------------------
+DesynchronizerMetricsSnapshot DataDesynchronizerGenericInherit::metrics() {
+	return metrics_.snapshot();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericInherit::reset_metrics() {
+	metrics_.reset();
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericInherit::set_metrics_log(const std::string &name,
+	int period_ms) {
+	metrics_.set_name(name);
+	metrics_.set_log_period(period_ms);
 }
 //-----------------------------------------------------------------------------
 bool DataDesynchronizerGenericInherit::is_running() {
 	return is_running_;
 }
 //-----------------------------------------------------------------------------
-bool DataDesynchronizerGenericInherit::wait_until_is_not_ready(size_t num_iterations, int sleep_ms) {
-	for (size_t i = 0; i < num_iterations; ++i) {
-		if (is_running()) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-		}
-		else {
-			return true;
-		}
-	}
-	return false;
+bool DataDesynchronizerGenericInherit::wait_until_is_not_ready(
+	size_t num_iterations, 
+	int sleep_ms) {
+	auto deadline = wait_deadline(num_iterations, sleep_ms);
+	std::unique_lock<std::mutex> lk(mtx_);
+	return cond_state_.wait_until(lk, deadline,
+		[this] { return !is_running_; });
 }
 //-----------------------------------------------------------------------------
 bool DataDesynchronizerGenericInherit::wait_until_buffer_is_empty(
 	size_t num_iterations, 
 	int sleep_ms) {
-	for (size_t i = 0; i < num_iterations; ++i) {
-		std::cout << "iA: " << i << " " << (size_about() > 0) << " ";
-		if (is_running() && (size_about() > 0)) {
-			std::cout << size_about() << std::endl;
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-		}
-		else {
-			return true;
-		}
-	}
-	return false;
+	auto deadline = wait_deadline(num_iterations, sleep_ms);
+	std::unique_lock<std::mutex> lk(mtx_);
+	// Woken up when the last data is processed or the thread quits
+	return cond_state_.wait_until(lk, deadline,
+		[this] { return !is_running_ || size_about() == 0; });
+}
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericInherit::notify_if_empty() {
+	if (size_about() > 0) return;
+	// The waiters test size_about under mtx_
+	std::lock_guard<std::mutex> lk(mtx_);
+	cond_state_.notify_all();
 }
 //-----------------------------------------------------------------------------
 void DataDesynchronizerGenericInherit::set_cbk_func_inherit(
 	cbk_func_inherit callback_func) {
 	callback_func_ = callback_func;
 }
+//-----------------------------------------------------------------------------
+void DataDesynchronizerGenericInherit::set_cbk_func_batch(
+	cbk_func_inherit_batch callback_func) {
+	callback_func_batch_ = callback_func;
+}
 
 
 } // namespace storedata
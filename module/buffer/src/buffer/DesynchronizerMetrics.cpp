@@ -0,0 +1,231 @@
+/* @file DesynchronizerMetrics.cpp
+ * @brief Implementation of the counters and histograms of the desynchronizers.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+
+#include "buffer/inc/buffer/DesynchronizerMetrics.hpp"
+#include "logger/inc/logger/log.hpp"
+
+namespace storedata
+{
+
+namespace
+{
+/** @brief It updates a maximum value.
+*/
+template <typename _Ty>
+void update_max(std::atomic<_Ty> &max_value, _Ty value) {
+	_Ty current = max_value.load(std::memory_order_relaxed);
+	while (value > current &&
+		!max_value.compare_exchange_weak(current, value,
+			std::memory_order_relaxed)) {
+	}
+}
+} // namespace
+
+//-----------------------------------------------------------------------------
+LatencyHistogram::LatencyHistogram() {
+	reset();
+}
+//-----------------------------------------------------------------------------
+void LatencyHistogram::add(int64_t us) {
+	if (us < 0) us = 0;
+	// Index of the highest bit + 1 (0 for less than 1us)
+	size_t bin = 0;
+	for (uint64_t v = static_cast<uint64_t>(us); v != 0 && 
+		bin + 1 < kNumBins; v >>= 1) {
+		++bin;
+	}
+	bins_[bin].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	sum_us_.fetch_add(us, std::memory_order_relaxed);
+	update_max(max_us_, us);
+}
+//-----------------------------------------------------------------------------
+void LatencyHistogram::reset() {
+	for (size_t i = 0; i < kNumBins; ++i) {
+		bins_[i] = 0;
+	}
+	count_ = 0;
+	sum_us_ = 0;
+	max_us_ = 0;
+}
+//-----------------------------------------------------------------------------
+double LatencyHistogram::percentile(double q, size_t count) {
+	size_t target = static_cast<size_t>(q * count);
+	if (target == 0) target = 1;
+	size_t cumulative = 0;
+	for (size_t i = 0; i < kNumBins; ++i) {
+		cumulative += bins_[i].load(std::memory_order_relaxed);
+		if (cumulative >= target) {
+			// Upper bound of the bin, limited by the maximum
+			double upper = i == 0 ? 1.0 : static_cast<double>(
+				uint64_t(1) << i);
+			double max_us = static_cast<double>(max_us_);
+			return upper < max_us ? upper : max_us;
+		}
+	}
+	return static_cast<double>(max_us_);
+}
+//-----------------------------------------------------------------------------
+LatencyStats LatencyHistogram::stats() {
+	LatencyStats s;
+	s.count = count_;
+	if (s.count == 0) return s;
+	s.mean_us = static_cast<double>(sum_us_) / s.count;
+	s.p50_us = percentile(0.50, s.count);
+	s.p99_us = percentile(0.99, s.count);
+	s.max_us = static_cast<double>(max_us_);
+	return s;
+}
+//-----------------------------------------------------------------------------
+DesynchronizerMetrics::DesynchronizerMetrics() {
+	depth_ = 0;
+	log_period_ms_ = 0;
+	last_log_us_ = now_us();
+	reset();
+}
+//-----------------------------------------------------------------------------
+int64_t DesynchronizerMetrics::now_us() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::on_push(size_t size_bytes) {
+	pushed_items_.fetch_add(1, std::memory_order_relaxed);
+	pushed_bytes_.fetch_add(size_bytes, std::memory_order_relaxed);
+	size_t depth = depth_.fetch_add(1, std::memory_order_relaxed) + 1;
+	depth_sum_.fetch_add(depth, std::memory_order_relaxed);
+	depth_samples_.fetch_add(1, std::memory_order_relaxed);
+	update_max(depth_high_water_, depth);
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::on_push_rejected(size_t size_bytes) {
+	pushed_items_.fetch_sub(1, std::memory_order_relaxed);
+	pushed_bytes_.fetch_sub(size_bytes, std::memory_order_relaxed);
+	on_drop(size_bytes, true);
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::on_drop(size_t size_bytes, bool was_queued) {
+	dropped_items_.fetch_add(1, std::memory_order_relaxed);
+	dropped_bytes_.fetch_add(size_bytes, std::memory_order_relaxed);
+	if (was_queued) depth_.fetch_sub(1, std::memory_order_relaxed);
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::on_dequeue(int64_t enqueue_us, int64_t now_us) {
+	time_in_queue_.add(now_us - enqueue_us);
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::on_processed(size_t num_items,
+	size_t size_bytes, int64_t callback_us) {
+	processed_items_.fetch_add(num_items, std::memory_order_relaxed);
+	processed_bytes_.fetch_add(size_bytes, std::memory_order_relaxed);
+	callback_duration_.add(callback_us);
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::on_release(size_t num_items) {
+	depth_.fetch_sub(num_items, std::memory_order_relaxed);
+}
+//-----------------------------------------------------------------------------
+size_t DesynchronizerMetrics::depth() {
+	return depth_.load(std::memory_order_relaxed);
+}
+//-----------------------------------------------------------------------------
+DesynchronizerMetricsSnapshot DesynchronizerMetrics::snapshot() {
+	DesynchronizerMetricsSnapshot s;
+	s.elapsed_s = (now_us() - start_us_) / 1000000.0;
+	s.pushed_items = pushed_items_;
+	s.pushed_bytes = pushed_bytes_;
+	s.processed_items = processed_items_;
+	s.processed_bytes = processed_bytes_;
+	s.dropped_items = dropped_items_;
+	s.dropped_bytes = dropped_bytes_;
+	s.queue_depth = depth_;
+	s.queue_depth_high_water = depth_high_water_;
+	size_t depth_samples = depth_samples_;
+	if (depth_samples > 0) {
+		s.queue_depth_mean = static_cast<double>(depth_sum_) / 
+			depth_samples;
+	}
+	if (s.elapsed_s > 0) {
+		s.enqueue_rate = s.pushed_items / s.elapsed_s;
+		s.processed_bytes_rate = s.processed_bytes / s.elapsed_s;
+	}
+	s.time_in_queue = time_in_queue_.stats();
+	s.callback_duration = callback_duration_.stats();
+	return s;
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::reset() {
+	start_us_ = now_us();
+	pushed_items_ = 0;
+	pushed_bytes_ = 0;
+	processed_items_ = 0;
+	processed_bytes_ = 0;
+	dropped_items_ = 0;
+	dropped_bytes_ = 0;
+	depth_high_water_ = depth_.load();
+	depth_sum_ = 0;
+	depth_samples_ = 0;
+	time_in_queue_.reset();
+	callback_duration_.reset();
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::set_name(const std::string &name) {
+	std::lock_guard<std::mutex> lk(mtx_name_);
+	name_ = name;
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::set_log_period(int period_ms) {
+	log_period_ms_ = period_ms;
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::log_if_due() {
+	int period_ms = log_period_ms_;
+	if (period_ms <= 0) return;
+	int64_t now = now_us();
+	int64_t last = last_log_us_.load(std::memory_order_relaxed);
+	if (now - last < static_cast<int64_t>(period_ms) * 1000) return;
+	// Only one thread writes the log for each period
+	if (!last_log_us_.compare_exchange_strong(last, now)) return;
+	log();
+}
+//-----------------------------------------------------------------------------
+void DesynchronizerMetrics::log() {
+	DesynchronizerMetricsSnapshot s = snapshot();
+	std::string name;
+	{
+		std::lock_guard<std::mutex> lk(mtx_name_);
+		name = name_;
+	}
+	CmnLib::control::LogMS::Info("[%s] pushed:%zu (%.1f/s) processed:%zu "
+		"(%.1f MB/s) dropped:%zu (%zu bytes) depth:%zu (max:%zu mean:%.1f) "
+		"queue us p50:%.0f p99:%.0f max:%.0f callback us p50:%.0f "
+		"p99:%.0f max:%.0f\n",
+		name.c_str(), s.pushed_items, s.enqueue_rate, s.processed_items,
+		s.processed_bytes_rate / (1024.0 * 1024.0), s.dropped_items,
+		s.dropped_bytes, s.queue_depth, s.queue_depth_high_water,
+		s.queue_depth_mean, s.time_in_queue.p50_us, s.time_in_queue.p99_us,
+		s.time_in_queue.max_us, s.callback_duration.p50_us,
+		s.callback_duration.p99_us, s.callback_duration.max_us);
+}
+
+} // namespace storedata
@@ -25,18 +25,39 @@
 
 #include <iostream>
 #include <vector>
+#include <mutex>
 
 #include "opencv2/opencv.hpp"
 
 #define BOOST_BUILD
 #include "create_file.hpp"
 #include "create_video.hpp"
+#include "mapped_file.hpp"
+#include "record_reader.hpp"
+#include "fixed_slot_file.hpp"
 
 #include "record_defines.hpp"
 
 namespace storedata
 {
 
+/** @brief Framing of the PlayerRecorder frames.
+
+	Header: int codified, cols, rows, channels, size_t image size, message
+	size. The view contains the whole frame (see PlayerRecorder::decode_frame).
+*/
+struct PlayerRecordFraming
+{
+	static const size_t kHeaderBytes = sizeof(int) * 4 + sizeof(size_t) * 2;
+
+	/** @brief It sets the view of the frame at the beginning of data.
+
+		@return It returns the bytes of the frame (0 if truncated).
+	*/
+	static STOREDATA_RECORD_EXPORT size_t next(const char *data,
+		size_t available, RecordView &view);
+};
+
 /** @brief Class to record/play RGB data
 */
 class PlayerRecorder
@@ -70,6 +91,26 @@ public:
 		int max_memory_allocable, 
 		int record_framerate);
 
+	/** @brief It writes the files in the indexed format (see IndexedFile).
+
+		It must be called before setup_file. The read detects the format.
+	*/
+	STOREDATA_RECORD_EXPORT void set_indexed_format(bool indexed);
+
+	/** @brief It writes the raw frames in fixed size slots (see
+	           FixedSlotFile).
+
+		The frames must have the same size and type, and a message up to
+		max_msg_bytes: record_file rejects the other frames. The frames
+		are not encoded. It must be called before setup_file, and it
+		disables the indexed format. The read detects the format.
+		@param[in] cols Width of the frames. 0 disables the fixed slots.
+		@param[in] alignment Alignment of the slots (see
+		                     FixedSlotFile::make_layout).
+	*/
+	STOREDATA_RECORD_EXPORT void set_fixed_slot_mode(int cols, int rows,
+		int type, size_t max_msg_bytes, size_t alignment = 4096);
+
 	/** @brief
 
 		@previous record
@@ -128,6 +169,28 @@ public:
 	STOREDATA_RECORD_EXPORT void set_callback_createfile(
 		cbk_fname_changed callback_createfile);
 
+	/** @brief It calls the callback for each frame of the file.
+
+		The frames are decoded one at a time (see RecordReader).
+		@param[in] callback It returns false to stop the reading.
+		@param[in] read_ahead Number of frames loaded in background.
+		@return It returns the number of frames read.
+	*/
+	STOREDATA_RECORD_EXPORT static size_t for_each_frame(
+		const std::string &filename,
+		const std::function<bool(const cv::Mat &image,
+			const std::vector<char> &msg)> &callback,
+		size_t read_ahead = 0);
+
+	/** @brief It decodes a frame (a view of PlayerRecordFraming).
+
+		@param[out] image Decoded image (empty if the frame has no image).
+		@param[out] msg Message of the frame.
+		@return It returns false if the frame is not valid.
+	*/
+	STOREDATA_RECORD_EXPORT static bool decode_frame(const RecordView &frame,
+		cv::Mat &image, std::vector<char> &msg);
+
 private:
 
 	/** @brief File Generator manager
@@ -137,16 +200,36 @@ private:
 	*/
 	std::map<int, FileGeneratorParams> fgp_;
 
+	/** @brief Buffer of the encoded frames (guarded by mtx_encode_)
+	*/
+	std::vector<uchar> encode_buffer_;
+	std::mutex mtx_encode_;
+
+	/** @brief Layout of the fixed slots (stride 0 if disabled)
+	*/
+	FixedSlotLayout fixed_slot_;
+	/** @brief Zeros that complete the slots
+	*/
+	std::vector<char> slot_padding_;
+	/** @brief Time of the last slot (the slots are searched by time)
+	*/
+	int64_t last_slot_timestamp_us_ = 0;
+
 	// <video>
 	VideoGeneratorManagerAsync vgm_;
 	/** @brief File Generator parameters
 	*/
 	std::map<int, VideoGeneratorParams> vgp_;
 
-	/** @brief It reads the recorded data
+	/** @brief It pushes the frame (header, image, message) to the writer.
 	*/
-	void data2data_type(char *data, int maxsize, 
-		std::vector< std::pair<cv::Mat, std::vector<char> > > &out);
+	bool push_frame(const cv::Mat &image, bool encoded,
+		const std::vector<uchar> &buffer, const void *msg, size_t msg_size);
+
+	/** @brief It pushes the frame in a fixed slot.
+	*/
+	bool push_slot(const cv::Mat &image, const void *msg, size_t msg_size);
+
 };
 
 } // namespace storedata
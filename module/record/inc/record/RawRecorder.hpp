@@ -30,6 +30,7 @@
 
 #define BOOST_BUILD
 #include "create_file.hpp"
+#include "mapped_file.hpp"
 
 // get the library configuration
 #include "lib_configuration.hpp"
@@ -43,9 +44,25 @@
 namespace storedata
 {
 
+/** @brief Framing of the RawRecorder data: size_t size, data.
+
+	Used with RecordViews to iterate the data of a file without copies:
+	for (const RecordView &v : RecordViews<RawRecordFraming>(file))
+*/
+struct RawRecordFraming
+{
+	/** @brief It sets the view of the data at the beginning of data.
+
+		@return It returns the bytes of the record (0 if truncated).
+	*/
+	static STOREDATA_RECORD_EXPORT size_t next(const char *data,
+		size_t available, RecordView &view);
+};
+
 /** @brief Class to record raw binary data.
 
-	@Warning Data writing is not guarantee. Not feedback returned.
+	@Warning Data writing is not guarantee unless set_guarantee_delivery
+	         is enabled. record returns false if the data is not accepted.
 */
 class RawRecorder
 {
@@ -66,6 +83,40 @@ public:
 		int max_memory_allocable, 
 		int record_framerate);
 
+	/** @brief It selects the lossless mode.
+
+		If enabled, each record is queued (in order) and written even if
+		the writer is busy. When the queue is full, record waits or returns
+		false according to queue_params. The framerate is not applied.
+		@param[in] guarantee_delivery If true the data is not replaced.
+		@param[in] queue_params Capacity and policy of the queue.
+	*/
+	STOREDATA_RECORD_EXPORT void set_guarantee_delivery(
+		bool guarantee_delivery,
+		const FileQueueParams &queue_params = FileQueueParams());
+
+	/** @brief It writes the files as preallocated segments.
+
+		It must be called before setup.
+		@param[in] use_segment If true see SegmentWriter.
+		@param[in] direct_io If true the page cache is bypassed (O_DIRECT).
+	*/
+	STOREDATA_RECORD_EXPORT void set_segment_writer(bool use_segment,
+		bool direct_io);
+
+	/** @brief It sets the asynchronous backend of the segment writer.
+
+		It must be called before setup. The backend can be shared.
+	*/
+	STOREDATA_RECORD_EXPORT void set_write_backend(
+		std::shared_ptr<AsyncWriteBackend> backend);
+
+	/** @brief It writes the files in the indexed format (see IndexedFile).
+
+		It must be called before setup. The read detects the format.
+	*/
+	STOREDATA_RECORD_EXPORT void set_indexed_format(bool indexed);
+
 	STOREDATA_RECORD_EXPORT bool record(const std::string &msg);
 	STOREDATA_RECORD_EXPORT bool record(const std::vector<uint8_t> &data);
 	STOREDATA_RECORD_EXPORT bool record(uint8_t* data, size_t len);
@@ -76,7 +127,10 @@ public:
 
 	/** @brief It reads binary data and put in a container.
 
-		The container has the binary data for each pushed data.
+		The container has the binary data for each pushed data. Both the
+		raw and the indexed files are accepted. Use RecordViews with
+		RawRecordFraming to iterate the data without copies, and
+		IndexedFileReader for the random access to the indexed files.
 	*/
 	STOREDATA_RECORD_EXPORT void read(const std::string &filename, 
 		std::vector< std::vector<uint8_t> > &data_info);
@@ -104,14 +158,13 @@ private:
 	*/
 	std::map<int, FileGeneratorParams> fgp_;
 
-	/** @brief It reads the recorded data
+	/** @brief If TRUE the records use the guaranteed delivery queue
+	*/
+	std::atomic<bool> guarantee_delivery_;
 
-		It extracts all the objects pushed in the record
-		the data size information is dropped and it is
-		possible to extract from the vector size.
+	/** @brief It pushes the record according to the delivery mode
 	*/
-	void data2data_type(char *data, int maxsize, 
-		std::vector< std::vector<uint8_t> > &out);
+	bool push(const void *data, size_t len);
 
 };
 
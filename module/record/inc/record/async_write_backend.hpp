@@ -0,0 +1,253 @@
+/**
+* @file async_write_backend.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_RECORD_ASYNC_WRITE_BACKEND_HPP__
+#define STOREDATA_RECORD_ASYNC_WRITE_BACKEND_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "record_defines.hpp"
+#include "create_base.hpp"
+
+namespace storedata
+{
+
+/** @brief Implementation of the asynchronous writes.
+*/
+enum class AsyncWriteBackendType : int
+{
+	Auto = 0,       // io_uring if available, thread pool otherwise
+	ThreadPool = 1, // pwrite executed by a pool of threads
+	IoUring = 2     // io_uring (requires USE_URING at build time)
+};
+
+/** @brief Parameters of the write backend.
+*/
+struct AsyncWriteParams
+{
+	AsyncWriteBackendType type;
+	/** @brief Number of registered buffers
+	*/
+	size_t num_buffers;
+	/** @brief Size of each buffer (rounded to 4096)
+	*/
+	size_t buffer_bytes;
+	/** @brief Threads of the ThreadPool backend
+	*/
+	size_t num_threads;
+	/** @brief Entries of the io_uring submission queue
+	*/
+	unsigned int queue_depth;
+
+	AsyncWriteParams() : type(AsyncWriteBackendType::Auto), num_buffers(16),
+		buffer_bytes(1024 * 1024), num_threads(2), queue_depth(64) {}
+};
+
+/** @brief Callback called when a write is completed.
+
+	The argument is the number of bytes written, or -errno in case of error.
+	It is called by the backend thread.
+*/
+typedef std::function<void(int64_t result)> cbk_write_done;
+
+/** @brief Backend that executes positional writes asynchronously.
+
+	The backend owns a fixed set of aligned buffers (registered with the
+	kernel by the io_uring backend). A producer acquires a buffer, fills it
+	and submits it: the buffer returns to the free set when the write is
+	completed. Memory owned by the caller can also be submitted, it must be
+	kept valid until the completion callback.
+
+	A single backend can be shared by many streams and files.
+
+	@brief ThreadSafe
+*/
+class AsyncWriteBackend
+{
+public:
+
+	/** @brief Alignment of the buffers (O_DIRECT compatible)
+	*/
+	static const size_t kAlignment = 4096;
+
+	STOREDATA_RECORD_EXPORT AsyncWriteBackend(size_t num_buffers,
+		size_t buffer_bytes);
+
+	STOREDATA_RECORD_EXPORT virtual ~AsyncWriteBackend();
+
+	/** @brief It returns a free buffer. It waits until a buffer is free.
+
+		@param[out] index Index of the buffer (used with submit_buffer).
+		@param[in] timeout_ms Maximum wait (negative without limit).
+		@return It returns the buffer. Nullptr if the timeout expires or the
+		        backend is stopped.
+	*/
+	STOREDATA_RECORD_EXPORT char* acquire_buffer(int &index,
+		int timeout_ms = -1);
+
+	/** @brief It returns a buffer not submitted to the free set.
+	*/
+	STOREDATA_RECORD_EXPORT void release_buffer(int index);
+
+	/** @brief It returns the size of each buffer.
+	*/
+	STOREDATA_RECORD_EXPORT size_t buffer_bytes() const;
+
+	/** @brief It writes size bytes of the buffer at offset of the file. The
+	           buffer is released after the completion.
+
+		@return It returns kSuccess if submitted, kFail otherwise.
+	*/
+	STOREDATA_RECORD_EXPORT int submit_buffer(int fd, int index, size_t size,
+		uint64_t offset, cbk_write_done done);
+
+	/** @brief It writes size bytes of data (owned by the caller) at offset
+	           of the file.
+
+		@return It returns kSuccess if submitted, kFail otherwise.
+	*/
+	STOREDATA_RECORD_EXPORT int submit(int fd, const void *data, size_t size,
+		uint64_t offset, cbk_write_done done);
+
+	/** @brief It waits until all the submitted writes are completed.
+	*/
+	STOREDATA_RECORD_EXPORT void wait_idle();
+
+	/** @brief It returns the number of writes not completed.
+	*/
+	STOREDATA_RECORD_EXPORT size_t in_flight();
+
+	/** @brief It returns the name of the implementation.
+	*/
+	STOREDATA_RECORD_EXPORT virtual const char* name() const = 0;
+
+protected:
+
+	/** @brief Write request
+	*/
+	struct Request
+	{
+		int fd;
+		/** @brief Registered buffer (-1 caller memory)
+		*/
+		int index;
+		const char *data;
+		size_t size;
+		uint64_t offset;
+		/** @brief Bytes already written (short writes)
+		*/
+		size_t done_bytes;
+		cbk_write_done done;
+	};
+
+	/** @brief Aligned buffers
+	*/
+	std::vector<char*> buffers_;
+
+	/** @brief It queues the request for the implementation.
+	*/
+	virtual int enqueue(Request &&request) = 0;
+
+	/** @brief It completes a request (callback, buffer release, counters).
+	*/
+	void complete(Request &request, int64_t result);
+
+	/** @brief It stops the implementation and waits the writes in flight.
+	           Called by the destructor of the derived class.
+	*/
+	void shutdown_wait();
+
+private:
+
+	size_t buffer_bytes_;
+	/** @brief Indexes of the free buffers
+	*/
+	std::vector<int> free_buffers_;
+	std::mutex mtx_buffers_;
+	std::condition_variable cond_buffers_;
+	/** @brief True after shutdown_wait (no buffer is given)
+	*/
+	bool stopped_;
+
+	/** @brief Writes submitted and not completed
+	*/
+	size_t in_flight_;
+	std::mutex mtx_idle_;
+	std::condition_variable cond_idle_;
+};
+
+/** @brief Backend that executes pwrite with a pool of threads.
+
+	Each worker takes up to ceil(pending / workers) requests at once (batch)
+	and writes them in order, so the pending requests are shared among the
+	workers.
+*/
+class AsyncWriteBackendThreadPool : public AsyncWriteBackend
+{
+public:
+
+	STOREDATA_RECORD_EXPORT AsyncWriteBackendThreadPool(
+		const AsyncWriteParams &params);
+
+	STOREDATA_RECORD_EXPORT ~AsyncWriteBackendThreadPool();
+
+	STOREDATA_RECORD_EXPORT const char* name() const override;
+
+protected:
+
+	int enqueue(Request &&request) override;
+
+private:
+
+	std::vector<std::thread> workers_;
+	std::deque<Request> pending_;
+	std::mutex mtx_;
+	std::condition_variable cond_;
+	bool continue_run_;
+
+	/** @brief Function executed by each worker
+	*/
+	void worker_thread();
+};
+
+/** @brief It creates the backend selected by params.
+
+	With Auto the io_uring backend is used if built with USE_URING and
+	supported by the kernel, the thread pool otherwise.
+	@return It returns the backend. Nullptr if the platform does not support
+	        positional writes (Windows) or the type is not available.
+*/
+STOREDATA_RECORD_EXPORT std::shared_ptr<AsyncWriteBackend>
+	create_async_write_backend(const AsyncWriteParams &params);
+
+} // namespace storedata
+
+#endif // STOREDATA_RECORD_ASYNC_WRITE_BACKEND_HPP__
@@ -31,7 +31,12 @@
 #include <map>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <queue>
+#include <deque>
+#include <chrono>
+#include <algorithm>
 
 #define BOOST_BUILD
 #ifdef BOOST_BUILD
@@ -46,11 +51,28 @@
 #include "storedata_time.hpp"
 #include "storedata_typedef.hpp"
 #include "create_base.hpp"
+#include "segment_writer.hpp"
+#include "indexed_file.hpp"
+#include "frame_pacer.hpp"
 
 namespace storedata
 {
 
 /** @brief Class to memorize a file until memory is availeble.
+
+	The pushed data is combined in a write buffer (group commit). The
+	buffer is written to the file when it reaches flush_bytes, when
+	flush_interval_ms has passed since the last write (checked by push and
+	flush_if_due), with sync and when the file is released.
+
+	With set_segment_writer each file is a SegmentWriter preallocated to
+	memory_max_allocable (optionally O_DIRECT). The flush_bytes is the size
+	of its aligned buffer and sync waits until the data is on disk.
+
+	With set_indexed_format the files are written in the IndexedFile
+	format: each data has a record header with timestamp and the footer
+	index is written by release. The memory check includes the headers and
+	the index.
 */
 class MemorizeFileManager : public MemorizeManagerBase
 {
@@ -88,8 +110,71 @@ class MemorizeFileManager : public MemorizeManagerBase
 	  STOREDATA_RECORD_EXPORT int check_memory(size_t size);
 
 	  /** @brief Push an image in the video container
+
+		  @param[in] timestamp_us Time of the data in microseconds since the
+		                          epoch (indexed format). Negative uses the
+		                          current time. It is clamped to the time
+		                          of the previous record, so the index is
+		                          ordered also if the clock steps back.
+	  */
+	  STOREDATA_RECORD_EXPORT int push(const std::vector<char> &data,
+		  int64_t timestamp_us = -1);
+
+	  /** @brief It sets the group commit thresholds.
+
+		  @param[in] flush_bytes Size of the write buffer. 0 writes each data
+		                         immediately (previous behaviour).
+		  @param[in] flush_interval_ms Maximum time the data is kept in the
+		                               buffer. Negative disables it.
+	  */
+	  STOREDATA_RECORD_EXPORT void set_group_commit(size_t flush_bytes,
+		  int flush_interval_ms);
+
+	  /** @brief It writes the buffer if flush_interval_ms has passed.
+	  */
+	  STOREDATA_RECORD_EXPORT void flush_if_due();
+
+	  /** @brief It writes the buffer and flushes the stream.
+
+		  Durability point: the data pushed so far is written to the disk
+		  (fdatasync). On Windows the stream is only flushed to the
+		  operating system.
+		  @return It returns kSuccess, kFileIsNotOpen or kFail on error.
+	  */
+	  STOREDATA_RECORD_EXPORT int sync();
+
+	  /** @brief It selects the segment writer for the next generated files.
+
+		  @param[in] use_segment If true the file is preallocated and written
+		                         with pwrite (see SegmentWriter).
+		  @param[in] direct_io If true the page cache is bypassed (O_DIRECT).
+	  */
+	  STOREDATA_RECORD_EXPORT void set_segment_writer(bool use_segment,
+		  bool direct_io);
+
+	  /** @brief It sets the asynchronous backend of the segment writer
+	             (applied to the next generated files).
+	  */
+	  STOREDATA_RECORD_EXPORT void set_write_backend(
+		  std::shared_ptr<AsyncWriteBackend> backend);
+
+	  /** @brief It selects the indexed format for the next generated files.
+
+		  The generated file is always a new file (append is ignored).
+		  @param[in] indexed If true see IndexedFile.
+		  @param[in] stream_id Id of the stream written in the records. The
+		                       stream name in the header is the filename.
 	  */
-	  STOREDATA_RECORD_EXPORT int push(const std::vector<char> &data);
+	  STOREDATA_RECORD_EXPORT void set_indexed_format(bool indexed,
+		  uint32_t stream_id);
+
+	  /** @brief It sets the bytes written at the beginning of each new file
+	             (i.e. FixedSlotFile header). Empty for none.
+
+		  It is not used with the indexed format.
+	  */
+	  STOREDATA_RECORD_EXPORT void set_file_header(
+		  const std::vector<char> &header);
 
   private:
 
@@ -109,6 +194,67 @@ class MemorizeFileManager : public MemorizeManagerBase
 	  /** @brief Stream to the output file.
 	  */
 	  std::ofstream fout_;
+	  /** @brief Path of the file opened by fout_ (used by sync)
+	  */
+	  std::string fout_filename_;
+
+	  /** @brief Write buffer (group commit)
+	  */
+	  std::vector<char> buffer_;
+	  /** @brief Buffer size that triggers the write
+	  */
+	  size_t flush_bytes_;
+	  /** @brief Maximum time in the buffer (negative disabled)
+	  */
+	  int flush_interval_ms_;
+	  /** @brief Time of the last write to the stream
+	  */
+	  std::chrono::steady_clock::time_point last_flush_;
+
+	  /** @brief Preallocated segment (used instead of fout_)
+	  */
+	  SegmentWriter segment_;
+	  /** @brief If TRUE the next files are written with segment_
+	  */
+	  bool use_segment_;
+	  bool direct_io_;
+	  /** @brief Data written to segment_ after the last flush
+	  */
+	  bool segment_dirty_;
+	  /** @brief Backend of the next segments (nullptr synchronous)
+	  */
+	  std::shared_ptr<AsyncWriteBackend> backend_;
+
+	  /** @brief If TRUE the next files use the indexed format
+	  */
+	  bool indexed_;
+	  uint32_t stream_id_;
+	  /** @brief Index of the current file
+	  */
+	  std::vector<IndexedFileEntry> index_;
+	  /** @brief If TRUE the current file needs the footer index
+	  */
+	  bool footer_pending_;
+	  /** @brief Header of the new files
+	  */
+	  std::vector<char> file_header_;
+
+	  /** @brief It writes the buffer to the stream and flushes it.
+	  */
+	  int flush_buffer();
+
+	  /** @brief It adds the bytes to the file (through the buffer or the
+	             segment).
+	  */
+	  int write_bytes(const char *data, size_t size);
+
+	  /** @brief It writes the index and the trailer of the indexed file.
+	  */
+	  int write_footer();
+
+	  /** @brief It returns true if the stream or the segment is open.
+	  */
+	  bool is_open() const;
 
 	/** @brief Function to get the file size.
 	*/
@@ -148,6 +294,73 @@ private:
 };
 
 
+/** @brief What push_data_write_guarantee does when the queue is full.
+*/
+enum class FileQueueFullPolicy : int
+{
+	Block = 0, // Wait until there is space (or the timeout expires)
+	Fail = 1   // Return kOutOfMemory immediately
+};
+
+/** @brief Capacity of the guaranteed delivery queue.
+*/
+struct FileQueueParams
+{
+	/** @brief Maximum number of queued data (0 no limit)
+	*/
+	size_t max_items;
+	/** @brief Memory budget of the queued data in bytes (0 no limit)
+	*/
+	size_t max_bytes;
+	FileQueueFullPolicy full_policy;
+	/** @brief Maximum wait for the Block policy. Negative waits forever.
+	*/
+	int block_timeout_ms;
+
+	FileQueueParams() : max_items(1024), max_bytes(256 * 1024 * 1024),
+		full_policy(FileQueueFullPolicy::Block), block_timeout_ms(-1) {}
+};
+
+/** @brief Part of a record (see push_gather).
+*/
+struct RecordSlice
+{
+	const void *data;
+	size_t size;
+
+	RecordSlice() : data(nullptr), size(0) {}
+	RecordSlice(const void *ptr, size_t len) : data(ptr), size(len) {}
+};
+
+/** @brief Counters of the guaranteed delivery queue.
+*/
+struct FileQueueStats
+{
+	/** @brief Data currently queued
+	*/
+	size_t queued_items;
+	/** @brief Bytes currently queued
+	*/
+	size_t queued_bytes;
+	/** @brief Maximum value reached by queued_bytes
+	*/
+	size_t queued_bytes_high_water;
+	/** @brief Data taken by the writer
+	*/
+	size_t written_items;
+	/** @brief Push calls that waited for space (Block)
+	*/
+	size_t blocked_pushes;
+	/** @brief Push calls rejected (Fail, timeout or closed)
+	*/
+	size_t rejected_pushes;
+
+	FileQueueStats() : queued_items(0), queued_bytes(0),
+		queued_bytes_high_water(0), written_items(0), blocked_pushes(0),
+		rejected_pushes(0) {}
+};
+
+
 /** @brief Class to manage the writing of the data in a file asynchronously.
 	
 	This class has a potential issue to lose or overwrite the data
@@ -157,8 +370,20 @@ private:
 	However, it is guarantee that during the writing, the data is not
 	modified.
 
+	A writer thread (started by setup, joined by close) owns the disk
+	operations. The push copies the data in a single pending slot and
+	returns immediately. If the writer is busy, a new push replaces the
+	data not written yet (counted by num_replaced). The data pending when
+	close is called is written before to quit.
+
+	push_data_write_guarantee is the lossless alternative: the data is
+	appended to a bounded FIFO queue (FileQueueParams) served by the same
+	writer, without framerate pacing. When the queue is full the producer
+	waits or it receives kOutOfMemory, depending on the policy. All the
+	queued data is written before close returns.
+
 	@brief ThreadSafe
-	@Warning Data writing is not guarantee. Not feedback returned.
+	@Warning Data writing is guarantee only with push_data_write_guarantee.
 */
 class FileGeneratorManagerAsync
 {
@@ -185,11 +410,6 @@ public:
 	*/
 	STOREDATA_RECORD_EXPORT bool under_writing();
 
-	/** @brief Function to add the frames to file. It is run in a separate
-	           thread.
-	*/
-	STOREDATA_RECORD_EXPORT bool procedure();
-
 	STOREDATA_RECORD_EXPORT void check();
 
 	/** @brief Try to push the data to a designed file writer.
@@ -201,7 +421,117 @@ public:
 	STOREDATA_RECORD_EXPORT int push_data_write_not_guarantee_can_replace(
 		const std::map<int, std::vector<char> > &data_in);
 
-	/** @brief Close the file
+	/** @brief Same as above, the data is moved in the pending slot.
+	*/
+	STOREDATA_RECORD_EXPORT int push_data_write_not_guarantee_can_replace(
+		std::map<int, std::vector<char> > &&data_in);
+
+	/** @brief It returns the number of data replaced before to be written.
+	*/
+	STOREDATA_RECORD_EXPORT size_t num_replaced();
+
+	/** @brief It sets the capacity of the guaranteed delivery queue.
+	*/
+	STOREDATA_RECORD_EXPORT void set_queue_params(
+		const FileQueueParams &queue_params);
+
+	/** @brief Push the data in the guaranteed delivery queue.
+
+		The data is written in the same order it is pushed.
+		@param[in] data_in The data to save in a file. The data_in key is used 
+		                   to select which file writer will be used.
+		@return It returns kSuccess if queued. kOutOfMemory if the queue is
+		        full (Fail policy or timeout). kFail if the writer is not
+		        running.
+	*/
+	STOREDATA_RECORD_EXPORT int push_data_write_guarantee(
+		const std::map<int, std::vector<char> > &data_in);
+
+	/** @brief Same as above, the data is moved in the queue.
+	*/
+	STOREDATA_RECORD_EXPORT int push_data_write_guarantee(
+		std::map<int, std::vector<char> > &&data_in);
+
+	/** @brief Push a record composed of many slices (i.e. header and
+	           payload) without temporary containers.
+
+		The slices are copied once in a buffer recycled from the previous
+		records, so no memory is allocated once the buffers are warm.
+		@param[in] id The file writer (key of the data).
+		@param[in] guarantee If true the record is queued as in
+		                     push_data_write_guarantee, otherwise it
+		                     replaces the pending record.
+	*/
+	STOREDATA_RECORD_EXPORT int push_gather(int id, const RecordSlice *slices,
+		size_t num_slices, bool guarantee);
+
+	/** @brief It returns a snapshot of the guaranteed delivery counters.
+	*/
+	STOREDATA_RECORD_EXPORT FileQueueStats queue_stats();
+
+	/** @brief It sets the group commit of the files (see MemorizeFileManager).
+
+		It is applied to the open files and to the files created by the next
+		setup. The writer thread writes the buffers older than
+		flush_interval_ms when idle.
+	*/
+	STOREDATA_RECORD_EXPORT void set_group_commit(size_t flush_bytes,
+		int flush_interval_ms);
+
+	/** @brief It sets the behavior of the record_framerate limit when the
+	           writes are late (see FramePacer). Default Skip.
+
+		It is applied by the next setup.
+	*/
+	STOREDATA_RECORD_EXPORT void set_pacing_policy(FramePacerPolicy policy,
+		size_t max_burst);
+
+	/** @brief It returns the counters of the record_framerate limit and the
+	           duration of the writes of the pending data.
+	*/
+	STOREDATA_RECORD_EXPORT FramePacerStats pacing_stats();
+
+	/** @brief It writes the buffered data of all the files to the disk
+	           (see MemorizeFileManager::sync). The data still in the
+	           pending slot or queue is not included.
+	*/
+	STOREDATA_RECORD_EXPORT int sync();
+
+	/** @brief It selects the segment writer (see MemorizeFileManager).
+
+		It is applied to the files generated after the call (next setup or
+		rollover).
+	*/
+	STOREDATA_RECORD_EXPORT void set_segment_writer(bool use_segment,
+		bool direct_io);
+
+	/** @brief It sets the asynchronous backend of the segment writer.
+
+		The same backend can be shared by many managers, so one thread
+		serves all the streams. It is used only with the segment writer.
+	*/
+	STOREDATA_RECORD_EXPORT void set_write_backend(
+		std::shared_ptr<AsyncWriteBackend> backend);
+
+	/** @brief It selects the indexed format (see IndexedFile).
+
+		It is applied to the files generated after the call (next setup or
+		rollover). The id of each stream is the key of the data. The
+		timestamp of a record is the time of its push.
+	*/
+	STOREDATA_RECORD_EXPORT void set_indexed_format(bool indexed);
+
+	/** @brief It sets the header of the files of the stream id (see
+	           MemorizeFileManager::set_file_header).
+
+		It is applied to the files generated after the call (next setup or
+		rollover).
+	*/
+	STOREDATA_RECORD_EXPORT void set_file_header(int id,
+		const std::vector<char> &header);
+
+	/** @brief It writes the pending data, stops the writer and closes the
+	           files.
 	*/
 	STOREDATA_RECORD_EXPORT void close();
 
@@ -216,16 +546,61 @@ public:
 
   private:
 
-#ifdef BOOST_BUILD
 	/** @brief Writing thread
 	*/
-	boost::thread* thr_;
-	boost::mutex mutex_;
-#endif
+	std::thread thread_writer_;
+	/** @brief It guards the pending slot (data_in_, has_data_)
+	*/
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	/** @brief It serializes the access to the files
+	*/
+	std::mutex mutex_write_;
 
 	/** @brief If TRUE the variable is under writing.
 	*/
-	bool under_writing_;
+	std::atomic<bool> under_writing_;
+	/** @brief If TRUE data_in_ contains data not written yet
+	*/
+	bool has_data_;
+	/** @brief If FALSE the writer quits after the pending data
+	*/
+	bool continue_write_;
+	/** @brief Number of data replaced before to be written
+	*/
+	size_t num_replaced_;
+
+	/** @brief Guaranteed delivery queue of (push time, data) (guarded by
+	           mutex_)
+	*/
+	std::deque<std::pair<int64_t, std::map<int, std::vector<char> > > > queue_;
+	FileQueueParams queue_params_;
+	FileQueueStats queue_stats_;
+	/** @brief Producers wait for space in queue_
+	*/
+	std::condition_variable cond_space_;
+	/** @brief Containers of the written records for each writer, reused
+	           by push_gather (guarded by mutex_). A pool holds at most
+	           max_items containers of queue_params_.
+	*/
+	std::map<int, std::vector<std::map<int, std::vector<char> > > >
+		data_pool_;
+
+	/** @brief Group commit of the files
+	*/
+	size_t flush_bytes_;
+	int flush_interval_ms_;
+	/** @brief Segment writer of the files
+	*/
+	bool use_segment_;
+	bool direct_io_;
+	std::shared_ptr<AsyncWriteBackend> backend_;
+	/** @brief Indexed format of the files
+	*/
+	bool indexed_;
+	/** @brief Header of the files of each stream
+	*/
+	std::map<int, std::vector<char> > file_headers_;
 
 	// set framerate to record and capture at
 	int record_framerate_;
@@ -236,15 +611,19 @@ public:
 
 	// Create a matrix to keep the retrieved frame
 	std::map<int, std::vector<char> > data_in_;
+	/** @brief Data under writing (swapped with data_in_)
+	*/
+	std::map<int, std::vector<char> > data_write_;
+	/** @brief Push time of data_in_ and data_write_ (microseconds)
+	*/
+	int64_t data_in_timestamp_us_;
+	int64_t data_write_timestamp_us_;
 
-	//vars
-#ifdef BOOST_BUILD
-	boost::posix_time::time_duration td_, td1_;
-	boost::posix_time::ptime nextFrameTimestamp_, 
-		currentFrameTimestamp_, initialLoopTimestamp_, finalLoopTimestamp_;
-#endif
-	int delayFound_;
-	int totalDelay_;
+	/** @brief Limit of record_framerate_ (guarded by mutex_)
+	*/
+	FramePacer pacer_;
+	FramePacerPolicy pacing_policy_;
+	size_t pacing_max_burst_;
 
 	/** @brief Create files
 	*/
@@ -257,6 +636,42 @@ public:
 	/** @brief Callback function when a file is created
 	*/
 	cbk_fname_changed callback_createfile_;
+
+	/** @brief Appendix of the last created files
+	*/
+	std::string last_appendix_;
+	/** @brief Files created with the same appendix
+	*/
+	int num_same_appendix_;
+
+	/** @brief Function executed by the writer thread
+	*/
+	void writer_thread();
+
+	/** @brief It writes the data in the files (mutex_write_ must be held).
+	*/
+	bool write_locked(const std::map<int, std::vector<char> > &data,
+		int64_t timestamp_us);
+
+	/** @brief It adds a counter to the appendix if equal to the previous.
+	*/
+	void make_unique_appendix(std::string &appendix);
+
+	/** @brief Function to add the pending data to file. It is run by the
+	           writer thread.
+
+		@return It returns true if at least one data is written.
+	*/
+	bool procedure();
+
+	/** @brief It waits for space and appends the data to queue_.
+	*/
+	int enqueue(std::map<int, std::vector<char> > &&data_in);
+
+	/** @brief It keeps the written data for the push_gather of one of its
+	           writers (mutex_ must be held).
+	*/
+	void recycle(std::map<int, std::vector<char> > &&data);
 };
 
 } // namespace storedata
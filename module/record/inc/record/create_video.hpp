@@ -27,18 +27,33 @@
 #include "boost/date_time/posix_time/posix_time.hpp"
 #include "boost/thread.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
 #include <opencv2/opencv.hpp>
 
 #include "storedata_typedef.hpp"
 #include "storedata_time.hpp"
 #include "record_defines.hpp"
 #include "create_base.hpp"
+#include "frame_pacer.hpp"
+#include "video_encoder.hpp"
 
 namespace storedata
 {
 
 /** @brief Class to capture video with a maximum size.
 
+	The frames are written by a VideoEncoder (cv::VideoWriter by default,
+	see set_encoder_params).
+
 	@previous_name VideoCaptureManager
 */
 class MemorizeVideoManager : public MemorizeManagerBase
@@ -70,6 +85,9 @@ class MemorizeVideoManager : public MemorizeManagerBase
 	  STOREDATA_RECORD_EXPORT void setup_metaframe(cv::Mat &meta_frame);
 
 	  /** @brief Generate a video capture file.
+
+		  @return It returns kSuccess if the video is opened, kFail if a
+		          video is already open or the writer can not be opened.
 	  */
 	  STOREDATA_RECORD_EXPORT int generate(const std::string &appendix);
 
@@ -78,9 +96,27 @@ class MemorizeVideoManager : public MemorizeManagerBase
 	  STOREDATA_RECORD_EXPORT int check_memory(const cv::Mat &image);
 
 	  /** @brief Push an image in the video container
+
+		  An image of different size is resized (see set_interpolation).
 	  */
 	  STOREDATA_RECORD_EXPORT int push(const cv::Mat &image);
 
+	  /** @brief It sets the interpolation of the resize (default
+	             cv::INTER_LINEAR, cv::INTER_AREA is better to reduce).
+	  */
+	  STOREDATA_RECORD_EXPORT void set_interpolation(int interpolation);
+
+	  /** @brief It returns the number of pushed images that were resized.
+
+		  A value different from 0 means that the sources and the video have
+		  different sizes.
+	  */
+	  STOREDATA_RECORD_EXPORT size_t num_resized() const;
+
+	  /** @brief It returns the size of the video frames.
+	  */
+	  STOREDATA_RECORD_EXPORT cv::Size size() const;
+
 	  /** @brief Change the encoder mode.
 
 		  Change the encoder mode. Usually is 
@@ -88,6 +124,16 @@ class MemorizeVideoManager : public MemorizeManagerBase
 	  */
 	  STOREDATA_RECORD_EXPORT void set_video_encoder(int video_encoder);
 
+	  /** @brief It sets the encoder of the videos (see VideoEncoderParams).
+	             It is applied by the next generate.
+	  */
+	  STOREDATA_RECORD_EXPORT void set_encoder_params(
+		  const VideoEncoderParams &params);
+
+	  /** @brief It returns the parameters of the encoder.
+	  */
+	  STOREDATA_RECORD_EXPORT const VideoEncoderParams& encoder_params() const;
+
   private:
 
 	  /** @brief Path and name of the file to memorize
@@ -113,14 +159,26 @@ class MemorizeVideoManager : public MemorizeManagerBase
 	  */
 	  cv::Mat meta_frame_;
 
-	  /** @brief Video writer
+	  /** @brief Interpolation and destination of the resize (reused)
 	  */
-	  cv::VideoWriter video_;
+	  int interpolation_;
+	  cv::Mat resized_;
+	  /** @brief Resized images (read by other threads)
+	  */
+	  std::atomic<size_t> num_resized_;
 
-	  /** @brief How the video is encoded
-		  CV_FOURCC('D', 'I', 'V', 'X')
+	  /** @brief Video writer (nullptr before the first generate)
 	  */
-	  int video_encoder_;
+	  std::unique_ptr<VideoEncoder> encoder_;
+
+	  /** @brief How the video is encoded (the fourcc is
+		  CV_FOURCC('D', 'I', 'V', 'X') by default)
+	  */
+	  VideoEncoderParams encoder_params_;
+
+	  /** @brief It returns true if the video is open.
+	  */
+	  bool is_open() const;
 
 };
 
@@ -164,7 +222,34 @@ private:
 };
 
 
-/** @brief Class to manage the 
+/** @brief Resize of the frames of a source with a size different from the
+           video.
+*/
+struct VideoResizeParams
+{
+	/** @brief Interpolation (i.e. cv::INTER_AREA to reduce)
+	*/
+	int interpolation;
+	/** @brief If true the frames are resized by the push while copied in
+	           the queues (no extra copy), otherwise by the writer threads.
+	*/
+	bool at_push;
+	/** @brief If true the push resizes the sources in parallel
+	           (cv::parallel_for_)
+	*/
+	bool parallel;
+
+	VideoResizeParams() : interpolation(cv::INTER_LINEAR), at_push(false),
+		parallel(false) {}
+};
+
+/** @brief Class to manage the videos of many sources.
+
+	Each source has its own writer thread and queue, so the frames of the
+	sources are encoded in parallel. When the queue of a source is full the
+	oldest frame is replaced. The rollover is decided when the frames are
+	pushed, so all the videos move to the files with the same appendix at
+	the same frame.
 
 	@previous_filename VideoGeneratorManager
 */
@@ -176,7 +261,7 @@ public:
 
 	STOREDATA_RECORD_EXPORT ~VideoGeneratorManagerAsync();
 
-	/** @brief Setup the videos to memorize
+	/** @brief Setup the videos to memorize and start the writers
 	*/
 	STOREDATA_RECORD_EXPORT int setup(
 		unsigned int max_memory_allocable_forvideo,
@@ -192,23 +277,24 @@ public:
 	*/
 	STOREDATA_RECORD_EXPORT void setup_metaframe(cv::Mat &meta_frame);
 
-	/** @brief Check if the video stream is in writing mode
+	/** @brief It returns true if the queue of a source is full (the next
+	           push replaces a frame not written yet).
 	*/
 	STOREDATA_RECORD_EXPORT bool under_writing();
 
-	/** @brief Function to add the frames to videos. It is run in a separate
-	           thread.
-	*/
-	STOREDATA_RECORD_EXPORT bool procedure();
-
 	STOREDATA_RECORD_EXPORT void check();
 
 	/** @brief Try to push the frame data in a video.
+
+		The frames are copied in the queues of the sources.
+		@return It returns false if the writers are not running or the
+		        frame is before the record_framerate slot.
 	*/
 	STOREDATA_RECORD_EXPORT int push_data_write_not_guarantee_can_replace(
 		const std::map<int, cv::Mat> &frame);
 
-	/** @brief Close the video
+	/** @brief It writes the queued frames, stops the writers and closes the
+	           videos.
 	*/
 	STOREDATA_RECORD_EXPORT void close();
 
@@ -221,16 +307,129 @@ public:
 	STOREDATA_RECORD_EXPORT void set_callback_createfile(
 		cbk_fname_changed callback_createfile);
 
-  private:
+	/** @brief It sets the behavior of the record_framerate limit when the
+	           frames are late (see FramePacer). Default Skip.
 
-	/** @brief Writing thread
+		It is applied by the next setup.
 	*/
-	boost::thread* thr_;
-	boost::mutex mutex_;
+	STOREDATA_RECORD_EXPORT void set_pacing_policy(FramePacerPolicy policy,
+		size_t max_burst);
 
-	/** @brief If TRUE the variable is under writing.
+	/** @brief It returns the counters of the record_framerate limit and the
+	           duration of the writes of the frames.
 	*/
-	bool under_writing_;
+	STOREDATA_RECORD_EXPORT FramePacerStats pacing_stats();
+
+	/** @brief It sets the max number of frames queued for each source
+	           (default 2). It is applied by the next setup.
+	*/
+	STOREDATA_RECORD_EXPORT void set_queue_size(size_t queue_size);
+
+	/** @brief It returns the number of frames replaced before to be
+	           written.
+	*/
+	STOREDATA_RECORD_EXPORT size_t num_replaced();
+
+	/** @brief It sets the resize of the frames (see VideoResizeParams).
+	           The interpolation of the writers is applied by the next
+	           setup.
+	*/
+	STOREDATA_RECORD_EXPORT void set_resize_params(
+		const VideoResizeParams &params);
+
+	/** @brief It returns the number of frames resized because the source
+	           size is different from the video size.
+	*/
+	STOREDATA_RECORD_EXPORT size_t num_resized();
+
+	/** @brief It sets the encoder of the videos (see VideoEncoderParams).
+	           It is applied by the next setup.
+	*/
+	STOREDATA_RECORD_EXPORT void set_encoder_params(
+		const VideoEncoderParams &params);
+
+  private:
+
+	/** @brief Frame waiting to be written
+	*/
+	struct VideoItem
+	{
+		cv::Mat frame;
+		/** @brief Appendix of the video of the frame
+		*/
+		std::shared_ptr<const std::string> appendix;
+	};
+
+	/** @brief Duration of the writes of the frames
+	*/
+	struct WriteDelay
+	{
+		int64_t last_us;
+		int64_t max_us;
+		int64_t total_us;
+		size_t num_writes;
+		/** @brief Time of the last write
+		*/
+		FramePacer::Clock::time_point last_time;
+
+		WriteDelay() : last_us(0), max_us(0), total_us(0), num_writes(0) {}
+
+		void add(FramePacer::Clock::time_point begin,
+			FramePacer::Clock::time_point end) {
+			last_us = std::chrono::duration_cast<std::chrono::microseconds>(
+				end - begin).count();
+			max_us = (std::max)(max_us, last_us);
+			total_us += last_us;
+			++num_writes;
+			last_time = end;
+		}
+
+		void merge(const WriteDelay &other) {
+			if (other.num_writes == 0) return;
+			if (num_writes == 0 || other.last_time > last_time) {
+				last_us = other.last_us;
+				last_time = other.last_time;
+			}
+			max_us = (std::max)(max_us, other.max_us);
+			total_us += other.total_us;
+			num_writes += other.num_writes;
+		}
+	};
+
+	/** @brief Writer of a source
+	*/
+	struct VideoSource
+	{
+		MemorizeVideoManager *video;
+		std::thread thr;
+		/** @brief It guards the members below
+		*/
+		std::mutex mtx;
+		std::condition_variable cond;
+		std::deque<VideoItem> queue;
+		/** @brief Written frames, their buffers are reused
+		*/
+		std::vector<cv::Mat> pool;
+		bool is_running;
+		size_t queue_size;
+		size_t num_replaced;
+		/** @brief Frames resized by the push
+		*/
+		size_t num_resized;
+		/** @brief Duration of the writes
+		*/
+		WriteDelay delay;
+		/** @brief Appendix of the open video (used by the writer only)
+		*/
+		std::shared_ptr<const std::string> appendix;
+
+		VideoSource() : video(nullptr), is_running(false), queue_size(1),
+			num_replaced(0), num_resized(0) {}
+	};
+
+	/** @brief It guards the members below and serializes the push
+	*/
+	std::mutex mutex_;
 
 	// set framerate to record 
 	int record_framerate_;
@@ -240,30 +439,61 @@ public:
 	double height_;
 	int video_framerate_;
 
-	// Create a matrix to keep the retrieved frame
-	std::map<int, cv::Mat> frame_;
+	/** @brief Writers of the sources
+	*/
+	std::map<int, std::unique_ptr<VideoSource> > sources_;
+	size_t queue_size_;
+	VideoResizeParams resize_params_;
+	VideoEncoderParams encoder_params_;
+	/** @brief Sources and frames of the current push (reused)
+	*/
+	std::vector<std::pair<VideoSource*, const cv::Mat*> > push_frames_;
 
-	//vars
-	boost::posix_time::time_duration td_, td1_;
-	boost::posix_time::ptime nextFrameTimestamp_, 
-		currentFrameTimestamp_, initialLoopTimestamp_, finalLoopTimestamp_;
-	int delayFound_;
-	int totalDelay_;
+	/** @brief Appendix of the current videos
+	*/
+	std::shared_ptr<const std::string> appendix_;
+	/** @brief Time of the last appendix and videos created with it
+	*/
+	std::string last_appendix_;
+	int num_same_appendix_;
+	/** @brief Frames pushed in the current videos and max number of frames
+	           of a video (without the meta frame)
+	*/
+	size_t num_frames_;
+	size_t max_frames_;
+	bool has_metaframe_;
 
-	/** @brief Create Video
+	/** @brief Limit of record_framerate_
 	*/
-	std::map<int, MemorizeVideoManager* > video_;
+	FramePacer pacer_;
+	FramePacerPolicy pacing_policy_;
+	size_t pacing_max_burst_;
+	/** @brief Duration of the writes of the closed sources
+	*/
+	WriteDelay closed_delay_;
 
-	/** @brief Count the number of frames that has to be memorized.
-	           It should avoid the use of the mutex.
+	/** @brief Create Video
 	*/
-	//int number_addframe_requests_;
+	std::map<int, MemorizeVideoManager* > video_;
 
 	bool verbose_;
 
 	/** @brief Callback function when a file is created
 	*/
 	cbk_fname_changed callback_createfile_;
+
+	/** @brief Function executed by the writer thread of a source
+	*/
+	void writer_thread(VideoSource *source);
+
+	/** @brief It copies (or resizes) the frame in the queue of the source.
+	*/
+	bool enqueue(VideoSource &source, const cv::Mat &frame);
+
+	/** @brief It returns the appendix of the new files (time). A counter
+	           is added if equal to the previous.
+	*/
+	std::string make_appendix();
 };
 
 } // namespace storedata
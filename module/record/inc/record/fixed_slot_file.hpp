@@ -0,0 +1,165 @@
+/**
+* @file fixed_slot_file.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_RECORD_FIXED_SLOT_FILE_HPP__
+#define STOREDATA_RECORD_FIXED_SLOT_FILE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "opencv2/opencv.hpp"
+
+#include "record_defines.hpp"
+#include "create_base.hpp"
+#include "mapped_file.hpp"
+
+namespace storedata
+{
+
+/** @brief Geometry of a fixed slot file.
+*/
+struct FixedSlotLayout
+{
+	int cols;
+	int rows;
+	/** @brief OpenCV type of the image (i.e. CV_8UC3)
+	*/
+	int type;
+	size_t image_bytes;
+	size_t max_msg_bytes;
+	/** @brief Size of the file header (multiple of the alignment)
+	*/
+	size_t header_bytes;
+	/** @brief Size of each slot (multiple of the alignment)
+	*/
+	size_t stride;
+
+	FixedSlotLayout() : cols(0), rows(0), type(0), image_bytes(0),
+		max_msg_bytes(0), header_bytes(0), stride(0) {}
+};
+
+/** @brief File of uncompressed frames with the same size and type.
+
+	The geometry is written once in the header, then each frame is a slot
+	of the same stride, so frame i is at header_bytes + i * stride.
+
+	Layout (all the integers little endian):
+
+	header: "SDFIXSLT", uint32 version, int32 cols, rows, type, uint64
+	        image bytes, max message bytes, stride, header bytes, zero
+	        padding to header bytes.
+	slot:   int64 timestamp (microseconds since the epoch, never 0), uint64
+	        message size, image, message, zero padding to stride.
+
+	A slot with timestamp 0 is not written (preallocated segment).
+*/
+class FixedSlotFile
+{
+public:
+
+	static const uint32_t kVersion = 1;
+	static const size_t kMagicBytes = 8;
+	static const size_t kSlotHeaderBytes = 8 + 8;
+
+	/** @brief It computes the layout of the frames.
+
+		@param[in] alignment Alignment of the header and of the slots
+		                     (i.e. 4096 for O_DIRECT, 1 for no padding).
+	*/
+	static STOREDATA_RECORD_EXPORT FixedSlotLayout make_layout(int cols,
+		int rows, int type, size_t max_msg_bytes, size_t alignment);
+
+	/** @brief It writes the file header (layout.header_bytes) in out.
+	*/
+	static STOREDATA_RECORD_EXPORT void write_header(
+		const FixedSlotLayout &layout, std::vector<char> &out);
+
+	/** @brief It writes the slot header (kSlotHeaderBytes) in out.
+	*/
+	static STOREDATA_RECORD_EXPORT void write_slot_header(int64_t timestamp_us,
+		uint64_t msg_size, char *out);
+
+	/** @brief It returns true if the file starts with the header magic.
+	*/
+	static STOREDATA_RECORD_EXPORT bool is_fixed_slot_file(
+		const std::string &filename);
+};
+
+/** @brief Reader of a fixed slot file.
+
+	The file is mapped: the open reads only the header and the frames are
+	accessed directly by position.
+
+	@Warning It is not thread safe.
+*/
+class FixedSlotReader
+{
+public:
+
+	STOREDATA_RECORD_EXPORT FixedSlotReader();
+
+	/** @brief It opens the file.
+
+		@return It returns kSuccess, kFileIsNotOpen or kFail if the file is
+		        not a fixed slot file.
+	*/
+	STOREDATA_RECORD_EXPORT int open(const std::string &filename);
+
+	STOREDATA_RECORD_EXPORT void close();
+
+	STOREDATA_RECORD_EXPORT const FixedSlotLayout& layout() const;
+
+	/** @brief It returns the number of written frames.
+	*/
+	STOREDATA_RECORD_EXPORT size_t size() const;
+
+	/** @brief It returns the frame.
+
+		@param[out] image Image that points to the mapping (no copy). It is
+		                  valid while the file is open.
+		@return It returns false if the frame does not exist.
+	*/
+	STOREDATA_RECORD_EXPORT bool frame(size_t index, cv::Mat &image,
+		RecordView &msg, int64_t &timestamp_us) const;
+
+	/** @brief It returns the first frame with timestamp greater or equal to
+	           timestamp_us (binary search). -1 if all the frames are older.
+	*/
+	STOREDATA_RECORD_EXPORT int64_t find_time(int64_t timestamp_us) const;
+
+private:
+
+	MappedFile file_;
+	FixedSlotLayout layout_;
+	size_t num_frames_;
+
+	/** @brief It returns the timestamp of the slot (0 if not written).
+	*/
+	int64_t timestamp(size_t index) const;
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_RECORD_FIXED_SLOT_FILE_HPP__
@@ -0,0 +1,137 @@
+/**
+* @file frame_pacer.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_RECORD_FRAME_PACER_HPP__
+#define STOREDATA_RECORD_FRAME_PACER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+
+#include "record_defines.hpp"
+
+namespace storedata
+{
+
+/** @brief Behavior of the pacer when the frames are late.
+*/
+enum class FramePacerPolicy : int
+{
+	Skip = 0,   // The missed slots are lost, the schedule restarts from now
+	CatchUp = 1 // Up to max_burst frames are admitted back to back
+};
+
+/** @brief Counters of the pacer.
+*/
+struct FramePacerStats
+{
+	/** @brief Frames admitted
+	*/
+	size_t num_frames;
+	/** @brief Frames admitted at least one period after their slot
+	*/
+	size_t num_late;
+	/** @brief Slots lost (Skip policy or beyond max_burst)
+	*/
+	size_t num_skipped;
+	/** @brief Duration of the writes (see record_delay, microseconds)
+	*/
+	int64_t last_delay_us;
+	int64_t max_delay_us;
+	double mean_delay_us;
+
+	FramePacerStats() : num_frames(0), num_late(0), num_skipped(0),
+		last_delay_us(0), max_delay_us(0), mean_delay_us(0) {}
+};
+
+/** @brief Frame rate limiter on the monotonic clock.
+
+	Token bucket in the virtual scheduling form: a frame is admitted when
+	the clock reaches the slot of the next frame, then the slot advances by
+	one period. A late frame restarts the schedule (Skip) or keeps it, so
+	the next frames are admitted without wait until the schedule is
+	recovered (CatchUp, at most max_burst frames including the late one).
+
+	@Warning It is not thread safe.
+*/
+class FramePacer
+{
+public:
+
+	typedef std::chrono::steady_clock Clock;
+
+	STOREDATA_RECORD_EXPORT FramePacer();
+
+	/** @brief It sets the rate and restarts the schedule from now.
+
+		@param[in] framerate Frames per second. 0 or negative disables the
+		                     pacing (all the frames are admitted).
+	*/
+	STOREDATA_RECORD_EXPORT void setup(double framerate,
+		FramePacerPolicy policy = FramePacerPolicy::Skip,
+		size_t max_burst = 1);
+
+	/** @brief It restarts the schedule from now and clears the counters.
+	*/
+	STOREDATA_RECORD_EXPORT void reset();
+
+	STOREDATA_RECORD_EXPORT bool is_enabled() const;
+
+	/** @brief It returns the time when the next frame is admitted.
+	*/
+	STOREDATA_RECORD_EXPORT Clock::time_point next_time() const;
+
+	/** @brief It admits a frame if its slot is reached.
+	*/
+	STOREDATA_RECORD_EXPORT bool try_acquire(Clock::time_point now);
+
+	/** @brief It admits a frame (also before its slot, i.e. at close).
+	*/
+	STOREDATA_RECORD_EXPORT void acquire(Clock::time_point now);
+
+	/** @brief It adds the duration of a write to the statistics.
+	*/
+	STOREDATA_RECORD_EXPORT void record_delay(Clock::duration delay);
+
+	STOREDATA_RECORD_EXPORT FramePacerStats stats() const;
+
+private:
+
+	FramePacerPolicy policy_;
+	size_t max_burst_;
+	/** @brief Period of the frames (zero if disabled)
+	*/
+	Clock::duration period_;
+	/** @brief Slot of the next frame
+	*/
+	Clock::time_point next_;
+	FramePacerStats stats_;
+	/** @brief Sum and number of the recorded delays
+	*/
+	int64_t total_delay_us_;
+	size_t num_delays_;
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_RECORD_FRAME_PACER_HPP__
@@ -0,0 +1,207 @@
+/**
+* @file indexed_file.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_RECORD_INDEXED_FILE_HPP__
+#define STOREDATA_RECORD_INDEXED_FILE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+
+#include "record_defines.hpp"
+#include "create_base.hpp"
+
+namespace storedata
+{
+
+/** @brief Stream recorded in an indexed file.
+*/
+struct IndexedStreamDescriptor
+{
+	uint32_t stream_id;
+	std::string name;
+
+	IndexedStreamDescriptor() : stream_id(0) {}
+	IndexedStreamDescriptor(uint32_t id, const std::string &stream_name) :
+		stream_id(id), name(stream_name) {}
+};
+
+/** @brief Position of a record in an indexed file.
+*/
+struct IndexedFileEntry
+{
+	/** @brief Position of the record header in the file
+	*/
+	uint64_t offset;
+	/** @brief Size of the payload
+	*/
+	uint64_t size;
+	/** @brief Timestamp of the record (microseconds since the epoch)
+	*/
+	int64_t timestamp_us;
+	uint32_t stream_id;
+
+	IndexedFileEntry() : offset(0), size(0), timestamp_us(0), stream_id(0) {}
+};
+
+/** @brief Versioned container format with a footer index.
+
+	Layout (all the integers little endian):
+
+	header:  "SDRECIDX", uint32 version, uint32 number of streams, then for
+	         each stream uint32 stream id, uint32 name size, name.
+	record:  uint32 stream id, int64 timestamp, uint64 size, payload.
+	index:   for each record uint64 offset, uint64 size, int64 timestamp,
+	         uint32 stream id. Written when the file is closed (roll time).
+	trailer: uint64 offset of the index, uint64 number of entries,
+	         "SDRECEND".
+
+	A file without trailer (interrupted recording) is read by scanning the
+	record headers.
+*/
+class IndexedFile
+{
+public:
+
+	static const uint32_t kVersion = 1;
+	static const size_t kMagicBytes = 8;
+	static const size_t kRecordHeaderBytes = 4 + 8 + 8;
+	static const size_t kIndexEntryBytes = 8 + 8 + 8 + 4;
+	static const size_t kTrailerBytes = 8 + 8 + kMagicBytes;
+
+	/** @brief It appends the file header to out.
+	*/
+	static STOREDATA_RECORD_EXPORT void write_header(
+		const std::vector<IndexedStreamDescriptor> &streams,
+		std::vector<char> &out);
+
+	/** @brief It writes the record header in out (kRecordHeaderBytes).
+	*/
+	static STOREDATA_RECORD_EXPORT void write_record_header(uint32_t stream_id,
+		int64_t timestamp_us, uint64_t size, char *out);
+
+	/** @brief It appends the index and the trailer to out.
+
+		@param[in] index_offset Position of the index in the file.
+	*/
+	static STOREDATA_RECORD_EXPORT void write_footer(
+		const std::vector<IndexedFileEntry> &index, uint64_t index_offset,
+		std::vector<char> &out);
+
+	/** @brief It returns true if the file starts with the header magic.
+	*/
+	static STOREDATA_RECORD_EXPORT bool is_indexed_file(
+		const std::string &filename);
+};
+
+/** @brief Reader of an indexed file.
+
+	The open reads only the header and the footer index, so the time does
+	not depend on the payload size. Each record is read on demand.
+
+	@Warning It is not thread safe.
+*/
+class IndexedFileReader
+{
+public:
+
+	STOREDATA_RECORD_EXPORT IndexedFileReader();
+
+	/** @brief It opens the file and loads the index.
+
+		@return It returns kSuccess, kFileIsNotOpen or kFail if the file is
+		        not an indexed file.
+	*/
+	STOREDATA_RECORD_EXPORT int open(const std::string &filename);
+
+	STOREDATA_RECORD_EXPORT void close();
+
+	/** @brief It returns the version of the file format.
+	*/
+	STOREDATA_RECORD_EXPORT uint32_t version() const;
+
+	/** @brief It returns the streams described in the header.
+	*/
+	STOREDATA_RECORD_EXPORT const std::vector<IndexedStreamDescriptor>&
+		streams() const;
+
+	/** @brief It returns the index (records in the file order).
+	*/
+	STOREDATA_RECORD_EXPORT const std::vector<IndexedFileEntry>& entries() const;
+
+	/** @brief It returns the number of records.
+	*/
+	STOREDATA_RECORD_EXPORT size_t size() const;
+
+	/** @brief It returns true if the footer was missing and the index is
+	           rebuilt from the records.
+	*/
+	STOREDATA_RECORD_EXPORT bool recovered() const;
+
+	/** @brief It returns the position in entries of the frame of the stream.
+
+		@return It returns -1 if the frame does not exist.
+	*/
+	STOREDATA_RECORD_EXPORT int64_t find_frame(uint32_t stream_id,
+		size_t frame) const;
+
+	/** @brief It returns the position in entries of the first record with
+	           timestamp greater or equal to timestamp_us (binary search).
+
+		@param[in] stream_id Stream to search. Negative searches all the
+		                     records.
+		@return It returns -1 if all the records are older.
+	*/
+	STOREDATA_RECORD_EXPORT int64_t find_time(int64_t timestamp_us,
+		int64_t stream_id = -1) const;
+
+	/** @brief It reads the payload of the record.
+	*/
+	STOREDATA_RECORD_EXPORT int read(size_t index, std::vector<char> &data);
+
+private:
+
+	std::ifstream fin_;
+	uint32_t version_;
+	std::vector<IndexedStreamDescriptor> streams_;
+	std::vector<IndexedFileEntry> entries_;
+	/** @brief Positions in entries_ of the records of each stream
+	*/
+	std::map<uint32_t, std::vector<size_t> > stream_entries_;
+	bool recovered_;
+
+	/** @brief It loads the footer index. False if it is not valid.
+	*/
+	bool load_footer(uint64_t data_begin, uint64_t file_size);
+
+	/** @brief It rebuilds the index by reading the record headers.
+	*/
+	void scan_records(uint64_t data_begin, uint64_t file_size);
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_RECORD_INDEXED_FILE_HPP__
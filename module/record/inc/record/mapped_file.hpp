@@ -0,0 +1,245 @@
+/**
+* @file mapped_file.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_RECORD_MAPPED_FILE_HPP__
+#define STOREDATA_RECORD_MAPPED_FILE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iterator>
+
+#include "record_defines.hpp"
+#include "create_base.hpp"
+#include "indexed_file.hpp"
+
+namespace storedata
+{
+
+/** @brief View of a memory range (it does not own the data).
+*/
+struct RecordView
+{
+	const char *data;
+	size_t size;
+
+	RecordView() : data(nullptr), size(0) {}
+	RecordView(const char *ptr, size_t len) : data(ptr), size(len) {}
+
+	const uint8_t* bytes() const {
+		return reinterpret_cast<const uint8_t*>(data);
+	}
+};
+
+/** @brief Read only memory mapping of a file.
+
+	The pages are loaded by the operating system when accessed, so the
+	open is immediate and the memory used does not depend on the file size.
+
+	@Warning It is not thread safe.
+*/
+class MappedFile
+{
+public:
+
+	STOREDATA_RECORD_EXPORT MappedFile();
+
+	STOREDATA_RECORD_EXPORT ~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/** @brief It maps the whole file.
+
+		@return It returns kSuccess or kFileIsNotOpen.
+	*/
+	STOREDATA_RECORD_EXPORT int open(const std::string &filename);
+
+	STOREDATA_RECORD_EXPORT void close();
+
+	STOREDATA_RECORD_EXPORT bool is_open() const;
+
+	/** @brief It returns the first byte of the file (nullptr if empty).
+	*/
+	STOREDATA_RECORD_EXPORT const char* data() const;
+
+	STOREDATA_RECORD_EXPORT size_t size() const;
+
+private:
+
+	const char *data_;
+	size_t size_;
+	bool is_open_;
+#ifdef _WIN32
+	void *file_;
+	void *mapping_;
+#else
+	int fd_;
+#endif
+};
+
+/** @brief Mapped file split in chunks of records.
+
+	A raw file is a single chunk. An indexed file (see IndexedFile) has a
+	chunk for each record payload: the index is loaded at open, the
+	payloads are accessed through the mapping.
+*/
+class MappedRecordFile
+{
+public:
+
+	STOREDATA_RECORD_EXPORT MappedRecordFile();
+
+	/** @brief It maps the file and detects its format.
+
+		@return It returns kSuccess, kFileIsNotOpen or kFail if the indexed
+		        file is not valid.
+	*/
+	STOREDATA_RECORD_EXPORT int open(const std::string &filename);
+
+	STOREDATA_RECORD_EXPORT void close();
+
+	/** @brief It returns true if the file is in the indexed format.
+	*/
+	STOREDATA_RECORD_EXPORT bool is_indexed() const;
+
+	/** @brief It returns the number of chunks.
+	*/
+	STOREDATA_RECORD_EXPORT size_t num_chunks() const;
+
+	/** @brief It returns the view of the chunk.
+	*/
+	STOREDATA_RECORD_EXPORT RecordView chunk(size_t index) const;
+
+	/** @brief It returns the index of an indexed file (empty otherwise).
+	*/
+	STOREDATA_RECORD_EXPORT const std::vector<IndexedFileEntry>& entries() const;
+
+private:
+
+	MappedFile file_;
+	bool is_indexed_;
+	std::vector<IndexedFileEntry> entries_;
+};
+
+/** @brief Range of the records of a MappedRecordFile.
+
+	The _Framing splits a chunk in records. It must define
+	static size_t next(const char *data, size_t available, RecordView &view)
+	that returns the bytes used by the record starting at data (0 if the
+	record is truncated) and sets the view returned by the iterator.
+
+	The views point to the mapping: they are valid while the file is open.
+*/
+template <typename _Framing>
+class RecordViews
+{
+public:
+
+	class iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef RecordView value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const RecordView* pointer;
+		typedef const RecordView& reference;
+
+		iterator() : file_(nullptr), chunk_(0), pos_(0), used_(0) {}
+
+		iterator(const MappedRecordFile *file, size_t chunk) :
+			file_(file), chunk_(chunk), pos_(0), used_(0) {
+			find_next();
+		}
+
+		reference operator*() const { return view_; }
+		pointer operator->() const { return &view_; }
+
+		iterator& operator++() {
+			pos_ += used_;
+			find_next();
+			return *this;
+		}
+
+		iterator operator++(int) {
+			iterator tmp = *this;
+			++(*this);
+			return tmp;
+		}
+
+		bool operator==(const iterator &obj) const {
+			return chunk_ == obj.chunk_ && pos_ == obj.pos_;
+		}
+		bool operator!=(const iterator &obj) const {
+			return !(*this == obj);
+		}
+
+		/** @brief It returns the chunk of the current record.
+		*/
+		size_t chunk() const { return chunk_; }
+
+	private:
+
+		const MappedRecordFile *file_;
+		size_t chunk_;
+		/** @brief Position of the current record in the chunk
+		*/
+		size_t pos_;
+		/** @brief Bytes of the current record
+		*/
+		size_t used_;
+		RecordView view_;
+
+		/** @brief It moves to the next complete record (or to the end).
+		*/
+		void find_next() {
+			if (!file_) return;
+			while (chunk_ < file_->num_chunks()) {
+				RecordView chunk = file_->chunk(chunk_);
+				if (pos_ < chunk.size) {
+					used_ = _Framing::next(chunk.data + pos_,
+						chunk.size - pos_, view_);
+					if (used_ > 0) return;
+				}
+				// A truncated record ends the chunk
+				++chunk_;
+				pos_ = 0;
+			}
+		}
+	};
+
+	explicit RecordViews(const MappedRecordFile &file) : file_(&file) {}
+
+	iterator begin() const { return iterator(file_, 0); }
+	iterator end() const { return iterator(nullptr, file_->num_chunks()); }
+
+private:
+
+	const MappedRecordFile *file_;
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_RECORD_MAPPED_FILE_HPP__
@@ -0,0 +1,198 @@
+/**
+* @file packed_archive.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_RECORD_PACKED_ARCHIVE_HPP__
+#define STOREDATA_RECORD_PACKED_ARCHIVE_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+
+#include "record_defines.hpp"
+#include "create_base.hpp"
+
+namespace storedata
+{
+
+/** @brief Entry of a packed archive
+*/
+struct PackedArchiveEntry
+{
+	/** @brief Name of the file (as pushed)
+	*/
+	std::string name;
+	/** @brief Position of the data in the .pack segment
+	*/
+	uint64_t offset;
+	/** @brief Size of the data
+	*/
+	uint64_t size;
+
+	PackedArchiveEntry() : offset(0), size(0) {}
+};
+
+/** @brief Writer of an archive of small files.
+
+	The data of each file is appended to a segment (.pack) and the entry
+	name, offset and size is appended to the index (.idx) with the same
+	name. When the segment exceeds max_segment_bytes a new segment/index
+	pair is started: root + appendix + "_" + sequence + ".pack"/".idx".
+
+	Index format: the magic "SDPKIDX1", then for each entry
+	uint32 name size, name, uint64 offset, uint64 size (little endian).
+	The data is flushed before the index, so an index entry always refers
+	to data present in the segment.
+
+	@Warning It is not thread safe.
+*/
+class PackedArchiveWriter
+{
+public:
+
+	STOREDATA_RECORD_EXPORT PackedArchiveWriter();
+
+	STOREDATA_RECORD_EXPORT ~PackedArchiveWriter();
+
+	/** @brief It sets the archive to create.
+
+		The first segment is created by the first append.
+		@param[in] filename_root Root of the segment names (i.e. data/pack_).
+		@param[in] max_segment_bytes Size that starts a new segment.
+	*/
+	STOREDATA_RECORD_EXPORT void setup(const std::string &filename_root,
+		size_t max_segment_bytes);
+
+	/** @brief It appends a file to the archive.
+
+		@return It returns kSuccess, kFileIsNotOpen if the segment cannot be
+		        created or kFail on write error.
+	*/
+	STOREDATA_RECORD_EXPORT int append(const std::string &name,
+		const void *data, size_t size);
+
+	/** @brief It flushes the segment and then the index.
+	*/
+	STOREDATA_RECORD_EXPORT int flush();
+
+	/** @brief It closes the current segment.
+	*/
+	STOREDATA_RECORD_EXPORT void close();
+
+	/** @brief It returns the index files created (one for each segment).
+	*/
+	STOREDATA_RECORD_EXPORT const std::vector<std::string>& index_files() const;
+
+	/** @brief Magic bytes at the beginning of the index
+	*/
+	static const char* magic();
+
+private:
+
+	std::string filename_root_;
+	size_t max_segment_bytes_;
+	/** @brief Appendix (date/time) of the archive
+	*/
+	std::string appendix_;
+	/** @brief Sequence number of the next segment
+	*/
+	int sequence_;
+	std::ofstream fpack_;
+	std::ofstream fidx_;
+	/** @brief Bytes in the current segment
+	*/
+	uint64_t segment_size_;
+	std::vector<std::string> index_files_;
+
+	/** @brief It opens the next segment/index pair.
+	*/
+	int open_segment();
+};
+
+/** @brief Reader of a segment of a packed archive.
+
+	It loads the index and it recreates the original files on demand.
+	A truncated last entry of the index (interrupted recording) is ignored.
+*/
+class PackedArchiveReader
+{
+public:
+
+	STOREDATA_RECORD_EXPORT PackedArchiveReader();
+
+	/** @brief It opens the index and the segment with the same name.
+
+		@param[in] index_filename File .idx.
+		@return It returns kSuccess, kFileIsNotOpen or kFail if the index is
+		        not valid.
+	*/
+	STOREDATA_RECORD_EXPORT int open(const std::string &index_filename);
+
+	STOREDATA_RECORD_EXPORT void close();
+
+	/** @brief It returns the entries in the archive order.
+	*/
+	STOREDATA_RECORD_EXPORT const std::vector<PackedArchiveEntry>& entries() const;
+
+	/** @brief It returns the position of the entry (the last one with the
+	           name). -1 if not found.
+	*/
+	STOREDATA_RECORD_EXPORT int find(const std::string &name) const;
+
+	/** @brief It reads the data of the entry.
+	*/
+	STOREDATA_RECORD_EXPORT int read(size_t index, std::vector<char> &data);
+	STOREDATA_RECORD_EXPORT int read(const std::string &name,
+		std::vector<char> &data);
+
+	/** @brief It recreates the file of the entry.
+
+		@param[in] output_dir Folder where to create the file (the relative
+		           path of the name is kept). If empty the original name is
+		           used.
+		@return It returns kFail if the name leaves output_dir.
+	*/
+	STOREDATA_RECORD_EXPORT int extract(const std::string &name,
+		const std::string &output_dir);
+
+	/** @brief It recreates all the files.
+
+		@return It returns the number of files created.
+	*/
+	STOREDATA_RECORD_EXPORT size_t extract_all(const std::string &output_dir);
+
+private:
+
+	std::ifstream fpack_;
+	std::vector<PackedArchiveEntry> entries_;
+	std::unordered_map<std::string, size_t> names_;
+
+	/** @brief It writes the data of the entry in output_dir.
+	*/
+	int extract_entry(size_t index, const std::string &output_dir);
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_RECORD_PACKED_ARCHIVE_HPP__
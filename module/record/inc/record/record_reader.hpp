@@ -0,0 +1,285 @@
+/**
+* @file record_reader.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_RECORD_RECORD_READER_HPP__
+#define STOREDATA_RECORD_RECORD_READER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "record_defines.hpp"
+#include "create_base.hpp"
+#include "mapped_file.hpp"
+
+namespace storedata
+{
+
+/** @brief Streaming reader of the records of a file.
+
+	The records are returned one at a time as views of the mapped file
+	(see RecordViews), so the memory used does not depend on the file size.
+	It can be used pull (next, seek) or push (for_each).
+
+	The optional read ahead thread loads the pages of the next records
+	while the current one is processed, so a slow storage does not stall
+	the processing.
+
+	Example:
+	RecordReader<RawRecordFraming> reader;
+	reader.open("record.dat", 16);
+	RecordView record;
+	while (reader.next(record)) { ... }
+
+	@Warning The views are valid until the reader is closed.
+*/
+template <typename _Framing>
+class RecordReader
+{
+public:
+
+	RecordReader() {
+		index_ = 0;
+		read_ahead_ = 0;
+		generation_ = 0;
+		is_running_ = false;
+	}
+
+	~RecordReader() {
+		close();
+	}
+
+	RecordReader(const RecordReader&) = delete;
+	RecordReader& operator=(const RecordReader&) = delete;
+
+	/** @brief It opens the file (raw or indexed).
+
+		@param[in] read_ahead Number of records loaded in background ahead
+		           of the current one. 0 disables the read ahead.
+		@return It returns kSuccess, kFileIsNotOpen or kFail.
+	*/
+	int open(const std::string &filename, size_t read_ahead = 0) {
+		close();
+		int return_status = file_.open(filename);
+		if (return_status != kSuccess) return return_status;
+		RecordViews<_Framing> views(file_);
+		it_ = views.begin();
+		end_ = views.end();
+		index_ = 0;
+		read_ahead_ = read_ahead;
+		if (read_ahead_ > 0) {
+			is_running_ = true;
+			thr_ = std::thread(&RecordReader::read_ahead_thread, this);
+		}
+		return kSuccess;
+	}
+
+	void close() {
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			is_running_ = false;
+		}
+		cv_.notify_all();
+		if (thr_.joinable()) thr_.join();
+		file_.close();
+		it_ = end_ = typename RecordViews<_Framing>::iterator();
+		index_ = 0;
+	}
+
+	/** @brief It returns the next record.
+
+		@param[out] timestamp_us Time of the record (-1 if the file is not
+		                         indexed).
+		@return It returns false at the end of the file.
+	*/
+	bool next(RecordView &record, int64_t &timestamp_us) {
+		std::lock_guard<std::mutex> lock(mtx_);
+		if (it_ == end_) return false;
+		record = *it_;
+		timestamp_us = timestamp(it_.chunk());
+		++it_;
+		++index_;
+		if (read_ahead_ > 0) cv_.notify_one();
+		return true;
+	}
+
+	bool next(RecordView &record) {
+		int64_t timestamp_us = 0;
+		return next(record, timestamp_us);
+	}
+
+	/** @brief It moves to the record.
+
+		In an indexed file each record is a chunk (see MemorizeFileManager),
+		so the position is immediate. In a raw file the previous record
+		headers are read.
+		@return It returns false if the file has less records.
+	*/
+	bool seek(size_t index) {
+		std::lock_guard<std::mutex> lock(mtx_);
+		if (file_.is_indexed()) {
+			size_t chunk = (std::min)(index, file_.num_chunks());
+			it_ = typename RecordViews<_Framing>::iterator(&file_, chunk);
+			index_ = chunk;
+		} else {
+			if (index < index_) {
+				it_ = RecordViews<_Framing>(file_).begin();
+				index_ = 0;
+			}
+			while (index_ < index && it_ != end_) {
+				++it_;
+				++index_;
+			}
+		}
+		++generation_;
+		cv_.notify_one();
+		return index_ == index && it_ != end_;
+	}
+
+	/** @brief It moves to the first record with timestamp greater or equal
+	           to timestamp_us (binary search on the index).
+
+		@return It returns false if the file is not indexed or all the
+		        records are older.
+	*/
+	bool seek_time(int64_t timestamp_us) {
+		if (!file_.is_indexed()) return false;
+		const std::vector<IndexedFileEntry> &entries = file_.entries();
+		auto it = std::lower_bound(entries.begin(), entries.end(),
+			timestamp_us, [](const IndexedFileEntry &e, int64_t t) {
+				return e.timestamp_us < t; });
+		return seek(static_cast<size_t>(it - entries.begin()));
+	}
+
+	/** @brief It calls the callback for each record from the current one.
+
+		@param[in] callback It returns false to stop the reading.
+		@return It returns the number of records read.
+	*/
+	size_t for_each(const std::function<bool(const RecordView &record,
+		int64_t timestamp_us)> &callback) {
+		size_t num_records = 0;
+		RecordView record;
+		int64_t timestamp_us = 0;
+		while (next(record, timestamp_us)) {
+			++num_records;
+			if (!callback(record, timestamp_us)) break;
+		}
+		return num_records;
+	}
+
+	/** @brief It returns the position of the next record.
+	*/
+	size_t position() {
+		std::lock_guard<std::mutex> lock(mtx_);
+		return index_;
+	}
+
+	/** @brief It returns the file (i.e. the index of an indexed file).
+	*/
+	const MappedRecordFile& file() const {
+		return file_;
+	}
+
+private:
+
+	/** @brief Size of the memory page touched by the read ahead
+	*/
+	static const size_t kPageBytes = 4096;
+
+	MappedRecordFile file_;
+	/** @brief Current record and end of the file
+	*/
+	typename RecordViews<_Framing>::iterator it_, end_;
+	/** @brief Position of the current record
+	*/
+	size_t index_;
+	/** @brief Max number of records read ahead
+	*/
+	size_t read_ahead_;
+	/** @brief It changes at each seek (the read ahead restarts)
+	*/
+	size_t generation_;
+	bool is_running_;
+	std::thread thr_;
+	std::mutex mtx_;
+	std::condition_variable cv_;
+
+	int64_t timestamp(size_t chunk) const {
+		if (!file_.is_indexed()) return -1;
+		return file_.entries()[chunk].timestamp_us;
+	}
+
+	/** @brief It loads the pages of the record in memory.
+	*/
+	static void touch(const RecordView &record) {
+		volatile char value = 0;
+		for (size_t i = 0; i < record.size; i += kPageBytes) {
+			value = value + record.data[i];
+		}
+		if (record.size > 0) value = value + record.data[record.size - 1];
+	}
+
+	/** @brief It reads the records ahead of the current one.
+	*/
+	void read_ahead_thread() {
+		typename RecordViews<_Framing>::iterator ahead;
+		size_t ahead_index = 0, generation = 0;
+		bool is_valid = false;
+		std::unique_lock<std::mutex> lock(mtx_);
+		while (is_running_) {
+			// Restart from the current record after a seek or if the reader
+			// is faster
+			if (!is_valid || generation != generation_ ||
+				ahead_index < index_) {
+				ahead = it_;
+				ahead_index = index_;
+				generation = generation_;
+				is_valid = true;
+			}
+			if (ahead == end_ || ahead_index >= index_ + read_ahead_) {
+				cv_.wait(lock);
+				continue;
+			}
+			// The mapping is read only: the pages are loaded without lock
+			lock.unlock();
+			touch(*ahead);
+			++ahead;
+			lock.lock();
+			++ahead_index;
+		}
+	}
+};
+
+template <typename _Framing>
+const size_t RecordReader<_Framing>::kPageBytes;
+
+} // namespace storedata
+
+#endif // STOREDATA_RECORD_RECORD_READER_HPP__
@@ -57,7 +57,19 @@ struct STOREDATA_RECORD_EXPORT RecordContainerData
 {
 	void* data;
 	size_t size_bytes;
-	RecordContainerData() : data(nullptr) {}
+	/** @brief Reference counted image set with assignFrom (zero copy)
+	*/
+	cv::Mat holder;
+	RecordContainerData() : data(nullptr), size_bytes(0) {}
+	/** @brief It keeps a reference to the image without copying the pixels.
+	           A not continuous image is copied.
+	*/
+	void assignFrom(const cv::Mat &img) {
+		if (data) dispose();
+		holder = img.isContinuous() ? img : img.clone();
+		size_bytes = holder.total() * holder.elemSize();
+		data = holder.data;
+	}
 	void copyFrom(const void* src, size_t src_size_bytes) {
 		if (data) dispose();
 		size_bytes = src_size_bytes;
@@ -71,6 +83,7 @@ struct STOREDATA_RECORD_EXPORT RecordContainerData
 		memcpy(data, obj.data, obj.size_bytes);
 	}
 	void dispose() {
+		if (!holder.empty()) { holder.release(); data = nullptr; }
 		if (data) { free(data); data = nullptr; }
 	}
 };
@@ -84,6 +97,8 @@ public:
 
 	STOREDATA_RECORD_EXPORT RecordContainerBase() {};
 
+	STOREDATA_RECORD_EXPORT virtual ~RecordContainerBase() {};
+
 	/** @brief It push a new frame to save
 	*/
 	STOREDATA_RECORD_EXPORT virtual void push(
@@ -107,6 +122,12 @@ public:
 	*/
 	STOREDATA_RECORD_EXPORT virtual void stop() = 0;
 
+	/** @brief It processes the queued data, then it stops and joins the 
+	           thread before the deadline.
+	*/
+	STOREDATA_RECORD_EXPORT virtual bool drain_and_join(
+		std::chrono::steady_clock::time_point deadline) = 0;
+
 	/** @brief Thread used to save the current container of images
 	*/
 	STOREDATA_RECORD_EXPORT virtual void internal_thread() = 0;
@@ -31,12 +31,15 @@
 #include <thread>             // std::thread, std::this_thread::yield
 #include <mutex>              // std::mutex, std::unique_lock
 #include <condition_variable> // std::condition_variable
+#include <atomic>
 
 #include <opencv2/opencv.hpp>
 
 #include "buffer/buffer_headers.hpp"
 #include "logger/inc/logger/log.hpp"
 #include "recordcontainerbase.hpp"
+#include "async_write_backend.hpp"
+#include "packed_archive.hpp"
 
 #include "record_defines.hpp"
 
@@ -84,7 +87,9 @@ namespace storedata
 	However, due to the lock and time to copy the data, events that happen
 	in real-time are not guarantee to be recorded.
 
-	@Important This class saves a file for each pushed data!
+	@Important This class saves a file for each pushed data! With the
+	packed mode the data is appended to an archive (see PackedArchiveWriter)
+	and the files are recreated with PackedArchiveReader.
 */
 class RecordContainerFile : public RecordContainerBase
 {
@@ -93,6 +98,10 @@ public:
 
 	STOREDATA_RECORD_EXPORT RecordContainerFile();
 
+	/** @brief It stops and joins the internal thread.
+	*/
+	STOREDATA_RECORD_EXPORT ~RecordContainerFile();
+
 	/** @brief It push a new frame to save
 	*/
 	STOREDATA_RECORD_EXPORT void push(
@@ -116,6 +125,16 @@ public:
 	*/
 	STOREDATA_RECORD_EXPORT void stop();
 
+	/** @brief It processes the queued data, then it stops and joins the 
+	           internal thread.
+
+		@param[in] deadline Maximum time to wait. If expired, the thread
+		           stops after the current data and it is not joined.
+		@return It returns true if the thread is joined before the deadline.
+	*/
+	STOREDATA_RECORD_EXPORT bool drain_and_join(
+		std::chrono::steady_clock::time_point deadline);
+
 	/** @brief It stops the thread and try to close the files.
 
 		If it succeeded to stop the thread, it closes the file.
@@ -128,9 +147,41 @@ public:
 
 	/** @brief It sets the save boosting. If true it use multiple threads to
 	save.
+
+		Each file is written by one of max_threads workers. When it is
+		disabled, the workers are stopped after the files under writing.
 	*/
 	STOREDATA_RECORD_EXPORT void set_save_boost(bool save_boost);
 
+	/** @brief It sets the maximum number of threads used with the save
+	           boosting. It is applied at the next pool start.
+	*/
+	STOREDATA_RECORD_EXPORT void set_max_threads(int max_threads);
+
+	/** @brief It sets the asynchronous backend used to write the files.
+
+		The file is opened by the caller thread and the write is submitted
+		to the backend. The file is closed and the data disposed when the
+		write is completed. The internal thread waits the writes in flight
+		before to quit. Nullptr restores the synchronous fwrite.
+	*/
+	STOREDATA_RECORD_EXPORT void set_write_backend(
+		std::shared_ptr<AsyncWriteBackend> backend);
+
+	/** @brief It sets the packed mode.
+
+		If packed, the pushed data is appended to the segments of an archive
+		instead of creating a file for each data. The name of the pushed
+		data is stored in the index of the archive. A new segment is started
+		when the size exceeds max_segment_bytes. The archive is closed when
+		the internal thread quits.
+		@param[in] packed If true the packed mode is used.
+		@param[in] archive_root Root of the segment names.
+		@param[in] max_segment_bytes Maximum size of a segment.
+	*/
+	STOREDATA_RECORD_EXPORT void set_packed_mode(bool packed,
+		const std::string &archive_root, size_t max_segment_bytes);
+
 	/** @brief It returns the about size of the writing queue
 	*/
 	STOREDATA_RECORD_EXPORT size_t size_about();
@@ -143,18 +194,19 @@ public:
 	*/
 	STOREDATA_RECORD_EXPORT bool is_running();
 
-	/** @brief Since the internal thread is detached, it is necessary to 
-	           wait until is not ready.
+	/** @brief It waits until the internal thread is not running.
 
-		The function try to stop for n iterations and wait m ms.
+		The maximum wait is num_iterations * sleep_ms milliseconds (see
+		wait_deadline).
 		@return It returns true in case of success. False otherwise.
 	*/
 	STOREDATA_RECORD_EXPORT bool wait_until_is_not_ready(size_t num_iterations, int sleep_ms);
 
-	/** @brief Since the internal thread is detached, it is necessary to
-		   wait until is not ready.
+	/** @brief It waits until all the queued data is processed (or the
+	           internal thread is not running).
 
-		The function try to stop for n iterations and wait m ms.
+		The maximum wait is num_iterations * sleep_ms milliseconds (see
+		wait_deadline).
 		@return It returns true in case of success. False otherwise.
 	*/
 	STOREDATA_RECORD_EXPORT bool wait_until_buffer_is_empty(size_t num_iterations, int sleep_ms);
@@ -170,10 +222,6 @@ private:
 	/** @brief Var used to the condition variable
 	*/
 	bool data_ready_ = false;
-	/** @brief Number of threads that are writing (it does not include the
-	class internal thread)
-	*/
-	int num_threads_;
 	/** @brief Maximum numbers of threads that can be run (except the
 	internal thread)
 	*/
@@ -182,13 +230,27 @@ private:
 	/** @brief If true it creates as many threads as possible
 	*/
 	bool save_boost_;
+	/** @brief Threads used to write the files with the save boosting
+	*/
+	CallbackWorkerPool worker_pool_;
 
 	/** @brief If true it continues to save the data
 	*/
-	bool continue_save_;
+	std::atomic<bool> continue_save_;
 	/** @brief If true is running the internal thread
 	*/
-	bool is_running_;
+	std::atomic<bool> is_running_;
+	/** @brief If true the internal thread processes all the queued data
+	           before to quit
+	*/
+	std::atomic<bool> drain_on_stop_;
+	/** @brief Internal thread
+	*/
+	std::thread thread_;
+	/** @brief Notified when the internal thread quits or the queued data
+	           is processed (see notify_if_empty)
+	*/
+	std::condition_variable cond_state_;
 
 	/** @brief Container with the data to save
 	*/
@@ -201,6 +263,32 @@ private:
 	           microbuffer.
 	*/
 	size_t num_elems_microbuffer_approx_;
+
+	/** @brief Asynchronous writes (nullptr not used)
+	*/
+	std::shared_ptr<AsyncWriteBackend> backend_;
+	/** @brief Writes submitted to backend_ and not completed
+	*/
+	size_t backend_pending_;
+	std::condition_variable cond_backend_;
+
+	/** @brief If true the data is appended to archive_
+	*/
+	std::atomic<bool> packed_mode_;
+	/** @brief Archive of the packed mode
+	*/
+	PackedArchiveWriter archive_;
+	/** @brief The archive is written by the workers of the save boosting
+	*/
+	std::mutex mtx_archive_;
+
+	/** @brief It writes the data in a file and dispose it
+	*/
+	void write_file(std::pair<std::string, RecordContainerData> &tuple);
+
+	/** @brief It notifies cond_state_ if there is no data to process.
+	*/
+	void notify_if_empty();
 };
 
 } // namespace storedata
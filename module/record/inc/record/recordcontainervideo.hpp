@@ -31,6 +31,7 @@
 #include <thread>             // std::thread, std::this_thread::yield
 #include <mutex>              // std::mutex, std::unique_lock
 #include <condition_variable> // std::condition_variable
+#include <atomic>
 
 #include <opencv2/opencv.hpp>
 
@@ -70,6 +71,10 @@ public:
 
 	STOREDATA_RECORD_EXPORT RecordContainerVideo();
 
+	/** @brief It stops and joins the internal thread.
+	*/
+	STOREDATA_RECORD_EXPORT ~RecordContainerVideo();
+
 	/** @brief It push a new container data.
 
 		@param[in] do_use_max_size_buffer If true, it defines that it will be
@@ -97,6 +102,16 @@ public:
 	*/
 	STOREDATA_RECORD_EXPORT void stop();
 
+	/** @brief It processes the queued data, then it stops and joins the 
+	           internal thread.
+
+		@param[in] deadline Maximum time to wait. If expired, the thread
+		           stops after the current data and it is not joined.
+		@return It returns true if the thread is joined before the deadline.
+	*/
+	STOREDATA_RECORD_EXPORT bool drain_and_join(
+		std::chrono::steady_clock::time_point deadline);
+
 	/** @brief It stops the thread and try to close the files.
 
 		If it succeeded to stop the thread, it closes the file.
@@ -109,6 +124,10 @@ public:
 
 	/** @brief It sets the save boosting. If true it use multiple threads to
 	save.
+
+		It has no effect: all the frames go to the same cv::VideoWriter, 
+		which requires them in order. The encoder threads are managed by
+		the video backend.
 	*/
 	STOREDATA_RECORD_EXPORT void set_save_boost(bool save_boost);
 
@@ -124,18 +143,19 @@ public:
 	*/
 	STOREDATA_RECORD_EXPORT bool is_running();
 
-	/** @brief Since the internal thread is detached, it is necessary to 
-	           wait until is not ready.
+	/** @brief It waits until the internal thread is not running.
 
-		The function try to stop for n iterations and wait m ms.
+		The maximum wait is num_iterations * sleep_ms milliseconds (see
+		wait_deadline).
 		@return It returns true in case of success. False otherwise.
 	*/
 	STOREDATA_RECORD_EXPORT bool wait_until_is_not_ready(size_t num_iterations, int sleep_ms);
 
-	/** @brief Since the internal thread is detached, it is necessary to
-		   wait until is not ready.
+	/** @brief It waits until all the queued data is processed (or the
+	           internal thread is not running).
 
-		The function try to stop for n iterations and wait m ms.
+		The maximum wait is num_iterations * sleep_ms milliseconds (see
+		wait_deadline).
 		@return It returns true in case of success. False otherwise.
 	*/
 	STOREDATA_RECORD_EXPORT bool wait_until_buffer_is_empty(size_t num_iterations, int sleep_ms);
@@ -159,10 +179,6 @@ private:
 	/** @brief Var used to the condition variable
 	*/
 	bool data_ready_ = false;
-	/** @brief Number of threads that are writing (it does not include the
-	class internal thread)
-	*/
-	int num_threads_;
 	/** @brief Maximum numbers of threads that can be run (except the
 	internal thread)
 	*/
@@ -174,10 +190,21 @@ private:
 
 	/** @brief If true it continues to save the data
 	*/
-	bool continue_save_;
+	std::atomic<bool> continue_save_;
 	/** @brief If true is running the internal thread
 	*/
-	bool is_running_;
+	std::atomic<bool> is_running_;
+	/** @brief If true the internal thread processes all the queued data
+	           before to quit
+	*/
+	std::atomic<bool> drain_on_stop_;
+	/** @brief Internal thread
+	*/
+	std::thread thread_;
+	/** @brief Notified when the internal thread quits or the queued data
+	           is processed (see notify_if_empty)
+	*/
+	std::condition_variable cond_state_;
 
 	/** @brief Container with the data to save and a message associated
 	*/
@@ -205,6 +232,10 @@ private:
 
 	void filevideo_push_frame(cv::VideoWriter &vw, const std::string &fname,
 		cv::Mat &img);
+
+	/** @brief It notifies cond_state_ if there is no data to process.
+	*/
+	void notify_if_empty();
 };
 
 
@@ -0,0 +1,244 @@
+/**
+* @file replay_engine.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_RECORD_REPLAY_ENGINE_HPP__
+#define STOREDATA_RECORD_REPLAY_ENGINE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "opencv2/opencv.hpp"
+
+#include "record_defines.hpp"
+#include "create_base.hpp"
+
+namespace storedata
+{
+
+/** @brief Format of the files of a replayed stream.
+*/
+enum class ReplayStreamType : int
+{
+	Raw = 0,    // RawRecorder files (data)
+	Player = 1, // PlayerRecorder files (image and message)
+	Video = 2   // Video files (image)
+};
+
+/** @brief Speed of the replay.
+*/
+enum class ReplayRateMode : int
+{
+	AsFastAsPossible = 0, // No wait between the records
+	RealTime = 1,         // Records spaced as recorded
+	Scaled = 2            // Records spaced as recorded, divided by speed
+};
+
+/** @brief Parameters of a replayed stream.
+*/
+struct ReplayStreamParams
+{
+	/** @brief Identifier returned with each record of the stream
+	*/
+	int stream_id;
+	ReplayStreamType type;
+	/** @brief Segments of the stream (see ReplayEngine::find_segments)
+	*/
+	std::vector<std::string> files;
+	/** @brief Frame rate used to time the records of the files without
+	           timestamps. 0 uses the video frame rate (30 for the other
+	           files).
+	*/
+	double fps;
+
+	ReplayStreamParams() : stream_id(0), type(ReplayStreamType::Raw),
+		fps(30) {}
+};
+
+/** @brief Record of the merged replay.
+*/
+struct ReplayRecord
+{
+	int stream_id;
+	/** @brief Time of the record (microseconds since the epoch)
+	*/
+	int64_t timestamp_us;
+	/** @brief Position of the record in its stream
+	*/
+	size_t index;
+	/** @brief Data (Raw) or message (Player)
+	*/
+	std::vector<char> data;
+	/** @brief Image (Player, Video)
+	*/
+	cv::Mat image;
+
+	ReplayRecord() : stream_id(0), timestamp_us(0), index(0) {}
+};
+
+/** @brief Replay of many streams, each recorded in many segments.
+
+	Each stream is decoded by its own thread in a bounded queue. next
+	returns the records of all the streams merged in order of time
+	(k-way merge of the queue heads), paced by the rate mode.
+
+	The time of a record is the one stored in the indexed files (see
+	IndexedFile). For the other files it is the time in the file name
+	(see find_segments for the 12-hour names) plus the position over fps.
+
+	Example:
+	ReplayEngine engine;
+	engine.add_stream(params_camera);
+	engine.add_stream(params_data);
+	engine.set_rate(ReplayRateMode::Scaled, 4.0);
+	engine.start();
+	ReplayRecord record;
+	while (engine.next(record)) { ... }
+
+	@Warning next must be called by one thread.
+*/
+class ReplayEngine
+{
+public:
+
+	STOREDATA_RECORD_EXPORT ReplayEngine();
+
+	STOREDATA_RECORD_EXPORT ~ReplayEngine();
+
+	ReplayEngine(const ReplayEngine&) = delete;
+	ReplayEngine& operator=(const ReplayEngine&) = delete;
+
+	/** @brief It returns the segments recorded with the filename root, in
+	           order of time.
+
+		i.e. find_segments("data/record_", ".dat") returns
+		data/record_<time2string>.dat
+		The hour in the names is 12-hour (01-12): AM or PM is selected with
+		the first record time of the indexed and fixed-slot files, else with
+		the modification time of the file. The modification time must be
+		kept when these segments are copied (i.e. cp -p).
+	*/
+	static STOREDATA_RECORD_EXPORT std::vector<std::string> find_segments(
+		const std::string &filename_root,
+		const std::string &dot_extension);
+
+	/** @brief It adds a stream. It must be called before start.
+	*/
+	STOREDATA_RECORD_EXPORT void add_stream(const ReplayStreamParams &params);
+
+	/** @brief It sets the replay speed.
+
+		@param[in] speed Multiplier of the Scaled mode (i.e. 2 is 2x).
+	*/
+	STOREDATA_RECORD_EXPORT void set_rate(ReplayRateMode mode,
+		double speed = 1.0);
+
+	/** @brief It sets the max number of records decoded ahead per stream.
+	*/
+	STOREDATA_RECORD_EXPORT void set_queue_size(size_t queue_size);
+
+	/** @brief It starts the decoding threads.
+
+		@return It returns kSuccess or kFail if there are no streams.
+	*/
+	STOREDATA_RECORD_EXPORT int start();
+
+	/** @brief It returns the oldest record of all the streams.
+
+		It waits for the decoding and for the replay time.
+		@return It returns false when all the streams ended or stop.
+	*/
+	STOREDATA_RECORD_EXPORT bool next(ReplayRecord &record);
+
+	/** @brief It calls the callback for each merged record.
+
+		@param[in] callback It returns false to stop the replay.
+		@return It returns the number of records replayed.
+	*/
+	STOREDATA_RECORD_EXPORT size_t run(
+		const std::function<bool(const ReplayRecord &record)> &callback);
+
+	/** @brief It stops the decoding threads.
+	*/
+	STOREDATA_RECORD_EXPORT void stop();
+
+private:
+
+	/** @brief Decoding state of a stream
+	*/
+	struct Stream
+	{
+		ReplayStreamParams params;
+		std::deque<ReplayRecord> queue;
+		bool is_finished;
+		std::thread thr;
+
+		Stream() : is_finished(false) {}
+	};
+
+	std::vector<std::unique_ptr<Stream> > streams_;
+	ReplayRateMode rate_mode_;
+	double speed_;
+	size_t queue_size_;
+	bool is_running_;
+	std::mutex mtx_;
+	/** @brief Notified when a record is decoded (or a stream ends)
+	*/
+	std::condition_variable cv_data_;
+	/** @brief Notified when a record is taken
+	*/
+	std::condition_variable cv_space_;
+	/** @brief Time of the first replayed record and when it was returned
+	*/
+	int64_t first_timestamp_us_;
+	std::chrono::steady_clock::time_point first_time_;
+
+	/** @brief It decodes the segments of the stream.
+	*/
+	void decode_thread(Stream *stream);
+
+	/** @brief It decodes a segment. False if the replay stopped.
+	*/
+	bool decode_file(Stream *stream, const std::string &filename,
+		size_t &index, int64_t &timestamp_us);
+
+	/** @brief It queues the record. False if the replay stopped.
+	*/
+	bool push(Stream *stream, ReplayRecord &&record);
+
+	/** @brief It waits for the replay time of the record.
+	*/
+	void pace(int64_t timestamp_us);
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_RECORD_REPLAY_ENGINE_HPP__
@@ -0,0 +1,208 @@
+/**
+* @file segment_writer.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_RECORD_SEGMENT_WRITER_HPP__
+#define STOREDATA_RECORD_SEGMENT_WRITER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "record_defines.hpp"
+#include "create_base.hpp"
+#include "async_write_backend.hpp"
+
+namespace storedata
+{
+
+/** @brief Writer of a file segment with a known maximum size.
+
+	The segment is preallocated (fallocate) to the expected size, so the
+	file is not fragmented while it grows. The data is combined in an
+	aligned buffer and written with pwrite at explicit offsets. With
+	direct_io the file is opened with O_DIRECT and the data bypasses the
+	page cache (if the file system refuses O_DIRECT, the buffered mode is
+	used). On close the file is truncated to the written size.
+
+	With an AsyncWriteBackend the first write takes a free buffer of the
+	backend and the full buffer is submitted (the backend releases it after
+	the write). If no buffer is free within kAcquireTimeoutMs the writer uses
+	its own buffer, written synchronously, until close. The partial block, sync and close
+	wait for the submitted writes.
+
+	On the systems without pwrite the writer falls back on std::ofstream.
+
+	@Warning It is not thread safe.
+*/
+class SegmentWriter
+{
+public:
+
+	/** @brief Alignment of the buffer, of the offsets and of the lengths
+	           written with O_DIRECT.
+	*/
+	static const size_t kAlignment = 4096;
+
+	/** @brief Maximum wait (ms) for a free buffer of the backend.
+	*/
+	static const int kAcquireTimeoutMs = 100;
+
+	STOREDATA_RECORD_EXPORT SegmentWriter();
+
+	STOREDATA_RECORD_EXPORT ~SegmentWriter();
+
+	/** @brief It opens the segment.
+
+		@param[in] filename Name of the file.
+		@param[in] preallocate_bytes Size reserved on disk (0 none).
+		@param[in] direct_io If true the page cache is bypassed.
+		@param[in] append If true the data is added after the current content.
+		@param[in] buffer_bytes Size of the aligned buffer (rounded up to
+		                        kAlignment). With a backend the size of its
+		                        buffers is used.
+		@return It returns kSuccess, kFail if already open or on error.
+	*/
+	STOREDATA_RECORD_EXPORT int open(const std::string &filename,
+		size_t preallocate_bytes, bool direct_io, bool append,
+		size_t buffer_bytes = 4 * 1024 * 1024);
+
+	/** @brief It adds the data to the segment.
+
+		@return It returns kSuccess, kFileIsNotOpen or kFail on error.
+	*/
+	STOREDATA_RECORD_EXPORT int write(const char *data, size_t size);
+
+	/** @brief It writes the buffered data (the partial block is padded and
+	           written again by the next flush).
+	*/
+	STOREDATA_RECORD_EXPORT int flush();
+
+	/** @brief It writes the buffered data and waits until it is on disk.
+	*/
+	STOREDATA_RECORD_EXPORT int sync();
+
+	/** @brief It writes the buffered data, truncates the file to the written
+	           size and closes it.
+	*/
+	STOREDATA_RECORD_EXPORT int close();
+
+	/** @brief It returns true if the segment is open.
+	*/
+	STOREDATA_RECORD_EXPORT bool is_open() const;
+
+	/** @brief It returns the bytes in the segment (written and buffered).
+	*/
+	STOREDATA_RECORD_EXPORT size_t size() const;
+
+	/** @brief It returns true if the page cache is bypassed.
+	*/
+	STOREDATA_RECORD_EXPORT bool direct_io() const;
+
+	/** @brief It sets the backend used by the next open (nullptr for the
+	           synchronous pwrite).
+	*/
+	STOREDATA_RECORD_EXPORT void set_backend(
+		std::shared_ptr<AsyncWriteBackend> backend);
+
+private:
+
+	/** @brief File descriptor (-1 if closed)
+	*/
+	int fd_;
+	/** @brief Fallback stream
+	*/
+	std::ofstream fout_;
+	/** @brief True if O_DIRECT is active
+	*/
+	bool direct_io_;
+	/** @brief Aligned buffer
+	*/
+	char *buffer_;
+	size_t buffer_capacity_;
+	/** @brief Bytes in the buffer
+	*/
+	size_t buffer_used_;
+	/** @brief Offset in the file of the first byte of the buffer (aligned)
+	*/
+	uint64_t file_offset_;
+
+	/** @brief Asynchronous writes (nullptr not used)
+	*/
+	std::shared_ptr<AsyncWriteBackend> backend_;
+	/** @brief Backend buffer in use (-1 own buffer or no buffer)
+	*/
+	int buffer_index_;
+	/** @brief Writes submitted to the backend and not completed
+	*/
+	size_t pending_writes_;
+	std::mutex mtx_pending_;
+	std::condition_variable cond_pending_;
+	/** @brief True if a submitted write failed
+	*/
+	std::atomic<bool> write_error_;
+
+	/** @brief It submits the full buffer to the backend. The buffer is
+	           given to the backend.
+	*/
+	int submit_buffer();
+
+	/** @brief It takes a buffer of the backend (or its own buffer if none is
+	           free) if the writer does not have one.
+	*/
+	int ensure_buffer();
+
+	/** @brief It allocates the aligned buffer of the writer.
+	*/
+	int alloc_own_buffer();
+
+	/** @brief It reads the partial block at file_offset_ in the buffer.
+	*/
+	int reload_tail();
+
+	/** @brief It waits the writes submitted to the backend.
+	*/
+	int wait_pending();
+
+	/** @brief It writes the full blocks of the buffer. If include_tail the
+	           partial block is written padded (it stays in the buffer).
+	*/
+	int flush_buffer(bool include_tail);
+
+	/** @brief It writes the whole length at offset (it retries the short
+	           writes).
+	*/
+	int write_at(const char *data, size_t size, uint64_t offset);
+
+	/** @brief It releases the buffer.
+	*/
+	void free_buffer();
+};
+
+} // namespace storedata
+
+#endif // STOREDATA_RECORD_SEGMENT_WRITER_HPP__
@@ -24,6 +24,7 @@
 #define STOREDATA_CORE_STOREDATATIME_HPP__
 
 #include <string>
+#include <cstdint>
 // Include Boost headers for system time and threading
 #include "boost/date_time/posix_time/posix_time.hpp"
 
@@ -45,6 +46,21 @@ public:
 	/** @brief Get the time in a string format
 	*/
 	static STOREDATA_RECORD_EXPORT std::string time2string();
+
+	/** @brief Get the current time in microseconds since the epoch
+	*/
+	static STOREDATA_RECORD_EXPORT int64_t timestamp_us();
+
+	/** @brief Get the time of a string created by time2string (local time)
+
+		The hour is read as 0-23, so AM/PM of the 12-hour hour written by
+		time2string (01-12) is not resolved (see ReplayEngine).
+
+		@return It returns the microseconds since the epoch or -1 if the
+		        string is not valid.
+	*/
+	static STOREDATA_RECORD_EXPORT int64_t string2timestamp_us(
+		const std::string &str);
 };
 
 } // storedata
@@ -0,0 +1,140 @@
+/**
+* @file video_encoder.hpp
+* @brief Header of the defined class
+*
+* @section LICENSE
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+* THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* @original author Alessandro Moro <alessandromoro.italy@gmail.com>
+* @bug No known bugs.
+* @version 0.1.0.0
+*
+*/
+
+#ifndef STOREDATA_RECORD_VIDEO_ENCODER_HPP__
+#define STOREDATA_RECORD_VIDEO_ENCODER_HPP__
+
+#include <memory>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "record_defines.hpp"
+#include "create_base.hpp"
+
+namespace storedata
+{
+
+/** @brief Parameters of the video encoder.
+*/
+struct VideoEncoderParams
+{
+	/** @brief Codec of the video (i.e. DIVX)
+	*/
+	int fourcc;
+	/** @brief Extension of the files. Empty for .avi.
+	*/
+	std::string dot_extension;
+
+	VideoEncoderParams() :
+#if CV_MAJOR_VERSION == 4
+		fourcc(cv::VideoWriter::fourcc('D', 'I', 'V', 'X'))
+#else
+		fourcc(CV_FOURCC('D', 'I', 'V', 'X'))
+#endif
+	{}
+};
+
+/** @brief Interface of the encoders used by MemorizeVideoManager.
+
+	@Warning It is not thread safe.
+*/
+class VideoEncoder
+{
+public:
+
+	STOREDATA_RECORD_EXPORT virtual ~VideoEncoder();
+
+	/** @brief It opens the video file.
+
+		@param[in] filename Name of the file (with the extension).
+		@param[in] size Size of the frames.
+		@param[in] framerate Frames per second.
+		@return It returns kSuccess, kFail if already open or on error.
+	*/
+	STOREDATA_RECORD_EXPORT virtual int open(const std::string &filename,
+		const cv::Size &size, double framerate) = 0;
+
+	/** @brief It returns true if the video is open.
+	*/
+	STOREDATA_RECORD_EXPORT virtual bool is_open() const = 0;
+
+	/** @brief It encodes a BGR image of the size of the video.
+
+		@return It returns kSuccess, kFileIsNotOpen or kFail on error.
+	*/
+	STOREDATA_RECORD_EXPORT virtual int write(const cv::Mat &image) = 0;
+
+	/** @brief It writes the delayed frames and closes the video.
+	*/
+	STOREDATA_RECORD_EXPORT virtual void release() = 0;
+
+	/** @brief It returns the extension of the files (i.e. .avi).
+	*/
+	STOREDATA_RECORD_EXPORT virtual std::string dot_extension() const = 0;
+
+	/** @brief It returns the name of the implementation.
+	*/
+	STOREDATA_RECORD_EXPORT virtual const char* name() const = 0;
+};
+
+/** @brief Encoder based on cv::VideoWriter.
+*/
+class VideoEncoderOpenCV : public VideoEncoder
+{
+public:
+
+	STOREDATA_RECORD_EXPORT VideoEncoderOpenCV(
+		const VideoEncoderParams &params);
+
+	STOREDATA_RECORD_EXPORT ~VideoEncoderOpenCV();
+
+	STOREDATA_RECORD_EXPORT int open(const std::string &filename,
+		const cv::Size &size, double framerate) override;
+
+	STOREDATA_RECORD_EXPORT bool is_open() const override;
+
+	STOREDATA_RECORD_EXPORT int write(const cv::Mat &image) override;
+
+	STOREDATA_RECORD_EXPORT void release() override;
+
+	STOREDATA_RECORD_EXPORT std::string dot_extension() const override;
+
+	STOREDATA_RECORD_EXPORT const char* name() const override;
+
+private:
+
+	VideoEncoderParams params_;
+	cv::VideoWriter video_;
+};
+
+/** @brief It creates the encoder selected by params.
+
+	@return It returns the encoder.
+*/
+STOREDATA_RECORD_EXPORT std::unique_ptr<VideoEncoder> create_video_encoder(
+	const VideoEncoderParams &params);
+
+} // namespace storedata
+
+#endif // STOREDATA_RECORD_VIDEO_ENCODER_HPP__
@@ -27,10 +27,15 @@
 #include "record/inc/record/lib_configuration.hpp"
 #include "record/inc/record/create_file.hpp"
 #include "record/inc/record/create_video.hpp"
+#include "record/inc/record/fixed_slot_file.hpp"
+#include "record/inc/record/frame_pacer.hpp"
 #include "record/inc/record/PlayerRecorder.hpp"
 #include "record/inc/record/RawRecorder.hpp"
+#include "record/inc/record/record_reader.hpp"
+#include "record/inc/record/replay_engine.hpp"
 #include "record/inc/record/recordcontainerfile.hpp"
 #include "record/inc/record/recordcontainervideo.hpp"
 #include "record/inc/record/storedata_time.hpp"
+#include "record/inc/record/video_encoder.hpp"
 
 #endif // STOREDATA_RECORD_RECORD_HEADERS_HPP__
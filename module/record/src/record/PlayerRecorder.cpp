@@ -25,6 +25,8 @@
 namespace storedata
 {
 
+const size_t PlayerRecordFraming::kHeaderBytes;
+
 // ----------------------------------------------------------------------------
 void PlayerRecorder::setup_file(
 	const std::string &filename,
@@ -67,69 +69,8 @@ void PlayerRecorder::setup_metaframe(cv::Mat &meta_frame) {
 }
 // ----------------------------------------------------------------------------
 bool PlayerRecorder::record_file(cv::Mat &curr, bool encoded, std::string &msg) {
-
-	if (fgm_.under_writing()) return false;
-
-	// Container with the buffer data of the encoded image.
-	std::vector< std::vector< uchar > > v_buffer_;
-
-	int codified = 0;
-	size_t size_img_data = curr.cols * curr.rows * curr.channels();
-	uchar *data = curr.data;
-	if (curr.empty()) size_img_data = 0;
-
-	// Encode the source image
-	if (encoded && !curr.empty()) {
-		codified = 1;
-		std::vector<int> params(2);
-#if CV_MAJOR_VERSION == 4
-		params[0] = cv::IMWRITE_JPEG_QUALITY;
-#else
-		params[0] = CV_IMWRITE_JPEG_QUALITY;
-#endif
-		params[1] = 100;//CV_IMWRITE_JPEG_QUALITY;
-		v_buffer_.clear();
-		v_buffer_.push_back( std::vector<uchar>() );
-		cv::imencode(".jpg", curr, v_buffer_[ v_buffer_.size() - 1 ], params);
-		// Image data size
-		size_img_data = v_buffer_[ v_buffer_.size() - 1 ].size(); 
-		data = &v_buffer_[ v_buffer_.size() - 1 ][0];
-	}
-
-	// Add the information to transmit
-	size_t size_msg_data = msg.size();
-	std::vector<char> info_to_transmit(size_msg_data);
-	memcpy(&info_to_transmit[0], &msg[0], size_msg_data);
-
-	// Prepare the container for the data to transmit
-	std::map<int, std::vector<char> > m_data;
-	// The size of the data header.
-	int imagedatasize_bytes = sizeof(int) * 4 + sizeof(size_t) * 2; // IT MUST BE SAME LATER
-								  // Cols, Rows, Channels, Data size, Message size
-	m_data[0] = std::vector<char>(size_img_data + size_msg_data +
-		imagedatasize_bytes);
-
-	// Copy the data
-	int channels = curr.channels();
-	size_t byte_header_size = 0;
-	memcpy(&m_data[0][byte_header_size], &codified, sizeof(int));
-	byte_header_size += sizeof(int);
-	memcpy(&m_data[0][byte_header_size], &curr.cols, sizeof(int));
-	byte_header_size += sizeof(int);
-	memcpy(&m_data[0][byte_header_size], &curr.rows, sizeof(int));
-	byte_header_size += sizeof(int);
-	memcpy(&m_data[0][byte_header_size], &channels, sizeof(int));
-	byte_header_size += sizeof(int);
-	memcpy(&m_data[0][byte_header_size], &size_img_data, sizeof(size_t));
-	byte_header_size += sizeof(size_t);
-	memcpy(&m_data[0][byte_header_size], &size_msg_data, sizeof(size_t));
-	byte_header_size += sizeof(size_t);
-	memcpy(&m_data[0][byte_header_size], data, size_img_data);
-	byte_header_size += size_img_data;
-	memcpy(&m_data[0][byte_header_size], &info_to_transmit[0],
-		size_msg_data);
-	if (!fgm_.push_data_write_not_guarantee_can_replace(m_data)) { return false; }
-	return true;
+	return record_file(curr, encoded,
+		reinterpret_cast<unsigned char*>(&msg[0]), msg.size());
 }
 // ----------------------------------------------------------------------------
 bool PlayerRecorder::record_file(
@@ -137,20 +78,11 @@ bool PlayerRecorder::record_file(
 	bool encoded, 
 	unsigned char *msg, 
 	size_t msg_size) {
-
-	if (fgm_.under_writing()) return false;
-
-	// Container with the buffer data of the encoded image.
-	std::vector< std::vector< uchar > > v_buffer_;
-
-	int codified = 0;
-	size_t size_img_data = curr.cols * curr.rows * curr.channels();
-	uchar *data = curr.data;
-	if (curr.empty()) size_img_data = 0;
-
-	// Encode the source image
-	if (encoded && !curr.empty()) {
-		codified = 1;
+	if (fixed_slot_.stride > 0) return push_slot(curr, msg, msg_size);
+	bool codified = encoded && !curr.empty();
+	// The buffer of the encoded image is reused
+	std::lock_guard<std::mutex> lock(mtx_encode_);
+	if (codified) {
 		std::vector<int> params(2);
 #if CV_MAJOR_VERSION == 4
 		params[0] = cv::IMWRITE_JPEG_QUALITY;
@@ -158,48 +90,95 @@ bool PlayerRecorder::record_file(
 		params[0] = CV_IMWRITE_JPEG_QUALITY;
 #endif
 		params[1] = 100;//CV_IMWRITE_JPEG_QUALITY;
-		v_buffer_.clear();
-		v_buffer_.push_back(std::vector<uchar>());
-		cv::imencode(".jpg", curr, v_buffer_[v_buffer_.size() - 1], params);
-		// Image data size
-		size_img_data = v_buffer_[v_buffer_.size() - 1].size();
-		data = &v_buffer_[v_buffer_.size() - 1][0];
+		if (!cv::imencode(".jpg", curr, encode_buffer_, params)) return false;
 	}
+	return push_frame(curr, codified, encode_buffer_, msg, msg_size);
+}
+// ----------------------------------------------------------------------------
+bool PlayerRecorder::push_frame(const cv::Mat &image, bool encoded,
+	const std::vector<uchar> &buffer, const void *msg, size_t msg_size) {
+	// The raw image must be a single block of memory
+	cv::Mat raw = image;
+	if (!encoded && !raw.empty() && !raw.isContinuous()) raw = image.clone();
 
-	// Add the information to transmit
-	size_t size_msg_data = msg_size;
-	std::vector<char> info_to_transmit(size_msg_data);
-	memcpy(&info_to_transmit[0], &msg[0], size_msg_data);
-
-	// Prepare the container for the data to transmit
-	std::map<int, std::vector<char> > m_data;
-	// The size of the data header.
-	int imagedatasize_bytes = sizeof(int) * 4 + sizeof(size_t) * 2; // IT MUST BE SAME LATER
-								  // Cols, Rows, Channels, Data size, Message size
-	m_data[0] = std::vector<char>(size_img_data + size_msg_data +
-		imagedatasize_bytes);
+	int codified = encoded ? 1 : 0;
+	int cols = image.cols, rows = image.rows, channels = image.channels();
+	size_t size_img_data = 0;
+	const void *img_data = nullptr;
+	if (encoded) {
+		size_img_data = buffer.size();
+		img_data = buffer.data();
+	} else if (!raw.empty()) {
+		size_img_data = static_cast<size_t>(cols) * rows * channels;
+		img_data = raw.data;
+	}
 
-	// Copy the data
-	int channels = curr.channels();
+	// Cols, Rows, Channels, Data size, Message size (see
+	// PlayerRecordFraming)
+	char header[PlayerRecordFraming::kHeaderBytes];
 	size_t byte_header_size = 0;
-	memcpy(&m_data[0][byte_header_size], &codified, sizeof(int));
+	memcpy(&header[byte_header_size], &codified, sizeof(int));
 	byte_header_size += sizeof(int);
-	memcpy(&m_data[0][byte_header_size], &curr.cols, sizeof(int));
+	memcpy(&header[byte_header_size], &cols, sizeof(int));
 	byte_header_size += sizeof(int);
-	memcpy(&m_data[0][byte_header_size], &curr.rows, sizeof(int));
+	memcpy(&header[byte_header_size], &rows, sizeof(int));
 	byte_header_size += sizeof(int);
-	memcpy(&m_data[0][byte_header_size], &channels, sizeof(int));
+	memcpy(&header[byte_header_size], &channels, sizeof(int));
 	byte_header_size += sizeof(int);
-	memcpy(&m_data[0][byte_header_size], &size_img_data, sizeof(size_t));
-	byte_header_size += sizeof(size_t);
-	memcpy(&m_data[0][byte_header_size], &size_msg_data, sizeof(size_t));
+	memcpy(&header[byte_header_size], &size_img_data, sizeof(size_t));
 	byte_header_size += sizeof(size_t);
-	memcpy(&m_data[0][byte_header_size], data, size_img_data);
-	byte_header_size += size_img_data;
-	memcpy(&m_data[0][byte_header_size], &info_to_transmit[0],
-		size_msg_data);
-	if (!fgm_.push_data_write_not_guarantee_can_replace(m_data)) { return false; }
-	return true;
+	memcpy(&header[byte_header_size], &msg_size, sizeof(size_t));
+
+	RecordSlice slices[3] = { RecordSlice(header, sizeof(header)),
+		RecordSlice(img_data, size_img_data), RecordSlice(msg, msg_size) };
+	return fgm_.push_gather(0, slices, 3, false) == kSuccess;
+}
+// ----------------------------------------------------------------------------
+bool PlayerRecorder::push_slot(const cv::Mat &image, const void *msg,
+	size_t msg_size) {
+	if (image.cols != fixed_slot_.cols || image.rows != fixed_slot_.rows ||
+		image.type() != fixed_slot_.type ||
+		msg_size > fixed_slot_.max_msg_bytes) {
+		return false;
+	}
+	cv::Mat raw = image;
+	if (!raw.isContinuous()) raw = image.clone();
+
+	// The time is clamped, so find_time works if the clock steps back
+	last_slot_timestamp_us_ = (std::max)(last_slot_timestamp_us_,
+		DateTime::timestamp_us());
+	char header[FixedSlotFile::kSlotHeaderBytes];
+	FixedSlotFile::write_slot_header(last_slot_timestamp_us_, msg_size,
+		header);
+	size_t padding = fixed_slot_.stride - sizeof(header) -
+		fixed_slot_.image_bytes - msg_size;
+	RecordSlice slices[4] = { RecordSlice(header, sizeof(header)),
+		RecordSlice(raw.data, fixed_slot_.image_bytes),
+		RecordSlice(msg, msg_size),
+		RecordSlice(slot_padding_.data(), padding) };
+	return fgm_.push_gather(0, slices, 4, false) == kSuccess;
+}
+// ----------------------------------------------------------------------------
+void PlayerRecorder::set_fixed_slot_mode(int cols, int rows, int type,
+	size_t max_msg_bytes, size_t alignment) {
+	std::vector<char> header;
+	if (cols <= 0 || rows <= 0) {
+		fixed_slot_ = FixedSlotLayout();
+		slot_padding_.clear();
+		fgm_.set_file_header(0, header);
+		return;
+	}
+	fixed_slot_ = FixedSlotFile::make_layout(cols, rows, type, max_msg_bytes,
+		alignment);
+	slot_padding_.assign(fixed_slot_.stride - FixedSlotFile::kSlotHeaderBytes -
+		fixed_slot_.image_bytes, 0);
+	FixedSlotFile::write_header(fixed_slot_, header);
+	fgm_.set_indexed_format(false);
+	fgm_.set_file_header(0, header);
+}
+// ----------------------------------------------------------------------------
+void PlayerRecorder::set_indexed_format(bool indexed) {
+	fgm_.set_indexed_format(indexed);
 }
 // ----------------------------------------------------------------------------
 void PlayerRecorder::record_video(std::map<int, cv::Mat> &sources) {
@@ -208,38 +187,14 @@ void PlayerRecorder::record_video(std::map<int, cv::Mat> &sources) {
 // ----------------------------------------------------------------------------
 void PlayerRecorder::read_file(const std::string &filename, int FPS) {
 	int _FPS = (std::max)(1, FPS);
-	// Read the data
-	bool bPlayRecord = true;
-	std::ifstream file(filename.c_str(),
-		std::ios::in | std::ios::binary | std::ios::ate);
-	int size = 0;
-	char *memblock = nullptr;
-	std::vector< std::pair<cv::Mat, std::vector<char> > > img_info;
-	if (file.is_open())
-	{
-		size = file.tellg();
-		memblock = new char[size];
-		file.seekg(0, std::ios::beg);
-		file.read(memblock, size);
-		file.close();
-		data2data_type(memblock, size, img_info);
-		delete[] memblock;
-	}
-
-#if _MSC_VER && !__INTEL_COMPILER && (_MSC_VER > 1600)
-	for (auto it = img_info.begin(); it != img_info.end(); it++)
-#else
-	for (std::vector< std::pair<cv::Mat, std::vector<char> > >::const_iterator it = img_info.begin(); it != img_info.end(); it++)
-#endif		
-	{
+	// The frames are decoded one at a time (any format)
+	for_each_frame(filename, [&](const cv::Mat &image,
+		const std::vector<char> &message) {
 		// show the image
-		if (!it->first.empty()) cv::imshow("record", it->first);
+		if (!image.empty()) cv::imshow("record", image);
 		// show the text result
-		char msg[2048];
-		for (int i = 0; i < it->second.size(); i++)
-			msg[i] = it->second[i];
-		msg[it->second.size()] = '\0';
-		std::cout << "msg[" << it->second.size() << "]: " << msg << std::endl;
+		std::cout << "msg[" << message.size() << "]: " <<
+			std::string(message.begin(), message.end()) << std::endl;
 
 		//// specialized
 		//memcpy(msg, &(it->second[0]), 384);
@@ -249,55 +204,32 @@ void PlayerRecorder::read_file(const std::string &filename, int FPS) {
 		//msg[it->second.size() - 384] = '\0';
 		//std::cout << "msg[" << it->second.size() << "]: " << msg << std::endl;
 		cv::waitKey(1000 / _FPS);
-	}
+		return true;
+	});
 }
 // ----------------------------------------------------------------------------
 void PlayerRecorder::unpack(
 	const std::string &filename, int FPS,
 	const std::string &path, unsigned int &index_start) {
 	int _FPS = (std::max)(1, FPS);
-	// Read the data
-	bool bPlayRecord = true;
-	std::ifstream file(filename.c_str(),
-		std::ios::in | std::ios::binary | std::ios::ate);
-	int size = 0;
-	char *memblock = nullptr;
-	std::vector< std::pair<cv::Mat, std::vector<char> > > img_info;
-	if (file.is_open())
-	{
-		size = file.tellg();
-		memblock = new char[size];
-		file.seekg(0, std::ios::beg);
-		file.read(memblock, size);
-		file.close();
-		data2data_type(memblock, size, img_info);
-		delete[] memblock;
-	}
-
 	// save the data from this index
 	unsigned int index_start_internal = index_start;
 
-#if _MSC_VER && !__INTEL_COMPILER && (_MSC_VER > 1600)
-	for (auto it = img_info.begin(); it != img_info.end(); it++)
-#else
-	for (std::vector< std::pair<cv::Mat, std::vector<char> > >::const_iterator it = img_info.begin(); it != img_info.end(); it++)
-#endif		
-	{
+	// The frames are decoded one at a time (any format)
+	for_each_frame(filename, [&](const cv::Mat &image,
+		const std::vector<char> &message) {
 		// show the image
-		if (!it->first.empty()) {
-			cv::imshow("record", it->first);
-			cv::imwrite(path + "\\" + std::to_string(index_start_internal) + ".jpg", it->first);
+		if (!image.empty()) {
+			cv::imshow("record", image);
+			cv::imwrite(path + "\\" + std::to_string(index_start_internal) + ".jpg", image);
 		}
 		// show the text result
-		char msg[2048];
-		for (int i = 0; i < it->second.size(); i++)
-			msg[i] = it->second[i];
-		msg[it->second.size()] = '\0';
-		std::cout << "msg[" << it->second.size() << "]: " << msg << std::endl;
+		std::cout << "msg[" << message.size() << "]: " <<
+			std::string(message.begin(), message.end()) << std::endl;
 
 		// save the message
 		std::ofstream fout(path + "\\" + std::to_string(index_start_internal) + ".txt", std::ios::binary);
-		fout.write(&it->second[0], it->second.size());
+		fout.write(message.data(), message.size());
 		fout.flush();
 
 		//// specialized
@@ -310,54 +242,95 @@ void PlayerRecorder::unpack(
 		cv::waitKey(1000 / _FPS);
 		// increment the counter
 		++index_start_internal;
-	}
+		return true;
+	});
 }
 // ----------------------------------------------------------------------------
-void PlayerRecorder::data2data_type(char *data, int maxsize, 
-	std::vector< std::pair<cv::Mat, std::vector<char> > > &out)
-{
-	const int sizeofinfo = sizeof(int) * 4 + sizeof(size_t) * 2; // Expected 
-	                            // information about the size
-								// of the image
-	int pos = 0;
-	while (pos < maxsize) {
-		std::cout << "read: " << pos << " " << maxsize << std::endl;
-		// Get the image size
-		char imginfo[sizeofinfo];
-		if (pos + sizeofinfo < maxsize) {
-			memcpy(imginfo, &data[pos], sizeofinfo);
+size_t PlayerRecorder::for_each_frame(const std::string &filename,
+	const std::function<bool(const cv::Mat &image,
+		const std::vector<char> &msg)> &callback,
+	size_t read_ahead) {
+	cv::Mat image;
+	std::vector<char> message;
+	size_t num_frames = 0;
+	// The fixed slots are read directly from the mapping
+	if (FixedSlotFile::is_fixed_slot_file(filename)) {
+		FixedSlotReader slots;
+		if (slots.open(filename) != kSuccess) return 0;
+		RecordView msg;
+		int64_t timestamp_us = 0;
+		for (size_t i = 0; i < slots.size(); ++i) {
+			if (!slots.frame(i, image, msg, timestamp_us)) continue;
+			message.assign(msg.data, msg.data + msg.size);
+			++num_frames;
+			if (!callback(image, message)) break;
 		}
-		int codified = 0, cols = 0, rows = 0, channels = 0;
-		size_t imgsize = 0, msgsize = 0;
-		size_t byte_header_size = 0;
-		memcpy(&codified, &imginfo[byte_header_size], sizeof(int));
-		memcpy(&cols, &imginfo[byte_header_size], sizeof(int));
-		memcpy(&rows, &imginfo[byte_header_size], sizeof(int));
-		memcpy(&channels, &imginfo[byte_header_size], sizeof(int));
-		memcpy(&imgsize, &imginfo[byte_header_size], sizeof(size_t));
-		memcpy(&msgsize, &imginfo[byte_header_size], sizeof(size_t));
-		if (pos + sizeofinfo + imgsize + msgsize < maxsize)
-		{
-			cv::Mat m;
-			if (codified == 0) {
-				int ch = channels == 3 ? CV_8UC3 : CV_8U;
-				m = cv::Mat::zeros(rows, cols, ch);
-				memcpy(m.data, &data[pos + sizeofinfo], imgsize);
-			} else if (codified == 1) {
-				std::vector< uchar > data_tmp(imgsize);
-				memcpy(&data_tmp[0], &data[pos + sizeofinfo], imgsize);
-				int flags = channels == 3 ? 1 : 0;
-				m = cv::imdecode(data_tmp, flags);
-			}
-			std::vector< uchar > msg_tmp(msgsize);
-			memcpy(&msg_tmp[0], &data[pos + sizeofinfo + imgsize], msgsize);
-			std::vector<char> v(msgsize);
-			for (int i = 0; i < msgsize; i++)
-				v[i] = msg_tmp[i];
-			out.push_back(std::make_pair(m, v));
+		return num_frames;
+	}
+
+	RecordReader<PlayerRecordFraming> reader;
+	if (reader.open(filename, read_ahead) != kSuccess) return 0;
+	reader.for_each([&](const RecordView &record, int64_t timestamp_us) {
+		if (!decode_frame(record, image, message)) return true;
+		++num_frames;
+		return callback(image, message);
+	});
+	return num_frames;
+}
+// ----------------------------------------------------------------------------
+bool PlayerRecorder::decode_frame(const RecordView &frame, cv::Mat &image,
+	std::vector<char> &msg) {
+	int codified = 0, cols = 0, rows = 0, channels = 0;
+	size_t imgsize = 0, msgsize = 0;
+	if (frame.size < PlayerRecordFraming::kHeaderBytes) return false;
+	size_t byte_header_size = 0;
+	memcpy(&codified, &frame.data[byte_header_size], sizeof(int));
+	byte_header_size += sizeof(int);
+	memcpy(&cols, &frame.data[byte_header_size], sizeof(int));
+	byte_header_size += sizeof(int);
+	memcpy(&rows, &frame.data[byte_header_size], sizeof(int));
+	byte_header_size += sizeof(int);
+	memcpy(&channels, &frame.data[byte_header_size], sizeof(int));
+	byte_header_size += sizeof(int);
+	memcpy(&imgsize, &frame.data[byte_header_size], sizeof(size_t));
+	byte_header_size += sizeof(size_t);
+	memcpy(&msgsize, &frame.data[byte_header_size], sizeof(size_t));
+	byte_header_size += sizeof(size_t);
+	if (imgsize + msgsize > frame.size - byte_header_size) return false;
+
+	const char *img_data = frame.data + byte_header_size;
+	image.release();
+	if (codified == 0) {
+		if (channels < 1 || channels > CV_CN_MAX || rows < 0 || cols < 0 ||
+			static_cast<size_t>(rows) * cols * channels != imgsize) {
+			return false;
 		}
-		pos += sizeofinfo + imgsize + msgsize;
+		image.create(rows, cols, CV_MAKETYPE(CV_8U, channels));
+		if (imgsize > 0) memcpy(image.data, img_data, imgsize);
+	} else if (codified == 1) {
+		// The encoded image is decoded from the mapping
+		cv::Mat encoded(1, static_cast<int>(imgsize), CV_8U,
+			const_cast<char*>(img_data));
+		int flags = channels == 3 ? 1 : 0;
+		image = cv::imdecode(encoded, flags);
+	}
+	msg.assign(img_data + imgsize, img_data + imgsize + msgsize);
+	return true;
+}
+// ----------------------------------------------------------------------------
+size_t PlayerRecordFraming::next(const char *data, size_t available,
+	RecordView &view) {
+	if (available < kHeaderBytes) return 0;
+	size_t imgsize = 0, msgsize = 0;
+	memcpy(&imgsize, data + sizeof(int) * 4, sizeof(size_t));
+	memcpy(&msgsize, data + sizeof(int) * 4 + sizeof(size_t), sizeof(size_t));
+	// The last frame ends at available
+	if (imgsize > available - kHeaderBytes ||
+		msgsize > available - kHeaderBytes - imgsize) {
+		return 0;
 	}
+	view = RecordView(data, kHeaderBytes + imgsize + msgsize);
+	return view.size;
 }
 // ----------------------------------------------------------------------------
 void PlayerRecorder::set_callback_createfile(
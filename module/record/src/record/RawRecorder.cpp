@@ -26,7 +26,9 @@ namespace storedata
 {
 
 // ----------------------------------------------------------------------------
-RawRecorder::RawRecorder() {}
+RawRecorder::RawRecorder() {
+	guarantee_delivery_ = false;
+}
 // ----------------------------------------------------------------------------
 RawRecorder::~RawRecorder() {
 	fgm_.close();
@@ -44,156 +46,78 @@ void RawRecorder::setup(
 	fgm_.setup(max_memory_allocable, fgp_, record_framerate);
 }
 // ----------------------------------------------------------------------------
+void RawRecorder::set_guarantee_delivery(bool guarantee_delivery,
+	const FileQueueParams &queue_params) {
+	fgm_.set_queue_params(queue_params);
+	guarantee_delivery_ = guarantee_delivery;
+}
+// ----------------------------------------------------------------------------
+void RawRecorder::set_segment_writer(bool use_segment, bool direct_io) {
+	fgm_.set_segment_writer(use_segment, direct_io);
+}
+// ----------------------------------------------------------------------------
+void RawRecorder::set_write_backend(
+	std::shared_ptr<AsyncWriteBackend> backend) {
+	fgm_.set_write_backend(backend);
+}
+// ----------------------------------------------------------------------------
+void RawRecorder::set_indexed_format(bool indexed) {
+	fgm_.set_indexed_format(indexed);
+}
+// ----------------------------------------------------------------------------
+bool RawRecorder::push(const void *data, size_t len) {
+	// [size][data] copied once in the writer buffer
+	RecordSlice slices[2] = { RecordSlice(&len, sizeof(size_t)),
+		RecordSlice(data, len) };
+	return fgm_.push_gather(0, slices, 2, guarantee_delivery_) == kSuccess;
+}
+// ----------------------------------------------------------------------------
 bool RawRecorder::record(uint8_t* data, size_t len) {
-	if (fgm_.under_writing()) return false;
-	// Add the information to transmit
-	size_t size_msg_data = len;
-	std::vector<char> info_to_transmit(size_msg_data);
-	memcpy(&info_to_transmit[0], data, size_msg_data);
-
-	// Prepare the container for the data to transmit
-	std::map<int, std::vector<char> > m_data;
-	m_data[0] = std::vector<char>(size_msg_data + sizeof(size_t));
-
-	// Copy the data
-	memcpy(&m_data[0][0], &size_msg_data, sizeof(size_t));
-	memcpy(&m_data[0][sizeof(size_t)], &info_to_transmit[0],
-		size_msg_data);
-	if (!fgm_.push_data_write_not_guarantee_can_replace(m_data)) { return false; }
-	return true;
+	return push(data, len);
 }
 // ----------------------------------------------------------------------------
 bool RawRecorder::record(void* data, size_t len) {
-	return record(data, len);
+	return push(data, len);
 }
 // ----------------------------------------------------------------------------
 bool RawRecorder::record(const void* data, size_t len) {
-	if (fgm_.under_writing()) return false;
-	// Add the information to transmit
-	size_t size_msg_data = len;
-	std::vector<char> info_to_transmit(size_msg_data);
-	memcpy(&info_to_transmit[0], data, size_msg_data);
-
-	// Prepare the container for the data to transmit
-	std::map<int, std::vector<char> > m_data;
-	m_data[0] = std::vector<char>(size_msg_data + sizeof(size_t));
-
-	// Copy the data
-	memcpy(&m_data[0][0], &size_msg_data, sizeof(size_t));
-	memcpy(&m_data[0][sizeof(size_t)], &info_to_transmit[0],
-		size_msg_data);
-	if (!fgm_.push_data_write_not_guarantee_can_replace(m_data)) { return false; }
-	return true;
+	return push(data, len);
 }
 // ----------------------------------------------------------------------------
 bool RawRecorder::record(const std::vector<uint8_t> &data) {
-	if (fgm_.under_writing()) return false;
-	// Add the information to transmit
-	size_t size_msg_data = data.size();
-	std::vector<char> info_to_transmit(size_msg_data);
-	memcpy(&info_to_transmit[0], &data[0], size_msg_data);
-
-	// Prepare the container for the data to transmit
-	std::map<int, std::vector<char> > m_data;
-	m_data[0] = std::vector<char>(size_msg_data + sizeof(size_t));
-
-	// Copy the data
-	memcpy(&m_data[0][0], &size_msg_data, sizeof(size_t));
-	memcpy(&m_data[0][sizeof(size_t)], &info_to_transmit[0],
-		size_msg_data);
-	if (!fgm_.push_data_write_not_guarantee_can_replace(m_data)) { return false; }
-	return true;
+	return push(data.data(), data.size());
 }
 // ----------------------------------------------------------------------------
 bool RawRecorder::record(const std::string &msg) {
-	if (fgm_.under_writing()) return false;
-	// Add the information to transmit
-	size_t size_msg_data = msg.size();
-	std::vector<char> info_to_transmit(size_msg_data);
-	memcpy(&info_to_transmit[0], &msg[0], size_msg_data);
-
-	// Prepare the container for the data to transmit
-	std::map<int, std::vector<char> > m_data;
-	m_data[0] = std::vector<char>(size_msg_data + sizeof(size_t));
-
-	// Copy the data
-	memcpy(&m_data[0][0], &size_msg_data, sizeof(size_t));
-	memcpy(&m_data[0][sizeof(size_t)], &info_to_transmit[0],
-		size_msg_data);
-	if (!fgm_.push_data_write_not_guarantee_can_replace(m_data)) { return false; }
-	return true;
+	return push(msg.data(), msg.size());
 }
 // ----------------------------------------------------------------------------
 template <typename _Ty>
 bool RawRecorder::record_t(_Ty data, size_t len) {
-	if (fgm_.under_writing()) return false;
-	// Add the information to transmit
-	size_t size_msg_data = len;
-	std::vector<char> info_to_transmit(size_msg_data);
-	memcpy(&info_to_transmit[0], data, size_msg_data);
-
-	// Prepare the container for the data to transmit
-	std::map<int, std::vector<char> > m_data;
-	m_data[0] = std::vector<char>(size_msg_data + sizeof(size_t));
-
-	// Copy the data
-	memcpy(&m_data[0][0], &size_msg_data, sizeof(size_t));
-	memcpy(&m_data[0][sizeof(size_t)], &info_to_transmit[0],
-		size_msg_data);
-	if (!fgm_.push_data_write_not_guarantee_can_replace(m_data)) { return false; }
-	return true;
+	return push(data, len);
 }
 // ----------------------------------------------------------------------------
 void RawRecorder::read_all_raw(const std::string &filename, int FPS) {
 	std::cout << "RawRecorder::read_all_raw:" << filename << std::endl;
 	int _FPS = (std::max)(1, FPS);
-	std::ifstream file(filename.c_str(),
-		std::ios::in | std::ios::binary | std::ios::ate);
-	int size = 0;
-	char *memblock = nullptr;
-	std::vector< std::vector<uint8_t> > data_info;
-	if (file.is_open())
+	// The records are printed from the mapping, one at a time
+	MappedRecordFile file;
+	if (file.open(filename) != kSuccess) return;
+	for (const RecordView &it : RecordViews<RawRecordFraming>(file))
 	{
-		size = file.tellg();
-		memblock = new char[size];
-		file.seekg(0, std::ios::beg);
-		file.read(memblock, size);
-		file.close();
-		data2data_type(memblock, size, data_info);
-		delete[] memblock;
-	}
-
-//#if _MSC_VER && !__INTEL_COMPILER && (_MSC_VER > 1600)
-	for (auto it = data_info.begin(); it != data_info.end(); it++)
-//#else
-	//for (std::vector< std::vector<char> >::const_iterator it = data_info.begin(); it != data_info.end(); it++)
-//#endif		
-	{
-		char msg[1024];
-		for (int i = 0; i < it->size(); i++)
-			msg[i] = (*it)[i];
-		msg[it->size()] = '\0';
-		std::cout << "msg: " << msg << std::endl;
+		std::cout << "msg: " << std::string(it.data, it.size) << std::endl;
 	}
 }	
 // ----------------------------------------------------------------------------
 void RawRecorder::read(const std::string &filename,
 	std::vector< std::vector<uint8_t> > &data_info) {
 
-	// Read the data
-	std::ifstream file(filename.c_str(),
-		std::ios::in | std::ios::binary | std::ios::ate);
-	int size = 0;
-	char *memblock = nullptr;
-	if (file.is_open())
-	{
-		size = file.tellg();
-		memblock = new char[size];
-		file.seekg(0, std::ios::beg);
-		file.read(memblock, size);
-		file.close();
-		data2data_type(memblock, size, data_info);
-		delete[] memblock;
+	// Read the data (raw or indexed)
+	MappedRecordFile file;
+	if (file.open(filename) != kSuccess) return;
+	for (const RecordView &it : RecordViews<RawRecordFraming>(file)) {
+		data_info.push_back(std::vector<uint8_t>(it.bytes(),
+			it.bytes() + it.size));
 	}
 }
 // ----------------------------------------------------------------------------
@@ -201,26 +125,13 @@ void RawRecorder::read_all_raw_compressed(const std::string &filename, int FPS)
 	int _FPS = (std::max)(1, FPS);
 	// Read the data
 	bool bPlayRecord = true;
-	std::ifstream file(filename.c_str(),
-		std::ios::in | std::ios::binary | std::ios::ate);
-	int size = 0;
-	char *memblock = nullptr;
 	// it extracts all the objects pushed in the record
 	// the data size information is dropped and it is
 	// possible to extract from the vector size.
-	std::vector< std::vector<uint8_t> > data_info;
-	if (file.is_open())
-	{
-		size = file.tellg();
-		memblock = new char[size];
-		file.seekg(0, std::ios::beg);
-		file.read(memblock, size);
-		file.close();
-		data2data_type(memblock, size, data_info);
-		delete[] memblock;
-	}
-
-	std::cout << "Found: " << data_info.size() << " frames" << std::endl;
+	// The records are views of the mapping (not copied).
+	MappedRecordFile file;
+	file.open(filename);
+	RecordViews<RawRecordFraming> data_info(file);
 
 #ifdef DEF_LIB_ZLIB
 	// allocate the space for the compressed memory
@@ -234,8 +145,8 @@ void RawRecorder::read_all_raw_compressed(const std::string &filename, int FPS)
 //#endif		
 	{
 		// uncompress
-		int err = uncompress(uncom, &uncomprLen, it->data(), 
-			static_cast<uLong>(it->size()));
+		int err = uncompress(uncom, &uncomprLen, it->bytes(), 
+			static_cast<uLong>(it->size));
 		if (err != Z_OK) {
 			fprintf(stderr, "error: %d\n", err);
 			exit(1);
@@ -307,20 +218,20 @@ void RawRecorder::read_all_raw_compressed(const std::string &filename, int FPS)
 		size_t s0 = 0;
 		size_t s1 = 0;
 		size_t data_size = 0;
-		memcpy(&num_items, &(it->data()[data_size]), sizeof(size_t));
+		memcpy(&num_items, &(it->data[data_size]), sizeof(size_t));
 		data_size += sizeof(size_t);
-		memcpy(&s0, &(it->data()[data_size]), sizeof(size_t));
+		memcpy(&s0, &(it->data[data_size]), sizeof(size_t));
 		data_size += sizeof(size_t);
-		memcpy(&s1, &(it->data()[data_size]), sizeof(size_t));
+		memcpy(&s1, &(it->data[data_size]), sizeof(size_t));
 		data_size += sizeof(size_t);
 
 		std::cout << "#items: " << num_items << " " << s0 << " " << s1 << std::endl;
 
 		cv::Mat img0(s1, s0, CV_8UC3, cv::Scalar::all(0));
-		memcpy(img0.data, &(it->data()[data_size]), sizeof(uchar) * s0 * s1 * img0.channels());
+		memcpy(img0.data, &(it->data[data_size]), sizeof(uchar) * s0 * s1 * img0.channels());
 		data_size += sizeof(uchar) * s0 * s1 * img0.channels();
 		cv::Mat img1(s1, s0, CV_32FC3, cv::Scalar::all(0));
-		memcpy(img1.data, &(it->data()[data_size]), sizeof(float) * s0 * s1 * img1.channels());
+		memcpy(img1.data, &(it->data[data_size]), sizeof(float) * s0 * s1 * img1.channels());
 		data_size += sizeof(float) * s0 * s1 * img1.channels();
 
 		cv::imshow("img0", img0);
@@ -331,27 +242,15 @@ void RawRecorder::read_all_raw_compressed(const std::string &filename, int FPS)
 #endif
 }
 // ----------------------------------------------------------------------------
-void RawRecorder::data2data_type(char *data, int maxsize,
-	std::vector< std::vector<uint8_t> > &out)
-{
-	int pos = 0;
-	while (pos < maxsize) {
-		//std::cout << "read: " << pos << " " << maxsize << std::endl;
-		size_t msgsize = 0;
-		memcpy(&msgsize, &data[pos], sizeof(msgsize));
-		pos += sizeof(msgsize);
-		if (msgsize < maxsize &&
-			pos + msgsize < maxsize)
-		{
-			std::vector<uint8_t> msg_tmp(msgsize);
-			memcpy(&msg_tmp[0], &data[pos], msgsize);
-			//std::vector<uint8_t> v(msgsize);
-			//for (int i = 0; i < msgsize; i++)
-			//	v[i] = msg_tmp[i];
-			out.push_back(msg_tmp);
-		}
-		pos += msgsize;
-	}
+size_t RawRecordFraming::next(const char *data, size_t available,
+	RecordView &view) {
+	size_t msgsize = 0;
+	if (available < sizeof(msgsize)) return 0;
+	memcpy(&msgsize, data, sizeof(msgsize));
+	// The last data ends at available
+	if (msgsize > available - sizeof(msgsize)) return 0;
+	view = RecordView(data + sizeof(msgsize), msgsize);
+	return sizeof(msgsize) + msgsize;
 }
 // ----------------------------------------------------------------------------
 void RawRecorder::set_callback_createfile(
@@ -0,0 +1,464 @@
+/* @file async_write_backend.cpp
+ * @brief Implementation of the asynchronous write backends.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include "record/inc/record/async_write_backend.hpp"
+
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+
+#include "record/inc/record/lib_configuration.hpp"
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef DEF_LIB_URING
+#include <liburing.h>
+#endif
+
+namespace storedata
+{
+
+const size_t AsyncWriteBackend::kAlignment;
+
+//-----------------------------------------------------------------------------
+AsyncWriteBackend::AsyncWriteBackend(size_t num_buffers,
+	size_t buffer_bytes) {
+	in_flight_ = 0;
+	stopped_ = false;
+	buffer_bytes_ = (std::max)(kAlignment,
+		(buffer_bytes + kAlignment - 1) / kAlignment * kAlignment);
+	num_buffers = (std::max)(num_buffers, size_t(1));
+	for (size_t i = 0; i < num_buffers; ++i) {
+		char *buffer = nullptr;
+#ifdef _WIN32
+		buffer = static_cast<char*>(_aligned_malloc(buffer_bytes_,
+			kAlignment));
+#else
+		void *ptr = nullptr;
+		if (posix_memalign(&ptr, kAlignment, buffer_bytes_) == 0) {
+			buffer = static_cast<char*>(ptr);
+		}
+#endif
+		if (!buffer) break;
+		free_buffers_.push_back(static_cast<int>(buffers_.size()));
+		buffers_.push_back(buffer);
+	}
+}
+//-----------------------------------------------------------------------------
+AsyncWriteBackend::~AsyncWriteBackend() {
+	for (auto &buffer : buffers_) {
+#ifdef _WIN32
+		_aligned_free(buffer);
+#else
+		free(buffer);
+#endif
+	}
+	buffers_.clear();
+}
+//-----------------------------------------------------------------------------
+char* AsyncWriteBackend::acquire_buffer(int &index, int timeout_ms) {
+	index = -1;
+	std::unique_lock<std::mutex> lk(mtx_buffers_);
+	if (buffers_.empty()) return nullptr;
+	auto is_free = [this] { return !free_buffers_.empty() || stopped_; };
+	if (timeout_ms < 0) {
+		cond_buffers_.wait(lk, is_free);
+	} else if (!cond_buffers_.wait_for(lk,
+		std::chrono::milliseconds(timeout_ms), is_free)) {
+		return nullptr;
+	}
+	if (stopped_) return nullptr;
+	index = free_buffers_.back();
+	free_buffers_.pop_back();
+	return buffers_[index];
+}
+//-----------------------------------------------------------------------------
+void AsyncWriteBackend::release_buffer(int index) {
+	if (index < 0 || index >= static_cast<int>(buffers_.size())) return;
+	{
+		std::lock_guard<std::mutex> lk(mtx_buffers_);
+		free_buffers_.push_back(index);
+	}
+	cond_buffers_.notify_one();
+}
+//-----------------------------------------------------------------------------
+size_t AsyncWriteBackend::buffer_bytes() const {
+	return buffer_bytes_;
+}
+//-----------------------------------------------------------------------------
+int AsyncWriteBackend::submit_buffer(int fd, int index, size_t size,
+	uint64_t offset, cbk_write_done done) {
+	if (index < 0 || index >= static_cast<int>(buffers_.size()) ||
+		size > buffer_bytes_) {
+		return kFail;
+	}
+	Request request;
+	request.fd = fd;
+	request.index = index;
+	request.data = buffers_[index];
+	request.size = size;
+	request.offset = offset;
+	request.done_bytes = 0;
+	request.done = std::move(done);
+	{
+		std::lock_guard<std::mutex> lk(mtx_idle_);
+		++in_flight_;
+	}
+	if (enqueue(std::move(request)) != kSuccess) {
+		std::lock_guard<std::mutex> lk(mtx_idle_);
+		--in_flight_;
+		cond_idle_.notify_all();
+		return kFail;
+	}
+	return kSuccess;
+}
+//-----------------------------------------------------------------------------
+int AsyncWriteBackend::submit(int fd, const void *data, size_t size,
+	uint64_t offset, cbk_write_done done) {
+	Request request;
+	request.fd = fd;
+	request.index = -1;
+	request.data = static_cast<const char*>(data);
+	request.size = size;
+	request.offset = offset;
+	request.done_bytes = 0;
+	request.done = std::move(done);
+	{
+		std::lock_guard<std::mutex> lk(mtx_idle_);
+		++in_flight_;
+	}
+	if (enqueue(std::move(request)) != kSuccess) {
+		std::lock_guard<std::mutex> lk(mtx_idle_);
+		--in_flight_;
+		cond_idle_.notify_all();
+		return kFail;
+	}
+	return kSuccess;
+}
+//-----------------------------------------------------------------------------
+void AsyncWriteBackend::wait_idle() {
+	std::unique_lock<std::mutex> lk(mtx_idle_);
+	cond_idle_.wait(lk, [this] { return in_flight_ == 0; });
+}
+//-----------------------------------------------------------------------------
+size_t AsyncWriteBackend::in_flight() {
+	std::lock_guard<std::mutex> lk(mtx_idle_);
+	return in_flight_;
+}
+//-----------------------------------------------------------------------------
+void AsyncWriteBackend::complete(Request &request, int64_t result) {
+	if (request.done) request.done(result);
+	if (request.index >= 0) release_buffer(request.index);
+	std::lock_guard<std::mutex> lk(mtx_idle_);
+	if (--in_flight_ == 0) cond_idle_.notify_all();
+}
+//-----------------------------------------------------------------------------
+void AsyncWriteBackend::shutdown_wait() {
+	// The producers waiting for a buffer are released
+	{
+		std::lock_guard<std::mutex> lk(mtx_buffers_);
+		stopped_ = true;
+	}
+	cond_buffers_.notify_all();
+	wait_idle();
+}
+
+//-----------------------------------------------------------------------------
+AsyncWriteBackendThreadPool::AsyncWriteBackendThreadPool(
+	const AsyncWriteParams &params) :
+	AsyncWriteBackend(params.num_buffers, params.buffer_bytes) {
+	continue_run_ = true;
+	size_t num_threads = (std::max)(params.num_threads, size_t(1));
+	for (size_t i = 0; i < num_threads; ++i) {
+		workers_.push_back(std::thread(
+			&AsyncWriteBackendThreadPool::worker_thread, this));
+	}
+}
+//-----------------------------------------------------------------------------
+AsyncWriteBackendThreadPool::~AsyncWriteBackendThreadPool() {
+	shutdown_wait();
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		continue_run_ = false;
+	}
+	cond_.notify_all();
+	for (auto &worker : workers_) {
+		if (worker.joinable()) worker.join();
+	}
+}
+//-----------------------------------------------------------------------------
+const char* AsyncWriteBackendThreadPool::name() const {
+	return "thread_pool";
+}
+//-----------------------------------------------------------------------------
+int AsyncWriteBackendThreadPool::enqueue(Request &&request) {
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		if (!continue_run_) return kFail;
+		pending_.push_back(std::move(request));
+	}
+	cond_.notify_one();
+	return kSuccess;
+}
+//-----------------------------------------------------------------------------
+void AsyncWriteBackendThreadPool::worker_thread() {
+	for (;;) {
+		std::vector<Request> batch;
+		{
+			std::unique_lock<std::mutex> lk(mtx_);
+			cond_.wait(lk, [this] {
+				return !pending_.empty() || !continue_run_; });
+			// Stop requested and nothing left to write
+			if (pending_.empty()) break;
+			// The pending requests are divided among the workers
+			size_t n = (pending_.size() + workers_.size() - 1) /
+				workers_.size();
+			for (size_t i = 0; i < n; ++i) {
+				batch.push_back(std::move(pending_.front()));
+				pending_.pop_front();
+			}
+		}
+
+		for (auto &request : batch) {
+			int64_t result = 0;
+#ifdef _WIN32
+			result = -1;
+#else
+			while (request.done_bytes < request.size) {
+				ssize_t n = pwrite(request.fd,
+					request.data + request.done_bytes,
+					request.size - request.done_bytes,
+					static_cast<off_t>(request.offset + request.done_bytes));
+				if (n < 0) {
+					if (errno == EINTR) continue;
+					result = -errno;
+					break;
+				}
+				request.done_bytes += static_cast<size_t>(n);
+			}
+			if (result == 0) result = static_cast<int64_t>(request.done_bytes);
+#endif
+			complete(request, result);
+		}
+	}
+}
+
+#ifdef DEF_LIB_URING
+/** @brief Backend that submits the writes with io_uring.
+
+	One thread prepares the pending requests in the submission queue,
+	submits them with a single system call and reaps the completions.
+	The buffers of the backend are registered (IORING_OP_WRITE_FIXED).
+*/
+class AsyncWriteBackendIoUring : public AsyncWriteBackend
+{
+public:
+
+	AsyncWriteBackendIoUring(const AsyncWriteParams &params) :
+		AsyncWriteBackend(params.num_buffers, params.buffer_bytes) {
+		is_ready_ = false;
+		registered_ = false;
+		continue_run_ = true;
+		queue_depth_ = (std::max)(params.queue_depth, 8u);
+		if (io_uring_queue_init(queue_depth_, &ring_, 0) < 0) return;
+		std::vector<struct iovec> iov(buffers_.size());
+		for (size_t i = 0; i < buffers_.size(); ++i) {
+			iov[i].iov_base = buffers_[i];
+			iov[i].iov_len = buffer_bytes();
+		}
+		registered_ = io_uring_register_buffers(&ring_, iov.data(),
+			static_cast<unsigned>(iov.size())) == 0;
+		is_ready_ = true;
+		thread_ = std::thread(&AsyncWriteBackendIoUring::ring_thread, this);
+	}
+
+	~AsyncWriteBackendIoUring() {
+		if (!is_ready_) return;
+		shutdown_wait();
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			continue_run_ = false;
+		}
+		cond_.notify_all();
+		if (thread_.joinable()) thread_.join();
+		io_uring_queue_exit(&ring_);
+	}
+
+	/** @brief It returns true if the ring is created.
+	*/
+	bool is_ready() const {
+		return is_ready_;
+	}
+
+	const char* name() const override {
+		return "io_uring";
+	}
+
+protected:
+
+	int enqueue(Request &&request) override {
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			if (!continue_run_ || !is_ready_) return kFail;
+			pending_.push_back(std::move(request));
+		}
+		cond_.notify_one();
+		return kSuccess;
+	}
+
+private:
+
+	struct io_uring ring_;
+	unsigned int queue_depth_;
+	bool is_ready_;
+	/** @brief True if the buffers are registered
+	*/
+	bool registered_;
+	std::thread thread_;
+	std::deque<Request> pending_;
+	std::mutex mtx_;
+	std::condition_variable cond_;
+	bool continue_run_;
+
+	/** @brief Function executed by the ring thread
+	*/
+	void ring_thread() {
+		// Requests in the kernel
+		size_t submitted = 0;
+		for (;;) {
+			std::vector<Request*> batch;
+			{
+				std::unique_lock<std::mutex> lk(mtx_);
+				if (submitted == 0) {
+					cond_.wait(lk, [this] {
+						return !pending_.empty() || !continue_run_; });
+					// Stop requested and nothing left to write
+					if (pending_.empty()) break;
+				}
+				// The requests that fit in the submission queue
+				while (!pending_.empty() &&
+					submitted + batch.size() < queue_depth_) {
+					batch.push_back(new Request(std::move(pending_.front())));
+					pending_.pop_front();
+				}
+			}
+
+			for (auto &request : batch) {
+				struct io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+				const char *ptr = request->data + request->done_bytes;
+				unsigned int len = static_cast<unsigned int>(
+					request->size - request->done_bytes);
+				uint64_t offset = request->offset + request->done_bytes;
+				if (request->index >= 0 && registered_) {
+					io_uring_prep_write_fixed(sqe, request->fd, ptr, len,
+						offset, request->index);
+				} else {
+					io_uring_prep_write(sqe, request->fd, ptr, len, offset);
+				}
+				io_uring_sqe_set_data(sqe, request);
+				++submitted;
+			}
+			// One system call for the whole batch
+			if (!batch.empty()) io_uring_submit(&ring_);
+
+			// Nothing new to submit: wait for a completion (the timeout
+			// limits the delay of the next requests)
+			struct io_uring_cqe *cqe = nullptr;
+			if (batch.empty() && submitted > 0) {
+				struct __kernel_timespec ts;
+				ts.tv_sec = 0;
+				ts.tv_nsec = 1000000;
+				io_uring_wait_cqe_timeout(&ring_, &cqe, &ts);
+			}
+
+			unsigned int head = 0;
+			unsigned int count = 0;
+			std::vector<Request*> resubmit;
+			io_uring_for_each_cqe(&ring_, head, cqe) {
+				++count;
+				--submitted;
+				Request *request = static_cast<Request*>(
+					io_uring_cqe_get_data(cqe));
+				int res = cqe->res;
+				if (res == -EINTR || res == -EAGAIN) {
+					resubmit.push_back(request);
+					continue;
+				}
+				if (res < 0) {
+					complete(*request, res);
+					delete request;
+					continue;
+				}
+				request->done_bytes += static_cast<size_t>(res);
+				// Short write: the remaining part is submitted again
+				if (res > 0 && request->done_bytes < request->size) {
+					resubmit.push_back(request);
+					continue;
+				}
+				complete(*request,
+					static_cast<int64_t>(request->done_bytes));
+				delete request;
+			}
+			io_uring_cq_advance(&ring_, count);
+
+			if (!resubmit.empty()) {
+				std::lock_guard<std::mutex> lk(mtx_);
+				for (auto it = resubmit.rbegin(); it != resubmit.rend(); ++it) {
+					pending_.push_front(std::move(**it));
+					delete *it;
+				}
+			}
+		}
+	}
+};
+#endif // DEF_LIB_URING
+
+//-----------------------------------------------------------------------------
+std::shared_ptr<AsyncWriteBackend> create_async_write_backend(
+	const AsyncWriteParams &params) {
+#ifdef _WIN32
+	(void)params;
+	return nullptr;
+#else
+#ifdef DEF_LIB_URING
+	if (params.type == AsyncWriteBackendType::Auto ||
+		params.type == AsyncWriteBackendType::IoUring) {
+		std::shared_ptr<AsyncWriteBackendIoUring> backend =
+			std::make_shared<AsyncWriteBackendIoUring>(params);
+		if (backend->is_ready()) return backend;
+		// The kernel does not support io_uring
+		if (params.type == AsyncWriteBackendType::IoUring) return nullptr;
+	}
+#else
+	if (params.type == AsyncWriteBackendType::IoUring) return nullptr;
+#endif
+	return std::make_shared<AsyncWriteBackendThreadPool>(params);
+#endif
+}
+
+} // namespace storedata
@@ -22,19 +22,61 @@
 
 #include "record/inc/record/create_file.hpp"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace storedata
 {
 
+namespace
+{
+/** @brief Records of this size are written without the buffer
+*/
+const size_t kDirectWriteBytes = 64 * 1024;
+
+/** @brief It copies the slices in data (the capacity is reused).
+*/
+void gather(const RecordSlice *slices, size_t num_slices,
+	std::vector<char> &data) {
+	size_t size = 0;
+	for (size_t i = 0; i < num_slices; ++i) size += slices[i].size;
+	data.resize(size);
+	size_t pos = 0;
+	for (size_t i = 0; i < num_slices; ++i) {
+		if (slices[i].size == 0) continue;
+		memcpy(&data[pos], slices[i].data, slices[i].size);
+		pos += slices[i].size;
+	}
+}
+} // namespace
+
 // ----------------------------------------------------------------------------
-MemorizeFileManager::MemorizeFileManager() {}
+MemorizeFileManager::MemorizeFileManager() {
+	memory_expected_allocated_ = 0;
+	memory_max_allocable_ = 0;
+	flush_bytes_ = 4 * 1024 * 1024;
+	flush_interval_ms_ = 50;
+	last_flush_ = std::chrono::steady_clock::now();
+	use_segment_ = false;
+	direct_io_ = false;
+	segment_dirty_ = false;
+	indexed_ = false;
+	stream_id_ = 0;
+	footer_pending_ = false;
+}
 // ----------------------------------------------------------------------------
 MemorizeFileManager::~MemorizeFileManager() {
 	release();
 }
 // ----------------------------------------------------------------------------
 void MemorizeFileManager::release() {
+	if (footer_pending_) write_footer();
+	flush_buffer();
 	fout_.close();
 	fout_.clear();
+	segment_.close();
 }
 // ----------------------------------------------------------------------------
 void MemorizeFileManager::setup(size_t memory_max_allocable,
@@ -48,17 +90,46 @@ void MemorizeFileManager::setup(size_t memory_max_allocable,
 }
 // ----------------------------------------------------------------------------
 int MemorizeFileManager::generate(const std::string &appendix, bool append) {
-	if (!fout_.is_open()) {
+	if (!is_open()) {
 		std::string filename = filename_ + appendix + dot_extension_;
 		std::cout << filename << std::endl;
-		// get the current time
-		if (append) {
-			fout_.open(filename.c_str(), std::ios::binary | std::ios::app);
+		// The index of a closed file cannot be extended
+		if (indexed_) append = false;
+		if (use_segment_) {
+			// Preallocated segment of the maximum size
+			segment_.set_backend(backend_);
+			if (segment_.open(filename, memory_max_allocable_, direct_io_,
+				append, flush_bytes_) != kSuccess) {
+				return kFail;
+			}
+			memory_expected_allocated_ = segment_.size();
+			segment_dirty_ = false;
 		} else {
-			fout_.open(filename.c_str(), std::ios::binary);
+			// get the current time
+			fout_filename_ = filename;
+			if (append) {
+				fout_.open(filename.c_str(), std::ios::binary | std::ios::app);
+			} else {
+				fout_.open(filename.c_str(), std::ios::binary);
+			}
+			// Get the file size
+			memory_expected_allocated_ = filesize(filename.c_str());
+			buffer_.clear();
+			buffer_.reserve(flush_bytes_);
+		}
+		last_flush_ = std::chrono::steady_clock::now();
+		index_.clear();
+		footer_pending_ = indexed_;
+		if (indexed_) {
+			std::vector<char> header;
+			IndexedFile::write_header(std::vector<IndexedStreamDescriptor>(1,
+				IndexedStreamDescriptor(stream_id_, filename_)), header);
+			return write_bytes(&header[0], header.size());
+		}
+		// The header is written only at the beginning of the file
+		if (!file_header_.empty() && memory_expected_allocated_ == 0) {
+			return write_bytes(&file_header_[0], file_header_.size());
 		}
-		// Get the file size
-		memory_expected_allocated_ = filesize(filename.c_str());
 		return kSuccess;
 	}
 	return kFail;
@@ -66,20 +137,45 @@ int MemorizeFileManager::generate(const std::string &appendix, bool append) {
 // ----------------------------------------------------------------------------
 int MemorizeFileManager::check_memory(size_t size) {
 	//std::cout << ">> " << memory_expected_allocated_ << " " << size << " " << memory_max_allocable_ << std::endl;
-	if (memory_expected_allocated_ + size < memory_max_allocable_) {
+	size_t allocated = memory_expected_allocated_;
+	if (footer_pending_) {
+		// The record header, its index entry and the trailer
+		size += IndexedFile::kRecordHeaderBytes + IndexedFile::kIndexEntryBytes;
+		allocated += index_.size() * IndexedFile::kIndexEntryBytes +
+			IndexedFile::kTrailerBytes;
+	}
+	if (allocated + size < memory_max_allocable_) {
 		return kSuccess;
 	}
 	return kFail;
 }
 // ----------------------------------------------------------------------------
-int MemorizeFileManager::push(const std::vector<char> &data) {
-	if (!fout_.is_open()) return kFileIsNotOpen;
+int MemorizeFileManager::push(const std::vector<char> &data,
+	int64_t timestamp_us) {
+	if (!is_open()) return kFileIsNotOpen;
 
 	if (data.size() > 0) {
 		if (check_memory(data.size())) {
-			fout_.write(&data[0], data.size());
-			fout_.flush();
-			memory_expected_allocated_ += data.size();
+			if (!footer_pending_) return write_bytes(&data[0], data.size());
+			IndexedFileEntry entry;
+			entry.offset = memory_expected_allocated_;
+			entry.size = data.size();
+			entry.timestamp_us = timestamp_us < 0 ? DateTime::timestamp_us() :
+				timestamp_us;
+			// The search by time (find_time) requires ordered records
+			if (!index_.empty()) {
+				entry.timestamp_us = (std::max)(entry.timestamp_us,
+					index_.back().timestamp_us);
+			}
+			entry.stream_id = stream_id_;
+			char header[IndexedFile::kRecordHeaderBytes];
+			IndexedFile::write_record_header(entry.stream_id,
+				entry.timestamp_us, entry.size, header);
+			if (write_bytes(header, sizeof(header)) != kSuccess ||
+				write_bytes(&data[0], data.size()) != kSuccess) {
+				return kFail;
+			}
+			index_.push_back(entry);
 			return kSuccess;
 		} else {
 			// out of memory
@@ -90,9 +186,142 @@ int MemorizeFileManager::push(const std::vector<char> &data) {
 	return kDataIsEmpty;
 }
 // ----------------------------------------------------------------------------
+int MemorizeFileManager::write_bytes(const char *data, size_t size) {
+	memory_expected_allocated_ += size;
+	// The segment has its own aligned buffer
+	if (segment_.is_open()) {
+		if (segment_.write(data, size) != kSuccess) {
+			return kFail;
+		}
+		segment_dirty_ = true;
+		flush_if_due();
+		return kSuccess;
+	}
+	// Large records (i.e. raw frames) are written directly, without the
+	// copy in the buffer
+	bool is_direct = size >= kDirectWriteBytes || size >= flush_bytes_;
+	if (is_direct || buffer_.size() + size > flush_bytes_) {
+		flush_buffer();
+		if (is_direct) {
+			fout_.write(data, size);
+			fout_.flush();
+			return kSuccess;
+		}
+	}
+	buffer_.insert(buffer_.end(), data, data + size);
+	if (buffer_.size() >= flush_bytes_) {
+		flush_buffer();
+	} else {
+		flush_if_due();
+	}
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+int MemorizeFileManager::write_footer() {
+	footer_pending_ = false;
+	if (!is_open()) return kFileIsNotOpen;
+	std::vector<char> footer;
+	IndexedFile::write_footer(index_, memory_expected_allocated_, footer);
+	index_.clear();
+	return write_bytes(&footer[0], footer.size());
+}
+// ----------------------------------------------------------------------------
+void MemorizeFileManager::set_group_commit(size_t flush_bytes,
+	int flush_interval_ms) {
+	flush_buffer();
+	flush_bytes_ = flush_bytes;
+	flush_interval_ms_ = flush_interval_ms;
+	buffer_.reserve(flush_bytes_);
+}
+// ----------------------------------------------------------------------------
+void MemorizeFileManager::flush_if_due() {
+	if ((buffer_.empty() && !segment_dirty_) || flush_interval_ms_ < 0) return;
+	if (std::chrono::steady_clock::now() - last_flush_ >=
+		std::chrono::milliseconds(flush_interval_ms_)) {
+		flush_buffer();
+	}
+}
+// ----------------------------------------------------------------------------
+int MemorizeFileManager::sync() {
+	if (segment_.is_open()) {
+		segment_dirty_ = false;
+		last_flush_ = std::chrono::steady_clock::now();
+		return segment_.sync();
+	}
+	if (!fout_.is_open()) return kFileIsNotOpen;
+	int return_status = flush_buffer();
+#ifndef _WIN32
+	// The stream has no descriptor. The data of the file is written to the
+	// disk by the sync of any descriptor of the same file.
+	int fd = ::open(fout_filename_.c_str(), O_RDONLY);
+	if (fd < 0) return kFail;
+#ifdef __linux__
+	if (fdatasync(fd) != 0) return_status = kFail;
+#else
+	if (fsync(fd) != 0) return_status = kFail;
+#endif
+	::close(fd);
+#endif
+	return return_status;
+}
+// ----------------------------------------------------------------------------
+int MemorizeFileManager::flush_buffer() {
+	last_flush_ = std::chrono::steady_clock::now();
+	if (segment_.is_open()) {
+		segment_dirty_ = false;
+		return segment_.flush();
+	}
+	if (!fout_.is_open()) return kFileIsNotOpen;
+	if (!buffer_.empty()) {
+		fout_.write(&buffer_[0], buffer_.size());
+		buffer_.clear();
+	}
+	fout_.flush();
+	return fout_.good() ? kSuccess : kFail;
+}
+// ----------------------------------------------------------------------------
+void MemorizeFileManager::set_segment_writer(bool use_segment,
+	bool direct_io) {
+	use_segment_ = use_segment;
+	direct_io_ = direct_io;
+}
+// ----------------------------------------------------------------------------
+void MemorizeFileManager::set_write_backend(
+	std::shared_ptr<AsyncWriteBackend> backend) {
+	backend_ = backend;
+}
+// ----------------------------------------------------------------------------
+void MemorizeFileManager::set_indexed_format(bool indexed,
+	uint32_t stream_id) {
+	indexed_ = indexed;
+	stream_id_ = stream_id;
+}
+// ----------------------------------------------------------------------------
+void MemorizeFileManager::set_file_header(const std::vector<char> &header) {
+	file_header_ = header;
+}
+// ----------------------------------------------------------------------------
+bool MemorizeFileManager::is_open() const {
+	return fout_.is_open() || segment_.is_open();
+}
+// ----------------------------------------------------------------------------
 FileGeneratorManagerAsync::FileGeneratorManagerAsync(){
 	verbose_ = false;
 	under_writing_ = false;
+	has_data_ = false;
+	continue_write_ = false;
+	num_replaced_ = 0;
+	record_framerate_ = -1;
+	pacing_policy_ = FramePacerPolicy::Skip;
+	pacing_max_burst_ = 1;
+	flush_bytes_ = 4 * 1024 * 1024;
+	flush_interval_ms_ = 50;
+	use_segment_ = false;
+	direct_io_ = false;
+	indexed_ = false;
+	data_in_timestamp_us_ = 0;
+	data_write_timestamp_us_ = 0;
+	num_same_appendix_ = 0;
 }
 // ----------------------------------------------------------------------------
 FileGeneratorManagerAsync::~FileGeneratorManagerAsync() {
@@ -105,26 +334,26 @@ int FileGeneratorManagerAsync::setup(
 	std::cout << "FileGeneratorManagerAsync::setup" << std::endl;
 	int return_status = kSuccess;
 
+	std::lock_guard<std::mutex> lock_write(mutex_write_);
+
 	// set framerate to record and capture at
 	record_framerate_ = record_framerate;
 
-#ifdef BOOST_BUILD
-
-	// initialize initial timestamps
-	nextFrameTimestamp_ = boost::posix_time::microsec_clock::local_time();
-	currentFrameTimestamp_ = nextFrameTimestamp_;
-	td_ = (currentFrameTimestamp_ - nextFrameTimestamp_);
-
-#endif
+	// The first data is written without wait
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pacer_.setup(record_framerate_, pacing_policy_, pacing_max_burst_);
+	}
 
 	// Get the appendix to add to the video
 	std::string appendix = DateTime::time2string();
 	std::cout << "FileGeneratorManagerAsync::setup:appendix: " <<
 		appendix << std::endl;
-	for (int i = 0; i < appendix.length(); i++)
+	for (size_t i = 0; i < appendix.length(); i++)
 	{
 		if (appendix[i] == ':') appendix[i] = '_';
 	}
+	make_unique_appendix(appendix);
 	// callback to inform that a new file will be created
 	if (callback_createfile_) {
 		callback_createfile_(appendix);
@@ -140,6 +369,16 @@ int FileGeneratorManagerAsync::setup(
 		m_files_[it->first] = new MemorizeFileManager();
 		m_files_[it->first]->setup(max_memory_allocable,
 			it->second.filename(), it->second.dot_extension());
+		m_files_[it->first]->set_group_commit(flush_bytes_,
+			flush_interval_ms_);
+		m_files_[it->first]->set_segment_writer(use_segment_, direct_io_);
+		m_files_[it->first]->set_write_backend(backend_);
+		m_files_[it->first]->set_indexed_format(indexed_,
+			static_cast<uint32_t>(it->first));
+		auto header = file_headers_.find(it->first);
+		if (header != file_headers_.end()) {
+			m_files_[it->first]->set_file_header(header->second);
+		}
 		if (!m_files_[it->first]->generate(appendix, false)) {
 			return_status = kFail;
 		}
@@ -147,6 +386,17 @@ int FileGeneratorManagerAsync::setup(
 
 	//number_addframe_requests_ = 0;
 	under_writing_ = false;
+
+	// Start the writer (it lives until close)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!continue_write_) {
+			if (thread_writer_.joinable()) thread_writer_.join();
+			continue_write_ = true;
+			thread_writer_ = std::thread(
+				&FileGeneratorManagerAsync::writer_thread, this);
+		}
+	}
 	return return_status;
 }
 // ----------------------------------------------------------------------------
@@ -154,169 +404,428 @@ bool FileGeneratorManagerAsync::under_writing() {
 	return under_writing_;
 }
 // ----------------------------------------------------------------------------
-bool FileGeneratorManagerAsync::procedure() {
-
-#ifdef BOOST_BUILD
-
-	bool result_out = false;
-
-	boost::mutex::scoped_lock lock(mutex_, boost::try_to_lock);
-	if (lock) {
-		under_writing_ = true;
-
-		//determine current elapsed time
-		currentFrameTimestamp_ = boost::posix_time::microsec_clock::local_time();
-		td_ = (currentFrameTimestamp_ - nextFrameTimestamp_);
+void FileGeneratorManagerAsync::writer_thread() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	auto pred = [this] {
+		return has_data_ || !queue_.empty() || !continue_write_; };
+	for (;;) {
+		if (flush_interval_ms_ < 0) {
+			cond_.wait(lock, pred);
+		} else if (!cond_.wait_for(lock,
+			std::chrono::milliseconds((std::max)(flush_interval_ms_, 1)),
+			pred)) {
+			// Idle: write the buffers kept too long
+			lock.unlock();
+			{
+				std::lock_guard<std::mutex> lock_write(mutex_write_);
+				for (auto &it : m_files_) it.second->flush_if_due();
+			}
+			lock.lock();
+			continue;
+		}
 
-		// wait for X microseconds until 1second/framerate time has passed after previous frame write
-		if (record_framerate_ < 0 ||
-			td_.total_microseconds() >= 1000000 / record_framerate_) {
+		// The guaranteed data is written first, in the push order
+		if (!queue_.empty()) {
+			int64_t timestamp_us = queue_.front().first;
+			std::map<int, std::vector<char> > data =
+				std::move(queue_.front().second);
+			queue_.pop_front();
+			size_t bytes = 0;
+			for (auto &it : data) bytes += it.second.size();
+			queue_stats_.queued_bytes -= bytes;
+			--queue_stats_.queued_items;
+			++queue_stats_.written_items;
+			cond_space_.notify_all();
+			lock.unlock();
+			{
+				std::lock_guard<std::mutex> lock_write(mutex_write_);
+				under_writing_ = true;
+				write_locked(data, timestamp_us);
+				under_writing_ = false;
+			}
+			lock.lock();
+			recycle(std::move(data));
+			continue;
+		}
 
-			//	 determine time at start of write
-			initialLoopTimestamp_ = boost::posix_time::microsec_clock::local_time();
+		// Close requested and the last data is written
+		if (!has_data_) break;
+
+		// Wait until the slot of the next write. Meanwhile a new data can
+		// replace the pending one.
+		if (continue_write_ && pacer_.is_enabled() &&
+			FramePacer::Clock::now() < pacer_.next_time()) {
+			cond_.wait_until(lock, pacer_.next_time(),
+				[this] { return !continue_write_ || !queue_.empty(); });
+			// Serve the guaranteed data before
+			if (!queue_.empty()) continue;
+		}
 
-			// Check the memory
-			bool memory_ok = true;
+		lock.unlock();
+		procedure();
+		lock.lock();
+	}
+}
+// ----------------------------------------------------------------------------
+bool FileGeneratorManagerAsync::write_locked(
+	const std::map<int, std::vector<char> > &data, int64_t timestamp_us) {
+	bool result_out = false;
 
+	// Check the memory
+	bool memory_ok = true;
 #if _MSC_VER && !__INTEL_COMPILER && (_MSC_VER > 1600)
-			for (auto it = data_in_.begin(); it != data_in_.end(); it++)
+	for (auto it = data.begin(); it != data.end(); it++)
 #else
-			for (std::map<int, std::vector<char> >::const_iterator it = data_in_.begin(); it != data_in_.end(); it++)
+	for (std::map<int, std::vector<char> >::const_iterator it = data.begin(); it != data.end(); it++)
 #endif
-			{
-				// Test the data
-				if (m_files_.find(it->first) != m_files_.end()) {
-					if (!m_files_[it->first]->check_memory(it->second.size())) {
-						memory_ok = false;
-						break;
-					}
-				}
+	{
+		// Test the data
+		if (m_files_.find(it->first) != m_files_.end()) {
+			if (!m_files_[it->first]->check_memory(it->second.size())) {
+				memory_ok = false;
+				break;
 			}
-			// At least one file has not enough memory.
-			// Close all the files and create a new one
-			if (!memory_ok) {
-
-				// Get the appendix to add to the video
-				std::string appendix = DateTime::time2string();
-				for (int i = 0; i < appendix.length(); i++)
-				{
-					if (appendix[i] == ':') appendix[i] = '_';
-				}
-				// callback to inform that a new file will be created
-				if (callback_createfile_) {
-					callback_createfile_(appendix);
-				}
+		}
+	}
+	// At least one file has not enough memory.
+	// Close all the files and create a new one
+	if (!memory_ok) {
+
+		// Get the appendix to add to the video
+		std::string appendix = DateTime::time2string();
+		for (size_t i = 0; i < appendix.length(); i++)
+		{
+			if (appendix[i] == ':') appendix[i] = '_';
+		}
+		make_unique_appendix(appendix);
+		// callback to inform that a new file will be created
+		if (callback_createfile_) {
+			callback_createfile_(appendix);
+		}
 
 #if _MSC_VER && !__INTEL_COMPILER && (_MSC_VER > 1600)
-				for (auto it = m_files_.begin(); it != m_files_.end(); it++)
+		for (auto it = m_files_.begin(); it != m_files_.end(); it++)
 #else
-				for (std::map<int, MemorizeFileManager* >::const_iterator it = m_files_.begin(); it != m_files_.end(); it++)
+		for (std::map<int, MemorizeFileManager* >::const_iterator it = m_files_.begin(); it != m_files_.end(); it++)
 #endif		
-				{
-					it->second->release();
-					it->second->generate(appendix, false);
-				}
-			}
+		{
+			it->second->release();
+			it->second->generate(appendix, false);
+		}
+	}
 
-			// Add the data
+	// Add the data
 #if _MSC_VER && !__INTEL_COMPILER && (_MSC_VER > 1600)
-			for (auto it = data_in_.begin(); it != data_in_.end(); it++)
+	for (auto it = data.begin(); it != data.end(); it++)
 #else
-			for (std::map<int, std::vector<char> >::const_iterator it = data_in_.begin(); it != data_in_.end(); it++)
+	for (std::map<int, std::vector<char> >::const_iterator it = data.begin(); it != data.end(); it++)
 #endif		
-			{
-				// Test if the file manager exists
-				if (m_files_.find(it->first) != m_files_.end()) {
-					// If able to write to disk
-					if (m_files_[it->first]->push(it->second) ==
-						kSuccess) {
-						result_out = true;
-					}
-				}
-			}
-
-			//write previous and current frame timestamp to console
-			if (verbose_) {
-				std::cout << nextFrameTimestamp_ << " " << currentFrameTimestamp_ << " ";
-			}
-
-			// add 1second/framerate time for next loop pause
-			nextFrameTimestamp_ = nextFrameTimestamp_ +
-				boost::posix_time::microsec(1000000 / record_framerate_);
-
-			// reset time_duration so while loop engages
-			td_ = (currentFrameTimestamp_ - nextFrameTimestamp_);
-
-			//determine and print out delay in ms, should be less than 1000/FPS
-			//occasionally, if delay is larger than said value, correction will occur
-			//if delay is consistently larger than said value, then CPU is not powerful
-			// enough to capture/decompress/record/compress that fast.
-			finalLoopTimestamp_ = boost::posix_time::microsec_clock::local_time();
-			td1_ = (finalLoopTimestamp_ - initialLoopTimestamp_);
-			delayFound_ = td1_.total_milliseconds();
-			if (verbose_) {
-				std::cout << delayFound_ << std::endl;
+	{
+		// Test if the file manager exists
+		if (m_files_.find(it->first) != m_files_.end()) {
+			// If able to write to disk
+			if (m_files_[it->first]->push(it->second, timestamp_us) ==
+				kSuccess) {
+				result_out = true;
 			}
 		}
-		under_writing_ = false;
 	}
 	return result_out;
+}
+// ----------------------------------------------------------------------------
+bool FileGeneratorManagerAsync::procedure() {
 
-#endif
+	bool result_out = false;
+
+	std::lock_guard<std::mutex> lock_write(mutex_write_);
+	{
+		// Take the pending data. The producers can push the next one
+		// during the writing.
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!has_data_) return false;
+		std::swap(data_in_, data_write_);
+		data_write_timestamp_us_ = data_in_timestamp_us_;
+		has_data_ = false;
+		under_writing_ = true;
+		// The slot is used also if the write is forced by close
+		pacer_.acquire(FramePacer::Clock::now());
+	}
+
+	// determine time at start of write
+	FramePacer::Clock::time_point initial_time = FramePacer::Clock::now();
+
+	result_out = write_locked(data_write_, data_write_timestamp_us_);
+	// The buffers are kept for the next data
+	for (auto &it : data_write_) it.second.clear();
+
+	// The delay should be less than 1000/FPS ms. If it is consistently
+	// larger, the CPU or the disk is not fast enough (see pacing_stats).
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pacer_.record_delay(FramePacer::Clock::now() - initial_time);
+	}
+	under_writing_ = false;
+	return result_out;
 }
 // ----------------------------------------------------------------------------
 void FileGeneratorManagerAsync::check() {
 	std::cout << "FileGeneratorManagerAsync::check(): " << under_writing_ << 
-		std::endl;//" " << number_addframe_requests_ << std::endl;
+		" replaced: " << num_replaced() << std::endl;
 }
 // ----------------------------------------------------------------------------
 int FileGeneratorManagerAsync::push_data_write_not_guarantee_can_replace(
 	const std::map<int, std::vector<char> > &data_in) {
-
-	bool write_success = false;
-
-#ifdef BOOST_BUILD
-	if (!under_writing_) {
-		{
-			boost::mutex::scoped_lock lock(mutex_, boost::try_to_lock);
-			if (lock) {
-				//++number_addframe_requests_;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!continue_write_) return kFail;
 #if _MSC_VER && !__INTEL_COMPILER && (_MSC_VER > 1600)
-				for (auto it = data_in.begin(); it != data_in.end(); it++)
+		for (auto it = data_in.begin(); it != data_in.end(); it++)
 #else
-				for (std::map<int, std::vector<char> >::const_iterator it = data_in.begin(); it != data_in.end(); it++)
+		for (std::map<int, std::vector<char> >::const_iterator it = data_in.begin(); it != data_in.end(); it++)
 #endif		
-				{
-					data_in_[it->first] = it->second;
-				}
-				write_success = true;
-			}
+		{
+			std::vector<char> &pending = data_in_[it->first];
+			// The data not written yet is replaced
+			if (!pending.empty()) ++num_replaced_;
+			pending = it->second;
 		}
-
-		//boost::thread* thr = new boost::thread(
-		//	boost::bind(&FileGeneratorManagerAsync::procedure, this));
-		if (write_success) {
-			auto a = std::async(
-			    &FileGeneratorManagerAsync::procedure, this);
+		data_in_timestamp_us_ = DateTime::timestamp_us();
+		has_data_ = true;
+	}
+	cond_.notify_one();
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+int FileGeneratorManagerAsync::push_data_write_not_guarantee_can_replace(
+	std::map<int, std::vector<char> > &&data_in) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!continue_write_) return kFail;
+		for (auto &it : data_in) {
+			std::vector<char> &pending = data_in_[it.first];
+			// The data not written yet is replaced
+			if (!pending.empty()) ++num_replaced_;
+			pending = std::move(it.second);
 		}
-
-		// used only for test to detect lost frames
-		//container_future_.push(std::async(&FileGeneratorManagerAsync::procedure, this));
-		//return kSuccess;
+		data_in_timestamp_us_ = DateTime::timestamp_us();
+		has_data_ = true;
 	}
-#endif
-	//return kFail;
-	return write_success;
+	cond_.notify_one();
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+size_t FileGeneratorManagerAsync::num_replaced() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return num_replaced_;
+}
+// ----------------------------------------------------------------------------
+void FileGeneratorManagerAsync::set_queue_params(
+	const FileQueueParams &queue_params) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	queue_params_ = queue_params;
+	cond_space_.notify_all();
+}
+// ----------------------------------------------------------------------------
+int FileGeneratorManagerAsync::enqueue(
+	std::map<int, std::vector<char> > &&data_in) {
+	size_t bytes = 0;
+	for (auto &it : data_in) bytes += it.second.size();
+	int64_t timestamp_us = DateTime::timestamp_us();
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	// A data bigger than the budget is accepted when the queue is empty
+	auto has_space = [this, bytes] {
+		return queue_.empty() ||
+			((queue_params_.max_items == 0 ||
+				queue_.size() < queue_params_.max_items) &&
+			(queue_params_.max_bytes == 0 ||
+				queue_stats_.queued_bytes + bytes <= queue_params_.max_bytes));
+	};
+	if (continue_write_ && !has_space()) {
+		if (queue_params_.full_policy == FileQueueFullPolicy::Fail) {
+			++queue_stats_.rejected_pushes;
+			return kOutOfMemory;
+		}
+		++queue_stats_.blocked_pushes;
+		auto pred = [this, &has_space] {
+			return !continue_write_ || has_space(); };
+		if (queue_params_.block_timeout_ms < 0) {
+			cond_space_.wait(lock, pred);
+		} else if (!cond_space_.wait_for(lock, std::chrono::milliseconds(
+			queue_params_.block_timeout_ms), pred)) {
+			++queue_stats_.rejected_pushes;
+			return kOutOfMemory;
+		}
+	}
+	if (!continue_write_) {
+		++queue_stats_.rejected_pushes;
+		return kFail;
+	}
+	queue_.push_back(std::make_pair(timestamp_us, std::move(data_in)));
+	++queue_stats_.queued_items;
+	queue_stats_.queued_bytes += bytes;
+	if (queue_stats_.queued_bytes > queue_stats_.queued_bytes_high_water) {
+		queue_stats_.queued_bytes_high_water = queue_stats_.queued_bytes;
+	}
+	lock.unlock();
+	cond_.notify_one();
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+int FileGeneratorManagerAsync::push_data_write_guarantee(
+	const std::map<int, std::vector<char> > &data_in) {
+	return enqueue(std::map<int, std::vector<char> >(data_in));
+}
+// ----------------------------------------------------------------------------
+int FileGeneratorManagerAsync::push_data_write_guarantee(
+	std::map<int, std::vector<char> > &&data_in) {
+	return enqueue(std::move(data_in));
+}
+// ----------------------------------------------------------------------------
+int FileGeneratorManagerAsync::push_gather(int id, const RecordSlice *slices,
+	size_t num_slices, bool guarantee) {
+	if (!guarantee) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!continue_write_) return kFail;
+			std::vector<char> &pending = data_in_[id];
+			// The data not written yet is replaced
+			if (!pending.empty()) ++num_replaced_;
+			gather(slices, num_slices, pending);
+			data_in_timestamp_us_ = DateTime::timestamp_us();
+			has_data_ = true;
+		}
+		cond_.notify_one();
+		return kSuccess;
+	}
+	std::map<int, std::vector<char> > data;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		// The first push of the writer registers its pool
+		std::vector<std::map<int, std::vector<char> > > &pool =
+			data_pool_[id];
+		if (!pool.empty()) {
+			data = std::move(pool.back());
+			pool.pop_back();
+		}
+	}
+	// A recycled container has only the key of this writer
+	gather(slices, num_slices, data[id]);
+	return enqueue(std::move(data));
+}
+// ----------------------------------------------------------------------------
+void FileGeneratorManagerAsync::recycle(
+	std::map<int, std::vector<char> > &&data) {
+	for (auto &it : data) {
+		auto pool = data_pool_.find(it.first);
+		if (pool == data_pool_.end()) continue;
+		// The pool is not larger than the queue
+		if (queue_params_.max_items > 0 &&
+			pool->second.size() >= queue_params_.max_items) {
+			continue;
+		}
+		// The keys of the other writers are erased, else they would be
+		// pushed again as empty data
+		int id = it.first;
+		for (auto jt = data.begin(); jt != data.end();) {
+			if (jt->first != id) {
+				jt = data.erase(jt);
+			} else {
+				++jt;
+			}
+		}
+		data.begin()->second.clear();
+		pool->second.push_back(std::move(data));
+		return;
+	}
+}
+// ----------------------------------------------------------------------------
+FileQueueStats FileGeneratorManagerAsync::queue_stats() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return queue_stats_;
+}
+// ----------------------------------------------------------------------------
+void FileGeneratorManagerAsync::set_group_commit(size_t flush_bytes,
+	int flush_interval_ms) {
+	std::lock_guard<std::mutex> lock_write(mutex_write_);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		flush_bytes_ = flush_bytes;
+		flush_interval_ms_ = flush_interval_ms;
+	}
+	for (auto &it : m_files_) {
+		it.second->set_group_commit(flush_bytes, flush_interval_ms);
+	}
+}
+// ----------------------------------------------------------------------------
+void FileGeneratorManagerAsync::set_pacing_policy(FramePacerPolicy policy,
+	size_t max_burst) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	pacing_policy_ = policy;
+	pacing_max_burst_ = max_burst;
+}
+// ----------------------------------------------------------------------------
+FramePacerStats FileGeneratorManagerAsync::pacing_stats() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return pacer_.stats();
+}
+// ----------------------------------------------------------------------------
+void FileGeneratorManagerAsync::set_segment_writer(bool use_segment,
+	bool direct_io) {
+	std::lock_guard<std::mutex> lock_write(mutex_write_);
+	use_segment_ = use_segment;
+	direct_io_ = direct_io;
+	for (auto &it : m_files_) {
+		it.second->set_segment_writer(use_segment, direct_io);
+	}
+}
+// ----------------------------------------------------------------------------
+void FileGeneratorManagerAsync::set_write_backend(
+	std::shared_ptr<AsyncWriteBackend> backend) {
+	std::lock_guard<std::mutex> lock_write(mutex_write_);
+	backend_ = backend;
+	for (auto &it : m_files_) {
+		it.second->set_write_backend(backend);
+	}
+}
+// ----------------------------------------------------------------------------
+void FileGeneratorManagerAsync::set_indexed_format(bool indexed) {
+	std::lock_guard<std::mutex> lock_write(mutex_write_);
+	indexed_ = indexed;
+	for (auto &it : m_files_) {
+		it.second->set_indexed_format(indexed,
+			static_cast<uint32_t>(it.first));
+	}
+}
+// ----------------------------------------------------------------------------
+void FileGeneratorManagerAsync::set_file_header(int id,
+	const std::vector<char> &header) {
+	std::lock_guard<std::mutex> lock_write(mutex_write_);
+	file_headers_[id] = header;
+	auto it = m_files_.find(id);
+	if (it != m_files_.end()) it->second->set_file_header(header);
+}
+// ----------------------------------------------------------------------------
+int FileGeneratorManagerAsync::sync() {
+	std::lock_guard<std::mutex> lock_write(mutex_write_);
+	int return_status = kSuccess;
+	for (auto &it : m_files_) {
+		if (it.second->sync() != kSuccess) return_status = kFail;
+	}
+	return return_status;
 }
 // ----------------------------------------------------------------------------
 void FileGeneratorManagerAsync::close() {
-#ifdef BOOST_BUILD
-	while (under_writing_ ){ //|| number_addframe_requests_ > 0) {
-		//std::cout << under_writing_ << " " << number_addframe_requests_ << std::endl;
-		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	// The writer saves the pending and queued data before to quit
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		continue_write_ = false;
 	}
-#endif
+	cond_.notify_all();
+	cond_space_.notify_all();
+	if (thread_writer_.joinable()) thread_writer_.join();
 
+	std::lock_guard<std::mutex> lock_write(mutex_write_);
 #if _MSC_VER && !__INTEL_COMPILER && (_MSC_VER > 1600)
 	for (auto it = m_files_.begin(); it != m_files_.end(); it++)
 #else
@@ -326,14 +835,20 @@ void FileGeneratorManagerAsync::close() {
 		delete it->second;
 	}
 	m_files_.clear();
-
-	// used only for test to detect lost frames
-	//// Container with the future result
-	//while (!container_future_.empty())
-	//{
-	//	std::cout << "res:" << container_future_.front().get() << std::endl;
-	//	container_future_.pop();
-	//}
+}
+// ----------------------------------------------------------------------------
+void FileGeneratorManagerAsync::make_unique_appendix(std::string &appendix) {
+	// The files created in the same second are numbered, so the previous
+	// file is not overwritten
+	if (appendix == last_appendix_) {
+		++num_same_appendix_;
+	} else {
+		last_appendix_ = appendix;
+		num_same_appendix_ = 0;
+	}
+	if (num_same_appendix_ > 0) {
+		appendix += "_" + std::to_string(num_same_appendix_);
+	}
 }
 // ----------------------------------------------------------------------------
 void FileGeneratorManagerAsync::set_verbose(bool verbose) {
@@ -27,6 +27,8 @@ namespace storedata
 
 // ----------------------------------------------------------------------------
 MemorizeVideoManager::MemorizeVideoManager() {
+	interpolation_ = cv::INTER_LINEAR;
+	num_resized_ = 0;
 }
 // ----------------------------------------------------------------------------
 MemorizeVideoManager::~MemorizeVideoManager() {
@@ -34,7 +36,7 @@ MemorizeVideoManager::~MemorizeVideoManager() {
 }
 // ----------------------------------------------------------------------------
 void MemorizeVideoManager::release() {
-	video_.release();
+	if (encoder_) encoder_->release();
 }
 // ----------------------------------------------------------------------------
 void MemorizeVideoManager::setup(unsigned int memory_max_allocable,
@@ -47,37 +49,36 @@ void MemorizeVideoManager::setup(unsigned int memory_max_allocable,
 	height_ = height;
 	width_ = width;
 	framerate_ = framerate;
-#if CV_MAJOR_VERSION == 4
-	video_encoder_ = cv::VideoWriter::fourcc('D', 'I', 'V', 'X');
-#else
-	video_encoder_ = CV_FOURCC('D', 'I', 'V', 'X');
-#endif
 }
 // ----------------------------------------------------------------------------
 void MemorizeVideoManager::setup_metaframe(cv::Mat &meta_frame) {
 	meta_frame_ = meta_frame.clone();
 	// if the meta frame is not empty, add at the beginning
-	if (!meta_frame_.empty() &&
-		video_.isOpened()) {
-		video_ << meta_frame_;
+	if (!meta_frame_.empty() && is_open() &&
+		encoder_->write(meta_frame_) == kSuccess) {
 		++frames_expected_allocated_;
 	}
 }
 // ----------------------------------------------------------------------------
 int MemorizeVideoManager::generate(const std::string &appendix) {
-	if (!video_.isOpened())
+	if (!is_open())
 	{
-	//if (!video_) {
-		std::string filename = filename_ + appendix + ".avi";
+		// The parameters may be changed since the previous video
+		encoder_ = create_video_encoder(encoder_params_);
+		// the encoder could not be created
+		if (!encoder_) return kFail;
+		std::string filename = filename_ + appendix +
+			encoder_->dot_extension();
 		std::cout << filename << std::endl;
-		// get the current time
-		video_ = cv::VideoWriter(filename, 
-			video_encoder_, 
-			framerate_, cv::Size(width_, height_));
 		frames_expected_allocated_ = 0;
+		// the codec or the path is not available
+		if (encoder_->open(filename, cv::Size(width_, height_),
+			framerate_) != kSuccess) {
+			return kFail;
+		}
 		// if the meta frame is not empty, add at the beginning
-		if (!meta_frame_.empty()) {
-			video_ << meta_frame_;
+		if (!meta_frame_.empty() &&
+			encoder_->write(meta_frame_) == kSuccess) {
 			++frames_expected_allocated_;
 		}
 		return kSuccess;
@@ -93,14 +94,17 @@ int MemorizeVideoManager::check_memory(const cv::Mat &image) {
 }
 // ----------------------------------------------------------------------------
 int MemorizeVideoManager::push(const cv::Mat &image) {
-	if (video_.isOpened()) {
+	if (is_open()) {
 		if (check_memory(image)) {
-			cv::Mat image_tmp = image;
+			// The destination of the resize is reused
+			const cv::Mat *image_tmp = &image;
 			if (image.size() != cv::Size(width_, height_)) {
-				cv::resize(image, image_tmp, cv::Size(width_, height_));
+				cv::resize(image, resized_, cv::Size(width_, height_), 0, 0,
+					interpolation_);
+				image_tmp = &resized_;
+				++num_resized_;
 			}
-			//(*video_) << image_tmp;
-			video_ << image_tmp;
+			if (encoder_->write(*image_tmp) != kSuccess) return kFail;
 			// Add the expected image size (raw)
 			//memory_expected_allocated_ += image.cols * image.rows * 
 			//image.channels();
@@ -117,12 +121,44 @@ int MemorizeVideoManager::push(const cv::Mat &image) {
 }
 // ----------------------------------------------------------------------------
 void MemorizeVideoManager::set_video_encoder(int video_encoder) {
-	video_encoder_ = video_encoder;
+	encoder_params_.fourcc = video_encoder;
+}
+// ----------------------------------------------------------------------------
+void MemorizeVideoManager::set_encoder_params(
+	const VideoEncoderParams &params) {
+	encoder_params_ = params;
+}
+// ----------------------------------------------------------------------------
+const VideoEncoderParams& MemorizeVideoManager::encoder_params() const {
+	return encoder_params_;
+}
+// ----------------------------------------------------------------------------
+bool MemorizeVideoManager::is_open() const {
+	return encoder_ && encoder_->is_open();
+}
+// ----------------------------------------------------------------------------
+void MemorizeVideoManager::set_interpolation(int interpolation) {
+	interpolation_ = interpolation;
+}
+// ----------------------------------------------------------------------------
+size_t MemorizeVideoManager::num_resized() const {
+	return num_resized_;
+}
+// ----------------------------------------------------------------------------
+cv::Size MemorizeVideoManager::size() const {
+	return cv::Size(width_, height_);
 }
 // ----------------------------------------------------------------------------
 VideoGeneratorManagerAsync::VideoGeneratorManagerAsync() {
 	verbose_ = false;
-	under_writing_ = false;
+	record_framerate_ = -1;
+	queue_size_ = 2;
+	num_frames_ = 0;
+	max_frames_ = 0;
+	has_metaframe_ = false;
+	num_same_appendix_ = 0;
+	pacing_policy_ = FramePacerPolicy::Skip;
+	pacing_max_burst_ = 1;
 }
 // ----------------------------------------------------------------------------
 VideoGeneratorManagerAsync::~VideoGeneratorManagerAsync() {
@@ -133,27 +169,28 @@ int VideoGeneratorManagerAsync::setup(
 	unsigned int max_memory_allocable_forvideo,
 	std::map<int, VideoGeneratorParams> &vgp, 
 	int record_framerate) {
+	close();
 
 	int return_status = 1;
 
+	std::lock_guard<std::mutex> lock(mutex_);
+
 	// set framerate to record and capture at
 	record_framerate_ = record_framerate;
 
-	// initialize initial timestamps
-	nextFrameTimestamp_ = boost::posix_time::microsec_clock::local_time();
-	currentFrameTimestamp_ = nextFrameTimestamp_;
-	td_ = (currentFrameTimestamp_ - nextFrameTimestamp_);
+	// The first frame is written without wait
+	pacer_.setup(record_framerate_, pacing_policy_, pacing_max_burst_);
+	closed_delay_ = WriteDelay();
 
 	// Get the appendix to add to the video
-	std::string appendix = storedata::DateTime::time2string();
-	for (int i = 0; i < appendix.length(); i++)
-	{
-		if (appendix[i] == ':') appendix[i] = '_';
-	}
+	appendix_ = std::make_shared<const std::string>(make_appendix());
 	// callback to inform that a new file will be created
 	if (callback_createfile_) {
-		callback_createfile_(appendix);
+		callback_createfile_(*appendix_);
 	}
+	num_frames_ = 0;
+	max_frames_ = max_memory_allocable_forvideo;
+	has_metaframe_ = false;
 
 	// Create the video writer
 	for (auto it = vgp.begin(); it != vgp.end(); it++) {
@@ -161,170 +198,283 @@ int VideoGeneratorManagerAsync::setup(
 		video_[it->first]->setup(max_memory_allocable_forvideo,
 			it->second.filename(), it->second.width(),
 			it->second.height(), it->second.video_framerate());
-		if (!video_[it->first]->generate(appendix)) {
+		video_[it->first]->set_interpolation(resize_params_.interpolation);
+		video_[it->first]->set_encoder_params(encoder_params_);
+		if (!video_[it->first]->generate(*appendix_)) {
 			return_status = 0;
 		}
+		// One writer for each source
+		std::unique_ptr<VideoSource> source(new VideoSource());
+		source->video = video_[it->first];
+		source->appendix = appendix_;
+		source->is_running = true;
+		source->queue_size = queue_size_;
+		source->thr = std::thread(&VideoGeneratorManagerAsync::writer_thread,
+			this, source.get());
+		sources_[it->first] = std::move(source);
 	}
 
-	//number_addframe_requests_ = 0;
-	under_writing_ = false;
 	return return_status;
 }
 // ----------------------------------------------------------------------------
 void VideoGeneratorManagerAsync::setup_metaframe(cv::Mat &meta_frame) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	has_metaframe_ = !meta_frame.empty();
 	for (auto &it : video_) {
 		it.second->setup_metaframe(meta_frame);
 	}
 }
 // ----------------------------------------------------------------------------
 bool VideoGeneratorManagerAsync::under_writing() {
-	return under_writing_;
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto &it : sources_) {
+		std::lock_guard<std::mutex> lock_source(it.second->mtx);
+		if (it.second->queue.size() >= it.second->queue_size) return true;
+	}
+	return false;
 }
 // ----------------------------------------------------------------------------
-bool VideoGeneratorManagerAsync::procedure() {
-
-	bool result_out = false;
-
-    boost::mutex::scoped_lock lock(mutex_, boost::try_to_lock);
-    if (lock) {
-		under_writing_ = true;
-
-		//determine current elapsed time
-		currentFrameTimestamp_ = boost::posix_time::microsec_clock::local_time();
-		td_ = (currentFrameTimestamp_ - nextFrameTimestamp_);
-
-		// wait for X microseconds until 1second/framerate time has passed after previous frame write
-		if (record_framerate_ < 0 ||
-			td_.total_microseconds() >= 1000000 / record_framerate_){
-
-			//	 determine time at start of write
-			initialLoopTimestamp_ = boost::posix_time::microsec_clock::local_time();
-
-			// Check the memory
-			bool memory_ok = true;
-			for (auto it = frame_.begin(); it != frame_.end(); it++)
-			{
-				// Test the videos
-				if (video_.find(it->first) != video_.end()) {
-					if (!video_[it->first]->check_memory(it->second)) {
-						memory_ok = false;
-						break;
-					}
-				}
-			}
-			// At least one video has not enough memory.
-			// Close all the videos and create a new one
-			if (!memory_ok) {
-				// Get the appendix to add to the video
-				std::string appendix = storedata::DateTime::time2string();
-				for (int i = 0; i < appendix.length(); i++)
-				{
-					if (appendix[i] == ':') appendix[i] = '_';
-				}
-				// callback to inform that a new file will be created
-				if (callback_createfile_) {
-					callback_createfile_(appendix);
-				}
-				//std::cout << "Memory failed: " << appendix << std::endl;
-
-				for (auto it = video_.begin(); it != video_.end(); it++)
-				{
-					it->second->release();
-					it->second->generate(appendix);
-				}
-			}
-
-			// Add the frame
-			for (auto it = frame_.begin(); it != frame_.end(); it++)
-			{
-				// Test the videos
-				if (video_.find(it->first) != video_.end()) {
-					if (video_[it->first]->push(it->second) ==
-						kSuccess) {
-						result_out = true;
-					}
-				}
-			}
-
-			//write previous and current frame timestamp to console
-			if (verbose_) {
-				std::cout << nextFrameTimestamp_ << " " << currentFrameTimestamp_ << " ";
-			}
-
-			// add 1second/framerate time for next loop pause
-			nextFrameTimestamp_ = nextFrameTimestamp_ + 
-				boost::posix_time::microsec(1000000 / record_framerate_);
+void VideoGeneratorManagerAsync::writer_thread(VideoSource *source) {
+	std::unique_lock<std::mutex> lock(source->mtx);
+	while (true) {
+		if (source->queue.empty()) {
+			// Close requested and the queue is written
+			if (!source->is_running) break;
+			source->cond.wait(lock);
+			continue;
+		}
+		VideoItem item = std::move(source->queue.front());
+		source->queue.pop_front();
+		lock.unlock();
 
-			// reset time_duration so while loop engages
-			td_ = (currentFrameTimestamp_ - nextFrameTimestamp_);
+		//	 determine time at start of write
+		FramePacer::Clock::time_point initial_time = FramePacer::Clock::now();
 
-			//determine and print out delay in ms, should be less than 1000/FPS
-			//occasionally, if delay is larger than said value, correction will occur
-			//if delay is consistently larger than said value, then CPU is not powerful
-			// enough to capture/decompress/record/compress that fast.
-			finalLoopTimestamp_ = boost::posix_time::microsec_clock::local_time();
-			td1_ = (finalLoopTimestamp_ - initialLoopTimestamp_);
-			delayFound_ = td1_.total_milliseconds();
-			if (verbose_) {
-				std::cout << delayFound_ << std::endl;
-			}
+		// The first frame of the new appendix closes the current video
+		if (item.appendix != source->appendix) {
+			source->video->release();
+			source->video->generate(*item.appendix);
+			source->appendix = item.appendix;
 		}
-		under_writing_ = false;
-	} 
-	//--number_addframe_requests_;
+		source->video->push(item.frame);
 
-	return result_out;
+		lock.lock();
+		// The delay should be less than 1000/FPS ms. If it is consistently
+		// larger, the CPU is not powerful enough to record/compress that
+		// fast (see pacing_stats).
+		source->delay.add(initial_time, FramePacer::Clock::now());
+		if (source->pool.size() < source->queue_size) {
+			source->pool.push_back(std::move(item.frame));
+		}
+	}
 }
 // ----------------------------------------------------------------------------
 void VideoGeneratorManagerAsync::check() {
-	std::cout << "push " << under_writing_ << std::endl;//" " << number_addframe_requests_ << std::endl;
+	std::cout << "push " << under_writing() << " replaced: " <<
+		num_replaced() << std::endl;
 }
 // ----------------------------------------------------------------------------
 int VideoGeneratorManagerAsync::push_data_write_not_guarantee_can_replace(
 	const std::map<int, cv::Mat> &frame) {
+	// The lock is held for the whole push, so the frames of the same
+	// appendix are queued together in all the sources
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (sources_.empty()) return false;
+	// the frames before the slot of the next write are dropped
+	if (!pacer_.try_acquire(FramePacer::Clock::now())) return false;
 
-	bool write_success = false;
+	// The videos are full, all the sources move to the new appendix
+	size_t max_frames = has_metaframe_ && max_frames_ > 0 ? max_frames_ - 1 :
+		max_frames_;
+	if (num_frames_ >= max_frames) {
+		appendix_ = std::make_shared<const std::string>(make_appendix());
+		// callback to inform that a new file will be created
+		if (callback_createfile_) {
+			callback_createfile_(*appendix_);
+		}
+		num_frames_ = 0;
+	}
+	++num_frames_;
 
-	if (!under_writing_) {
-		{
-			boost::mutex::scoped_lock lock(mutex_, boost::try_to_lock);
-			if (lock) {
-				//++number_addframe_requests_;
-				for (auto it = frame.begin(); it != frame.end(); it++)
-				{
-					frame_[it->first] = it->second.clone();
+	push_frames_.clear();
+	for (auto it = frame.begin(); it != frame.end(); it++)
+	{
+		auto source_it = sources_.find(it->first);
+		if (source_it == sources_.end()) continue;
+		push_frames_.push_back(std::make_pair(source_it->second.get(),
+			&it->second));
+	}
+
+	bool write_success = false;
+#if CV_MAJOR_VERSION >= 4
+	// The sources are copied (and resized) in parallel
+	if (resize_params_.at_push && resize_params_.parallel &&
+		push_frames_.size() > 1) {
+		std::atomic<bool> is_queued(false);
+		cv::parallel_for_(cv::Range(0, static_cast<int>(push_frames_.size())),
+			[&](const cv::Range &range) {
+			for (int i = range.start; i < range.end; ++i) {
+				if (enqueue(*push_frames_[i].first, *push_frames_[i].second)) {
+					is_queued = true;
 				}
-				write_success = true;
 			}
-		}
-		//boost::thread* thr = new boost::thread(
-		//	boost::bind(&FileGeneratorManagerAsync::procedure, this));
-		if (write_success) {
-			boost::thread* thr = new boost::thread(
-				boost::bind(&VideoGeneratorManagerAsync::procedure, this));
-		}
+		});
+		return is_queued;
+	}
+#endif
+	for (auto &it : push_frames_) {
+		if (enqueue(*it.first, *it.second)) write_success = true;
 	}
 	return write_success;
 }
 // ----------------------------------------------------------------------------
+bool VideoGeneratorManagerAsync::enqueue(VideoSource &source,
+	const cv::Mat &frame) {
+	std::lock_guard<std::mutex> lock_source(source.mtx);
+	if (!source.is_running) return false;
+	VideoItem item;
+	if (source.queue.size() >= source.queue_size) {
+		// The oldest frame is replaced
+		item = std::move(source.queue.front());
+		source.queue.pop_front();
+		++source.num_replaced;
+	} else if (!source.pool.empty()) {
+		item.frame = std::move(source.pool.back());
+		source.pool.pop_back();
+	}
+	// The buffer of the reused frame is kept if the size is the same
+	cv::Size size = source.video->size();
+	if (resize_params_.at_push && frame.size() != size) {
+		cv::resize(frame, item.frame, size, 0, 0,
+			resize_params_.interpolation);
+		++source.num_resized;
+	} else {
+		frame.copyTo(item.frame);
+	}
+	item.appendix = appendix_;
+	source.queue.push_back(std::move(item));
+	source.cond.notify_one();
+	return true;
+}
+// ----------------------------------------------------------------------------
 void VideoGeneratorManagerAsync::close() {
-	while (under_writing_ ){ //|| number_addframe_requests_ > 0) {
-		//std::cout << under_writing_ << " " << number_addframe_requests_ << std::endl;
-		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	std::map<int, std::unique_ptr<VideoSource> > sources;
+	std::map<int, MemorizeVideoManager* > video;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		sources.swap(sources_);
+		video.swap(video_);
+	}
+	// The writers save the queued frames before to quit
+	for (auto &it : sources) {
+		{
+			std::lock_guard<std::mutex> lock(it.second->mtx);
+			it.second->is_running = false;
+		}
+		it.second->cond.notify_all();
+	}
+	for (auto &it : sources) {
+		if (it.second->thr.joinable()) it.second->thr.join();
 	}
-	for (auto it = video_.begin(); it != video_.end(); it++)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto &it : sources) {
+			closed_delay_.merge(it.second->delay);
+		}
+	}
+	for (auto it = video.begin(); it != video.end(); it++)
 	{
 		delete it->second;
 	}
-	video_.clear();
 }
 // ----------------------------------------------------------------------------
 void VideoGeneratorManagerAsync::set_verbose(bool verbose) {
 	verbose_ = verbose;
 }
 // ----------------------------------------------------------------------------
+void VideoGeneratorManagerAsync::set_pacing_policy(FramePacerPolicy policy,
+	size_t max_burst) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	pacing_policy_ = policy;
+	pacing_max_burst_ = max_burst;
+}
+// ----------------------------------------------------------------------------
+FramePacerStats VideoGeneratorManagerAsync::pacing_stats() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	FramePacerStats stats = pacer_.stats();
+	// The writers keep their own delays
+	WriteDelay delay = closed_delay_;
+	for (auto &it : sources_) {
+		std::lock_guard<std::mutex> lock_source(it.second->mtx);
+		delay.merge(it.second->delay);
+	}
+	stats.last_delay_us = delay.last_us;
+	stats.max_delay_us = delay.max_us;
+	stats.mean_delay_us = delay.num_writes > 0 ?
+		static_cast<double>(delay.total_us) / delay.num_writes : 0;
+	return stats;
+}
+// ----------------------------------------------------------------------------
+void VideoGeneratorManagerAsync::set_queue_size(size_t queue_size) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	queue_size_ = (std::max)(static_cast<size_t>(1), queue_size);
+}
+// ----------------------------------------------------------------------------
+size_t VideoGeneratorManagerAsync::num_replaced() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	size_t num_replaced = 0;
+	for (auto &it : sources_) {
+		std::lock_guard<std::mutex> lock_source(it.second->mtx);
+		num_replaced += it.second->num_replaced;
+	}
+	return num_replaced;
+}
+// ----------------------------------------------------------------------------
+void VideoGeneratorManagerAsync::set_resize_params(
+	const VideoResizeParams &params) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	resize_params_ = params;
+}
+// ----------------------------------------------------------------------------
+size_t VideoGeneratorManagerAsync::num_resized() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	size_t num_resized = 0;
+	for (auto &it : sources_) {
+		std::lock_guard<std::mutex> lock_source(it.second->mtx);
+		num_resized += it.second->num_resized + it.second->video->num_resized();
+	}
+	return num_resized;
+}
+// ----------------------------------------------------------------------------
+void VideoGeneratorManagerAsync::set_encoder_params(
+	const VideoEncoderParams &params) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	encoder_params_ = params;
+}
+// ----------------------------------------------------------------------------
+std::string VideoGeneratorManagerAsync::make_appendix() {
+	std::string appendix = storedata::DateTime::time2string();
+	for (size_t i = 0; i < appendix.length(); i++)
+	{
+		if (appendix[i] == ':') appendix[i] = '_';
+	}
+	// The videos created in the same second are numbered, so the previous
+	// video is not overwritten
+	if (appendix == last_appendix_) {
+		++num_same_appendix_;
+	} else {
+		last_appendix_ = appendix;
+		num_same_appendix_ = 0;
+	}
+	if (num_same_appendix_ > 0) {
+		appendix += "_" + std::to_string(num_same_appendix_);
+	}
+	return appendix;
+}
+// ----------------------------------------------------------------------------
 void VideoGeneratorManagerAsync::set_callback_createfile(
 	cbk_fname_changed callback_createfile) {
+	std::lock_guard<std::mutex> lock(mutex_);
 	callback_createfile_ = callback_createfile;
 }
 
@@ -0,0 +1,217 @@
+/* @file fixed_slot_file.cpp
+ * @brief Implementation of the fixed slot frames file.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include "record/inc/record/fixed_slot_file.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+namespace storedata
+{
+
+namespace
+{
+const char kHeaderMagic[] = "SDFIXSLT";
+/** @brief Bytes of the header fields (before the padding)
+*/
+const size_t kHeaderFieldsBytes = 8 + 4 + 4 * 3 + 8 * 4;
+
+void put_uint(char *out, uint64_t v, size_t bytes) {
+	for (size_t i = 0; i < bytes; ++i) {
+		out[i] = static_cast<char>((v >> (8 * i)) & 0xff);
+	}
+}
+
+uint64_t get_uint(const char *in, size_t bytes) {
+	uint64_t v = 0;
+	for (size_t i = 0; i < bytes; ++i) {
+		v |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) <<
+			(8 * i);
+	}
+	return v;
+}
+
+size_t align_up(size_t size, size_t alignment) {
+	return (size + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+const uint32_t FixedSlotFile::kVersion;
+const size_t FixedSlotFile::kMagicBytes;
+const size_t FixedSlotFile::kSlotHeaderBytes;
+
+// ----------------------------------------------------------------------------
+FixedSlotLayout FixedSlotFile::make_layout(int cols, int rows, int type,
+	size_t max_msg_bytes, size_t alignment) {
+	alignment = (std::max)(static_cast<size_t>(1), alignment);
+	FixedSlotLayout layout;
+	layout.cols = cols;
+	layout.rows = rows;
+	layout.type = type;
+	layout.image_bytes = static_cast<size_t>(cols) * rows *
+		CV_ELEM_SIZE(type);
+	layout.max_msg_bytes = max_msg_bytes;
+	layout.header_bytes = align_up(kHeaderFieldsBytes, alignment);
+	layout.stride = align_up(kSlotHeaderBytes + layout.image_bytes +
+		max_msg_bytes, alignment);
+	return layout;
+}
+// ----------------------------------------------------------------------------
+void FixedSlotFile::write_header(const FixedSlotLayout &layout,
+	std::vector<char> &out) {
+	out.assign(layout.header_bytes, 0);
+	size_t pos = 0;
+	memcpy(&out[pos], kHeaderMagic, kMagicBytes);
+	pos += kMagicBytes;
+	put_uint(&out[pos], kVersion, 4);
+	pos += 4;
+	put_uint(&out[pos], static_cast<uint32_t>(layout.cols), 4);
+	pos += 4;
+	put_uint(&out[pos], static_cast<uint32_t>(layout.rows), 4);
+	pos += 4;
+	put_uint(&out[pos], static_cast<uint32_t>(layout.type), 4);
+	pos += 4;
+	put_uint(&out[pos], layout.image_bytes, 8);
+	pos += 8;
+	put_uint(&out[pos], layout.max_msg_bytes, 8);
+	pos += 8;
+	put_uint(&out[pos], layout.stride, 8);
+	pos += 8;
+	put_uint(&out[pos], layout.header_bytes, 8);
+}
+// ----------------------------------------------------------------------------
+void FixedSlotFile::write_slot_header(int64_t timestamp_us,
+	uint64_t msg_size, char *out) {
+	put_uint(out, static_cast<uint64_t>(timestamp_us), 8);
+	put_uint(out + 8, msg_size, 8);
+}
+// ----------------------------------------------------------------------------
+bool FixedSlotFile::is_fixed_slot_file(const std::string &filename) {
+	std::ifstream fin(filename.c_str(), std::ios::binary);
+	char magic[kMagicBytes];
+	return fin.read(magic, kMagicBytes) &&
+		memcmp(magic, kHeaderMagic, kMagicBytes) == 0;
+}
+// ----------------------------------------------------------------------------
+FixedSlotReader::FixedSlotReader() {
+	num_frames_ = 0;
+}
+// ----------------------------------------------------------------------------
+int FixedSlotReader::open(const std::string &filename) {
+	close();
+	int return_status = file_.open(filename);
+	if (return_status != kSuccess) return return_status;
+	const char *data = file_.data();
+	if (file_.size() < kHeaderFieldsBytes ||
+		memcmp(data, kHeaderMagic, FixedSlotFile::kMagicBytes) != 0) {
+		close();
+		return kFail;
+	}
+	size_t pos = FixedSlotFile::kMagicBytes + 4;
+	layout_.cols = static_cast<int>(get_uint(data + pos, 4));
+	pos += 4;
+	layout_.rows = static_cast<int>(get_uint(data + pos, 4));
+	pos += 4;
+	layout_.type = static_cast<int>(get_uint(data + pos, 4));
+	pos += 4;
+	layout_.image_bytes = static_cast<size_t>(get_uint(data + pos, 8));
+	pos += 8;
+	layout_.max_msg_bytes = static_cast<size_t>(get_uint(data + pos, 8));
+	pos += 8;
+	layout_.stride = static_cast<size_t>(get_uint(data + pos, 8));
+	pos += 8;
+	layout_.header_bytes = static_cast<size_t>(get_uint(data + pos, 8));
+	if (layout_.stride < FixedSlotFile::kSlotHeaderBytes +
+		layout_.image_bytes + layout_.max_msg_bytes ||
+		layout_.header_bytes < kHeaderFieldsBytes ||
+		layout_.header_bytes > file_.size()) {
+		close();
+		return kFail;
+	}
+
+	// The slots are written in order: the first not written slot (i.e.
+	// preallocated segment) is found by binary search
+	size_t lo = 0;
+	size_t hi = (file_.size() - layout_.header_bytes) / layout_.stride;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (timestamp(mid) != 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	num_frames_ = lo;
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+void FixedSlotReader::close() {
+	file_.close();
+	layout_ = FixedSlotLayout();
+	num_frames_ = 0;
+}
+// ----------------------------------------------------------------------------
+const FixedSlotLayout& FixedSlotReader::layout() const {
+	return layout_;
+}
+// ----------------------------------------------------------------------------
+size_t FixedSlotReader::size() const {
+	return num_frames_;
+}
+// ----------------------------------------------------------------------------
+bool FixedSlotReader::frame(size_t index, cv::Mat &image, RecordView &msg,
+	int64_t &timestamp_us) const {
+	if (index >= num_frames_) return false;
+	const char *slot = file_.data() + layout_.header_bytes +
+		index * layout_.stride;
+	timestamp_us = static_cast<int64_t>(get_uint(slot, 8));
+	size_t msg_size = static_cast<size_t>(get_uint(slot + 8, 8));
+	if (msg_size > layout_.max_msg_bytes) return false;
+	const char *img_data = slot + FixedSlotFile::kSlotHeaderBytes;
+	image = cv::Mat(layout_.rows, layout_.cols, layout_.type,
+		const_cast<char*>(img_data));
+	msg = RecordView(img_data + layout_.image_bytes, msg_size);
+	return true;
+}
+// ----------------------------------------------------------------------------
+int64_t FixedSlotReader::find_time(int64_t timestamp_us) const {
+	size_t lo = 0, hi = num_frames_;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (timestamp(mid) < timestamp_us) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == num_frames_) return -1;
+	return static_cast<int64_t>(lo);
+}
+// ----------------------------------------------------------------------------
+int64_t FixedSlotReader::timestamp(size_t index) const {
+	const char *slot = file_.data() + layout_.header_bytes +
+		index * layout_.stride;
+	return static_cast<int64_t>(get_uint(slot, 8));
+}
+
+} // namespace storedata
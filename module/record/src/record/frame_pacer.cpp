@@ -0,0 +1,106 @@
+/* @file frame_pacer.cpp
+ * @brief Implementation of the frame rate limiter.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include "record/inc/record/frame_pacer.hpp"
+
+#include <algorithm>
+
+namespace storedata
+{
+
+// ----------------------------------------------------------------------------
+FramePacer::FramePacer() {
+	policy_ = FramePacerPolicy::Skip;
+	max_burst_ = 1;
+	period_ = Clock::duration::zero();
+	reset();
+}
+// ----------------------------------------------------------------------------
+void FramePacer::setup(double framerate, FramePacerPolicy policy,
+	size_t max_burst) {
+	policy_ = policy;
+	max_burst_ = (std::max)(static_cast<size_t>(1), max_burst);
+	period_ = Clock::duration::zero();
+	if (framerate > 0) {
+		period_ = std::chrono::duration_cast<Clock::duration>(
+			std::chrono::duration<double>(1.0 / framerate));
+	}
+	reset();
+}
+// ----------------------------------------------------------------------------
+void FramePacer::reset() {
+	next_ = Clock::now();
+	stats_ = FramePacerStats();
+	total_delay_us_ = 0;
+	num_delays_ = 0;
+}
+// ----------------------------------------------------------------------------
+bool FramePacer::is_enabled() const {
+	return period_ > Clock::duration::zero();
+}
+// ----------------------------------------------------------------------------
+FramePacer::Clock::time_point FramePacer::next_time() const {
+	return next_;
+}
+// ----------------------------------------------------------------------------
+bool FramePacer::try_acquire(Clock::time_point now) {
+	if (is_enabled() && now < next_) return false;
+	acquire(now);
+	return true;
+}
+// ----------------------------------------------------------------------------
+void FramePacer::acquire(Clock::time_point now) {
+	++stats_.num_frames;
+	if (!is_enabled()) return;
+	if (now - next_ >= period_) {
+		++stats_.num_late;
+		// The slots behind the allowed burst are lost
+		Clock::time_point oldest = policy_ == FramePacerPolicy::CatchUp ?
+			now - period_ * static_cast<int64_t>(max_burst_ - 1) : now;
+		if (oldest > next_) {
+			stats_.num_skipped += static_cast<size_t>((oldest - next_) /
+				period_);
+			next_ = oldest;
+		}
+	}
+	next_ += period_;
+}
+// ----------------------------------------------------------------------------
+void FramePacer::record_delay(Clock::duration delay) {
+	int64_t delay_us = std::chrono::duration_cast<std::chrono::microseconds>(
+		delay).count();
+	stats_.last_delay_us = delay_us;
+	stats_.max_delay_us = (std::max)(stats_.max_delay_us, delay_us);
+	total_delay_us_ += delay_us;
+	++num_delays_;
+}
+// ----------------------------------------------------------------------------
+FramePacerStats FramePacer::stats() const {
+	FramePacerStats stats = stats_;
+	if (num_delays_ > 0) {
+		stats.mean_delay_us = static_cast<double>(total_delay_us_) /
+			num_delays_;
+	}
+	return stats;
+}
+
+} // namespace storedata
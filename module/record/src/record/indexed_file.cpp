@@ -0,0 +1,301 @@
+/* @file indexed_file.cpp
+ * @brief Implementation of the indexed container format.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include "record/inc/record/indexed_file.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace storedata
+{
+
+namespace
+{
+const char kHeaderMagic[] = "SDRECIDX";
+const char kTrailerMagic[] = "SDRECEND";
+
+void put_uint(char *out, uint64_t v, size_t bytes) {
+	for (size_t i = 0; i < bytes; ++i) {
+		out[i] = static_cast<char>((v >> (8 * i)) & 0xff);
+	}
+}
+
+void append_uint(std::vector<char> &out, uint64_t v, size_t bytes) {
+	size_t pos = out.size();
+	out.resize(pos + bytes);
+	put_uint(&out[pos], v, bytes);
+}
+
+uint64_t get_uint(const char *in, size_t bytes) {
+	uint64_t v = 0;
+	for (size_t i = 0; i < bytes; ++i) {
+		v |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) <<
+			(8 * i);
+	}
+	return v;
+}
+
+bool read_uint(std::istream &in, uint64_t &v, size_t bytes) {
+	char b[8];
+	if (!in.read(b, bytes)) return false;
+	v = get_uint(b, bytes);
+	return true;
+}
+} // namespace
+
+const uint32_t IndexedFile::kVersion;
+const size_t IndexedFile::kMagicBytes;
+const size_t IndexedFile::kRecordHeaderBytes;
+const size_t IndexedFile::kIndexEntryBytes;
+const size_t IndexedFile::kTrailerBytes;
+
+// ----------------------------------------------------------------------------
+void IndexedFile::write_header(
+	const std::vector<IndexedStreamDescriptor> &streams,
+	std::vector<char> &out) {
+	out.insert(out.end(), kHeaderMagic, kHeaderMagic + kMagicBytes);
+	append_uint(out, kVersion, 4);
+	append_uint(out, streams.size(), 4);
+	for (auto &it : streams) {
+		append_uint(out, it.stream_id, 4);
+		append_uint(out, it.name.size(), 4);
+		out.insert(out.end(), it.name.begin(), it.name.end());
+	}
+}
+// ----------------------------------------------------------------------------
+void IndexedFile::write_record_header(uint32_t stream_id,
+	int64_t timestamp_us, uint64_t size, char *out) {
+	put_uint(out, stream_id, 4);
+	put_uint(out + 4, static_cast<uint64_t>(timestamp_us), 8);
+	put_uint(out + 12, size, 8);
+}
+// ----------------------------------------------------------------------------
+void IndexedFile::write_footer(const std::vector<IndexedFileEntry> &index,
+	uint64_t index_offset, std::vector<char> &out) {
+	out.reserve(out.size() + index.size() * kIndexEntryBytes + kTrailerBytes);
+	for (auto &it : index) {
+		append_uint(out, it.offset, 8);
+		append_uint(out, it.size, 8);
+		append_uint(out, static_cast<uint64_t>(it.timestamp_us), 8);
+		append_uint(out, it.stream_id, 4);
+	}
+	append_uint(out, index_offset, 8);
+	append_uint(out, index.size(), 8);
+	out.insert(out.end(), kTrailerMagic, kTrailerMagic + kMagicBytes);
+}
+// ----------------------------------------------------------------------------
+bool IndexedFile::is_indexed_file(const std::string &filename) {
+	std::ifstream fin(filename.c_str(), std::ios::binary);
+	char magic[kMagicBytes];
+	return fin.read(magic, kMagicBytes) &&
+		memcmp(magic, kHeaderMagic, kMagicBytes) == 0;
+}
+// ----------------------------------------------------------------------------
+IndexedFileReader::IndexedFileReader() {
+	version_ = 0;
+	recovered_ = false;
+}
+// ----------------------------------------------------------------------------
+int IndexedFileReader::open(const std::string &filename) {
+	close();
+	fin_.open(filename.c_str(), std::ios::binary);
+	if (!fin_.is_open()) return kFileIsNotOpen;
+
+	// Header
+	char magic[IndexedFile::kMagicBytes];
+	uint64_t version = 0, num_streams = 0;
+	if (!fin_.read(magic, IndexedFile::kMagicBytes) ||
+		memcmp(magic, kHeaderMagic, IndexedFile::kMagicBytes) != 0 ||
+		!read_uint(fin_, version, 4) || !read_uint(fin_, num_streams, 4)) {
+		close();
+		return kFail;
+	}
+	version_ = static_cast<uint32_t>(version);
+	for (uint64_t i = 0; i < num_streams; ++i) {
+		uint64_t stream_id = 0, name_size = 0;
+		if (!read_uint(fin_, stream_id, 4) || !read_uint(fin_, name_size, 4)) {
+			close();
+			return kFail;
+		}
+		IndexedStreamDescriptor descriptor;
+		descriptor.stream_id = static_cast<uint32_t>(stream_id);
+		descriptor.name.resize(static_cast<size_t>(name_size));
+		if (name_size > 0 && !fin_.read(&descriptor.name[0], name_size)) {
+			close();
+			return kFail;
+		}
+		streams_.push_back(descriptor);
+	}
+	uint64_t data_begin = static_cast<uint64_t>(fin_.tellg());
+	fin_.seekg(0, std::ios::end);
+	uint64_t file_size = static_cast<uint64_t>(fin_.tellg());
+
+	if (!load_footer(data_begin, file_size)) {
+		entries_.clear();
+		scan_records(data_begin, file_size);
+		recovered_ = true;
+	}
+	for (size_t i = 0; i < entries_.size(); ++i) {
+		stream_entries_[entries_[i].stream_id].push_back(i);
+	}
+	fin_.clear();
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+void IndexedFileReader::close() {
+	if (fin_.is_open()) fin_.close();
+	fin_.clear();
+	version_ = 0;
+	streams_.clear();
+	entries_.clear();
+	stream_entries_.clear();
+	recovered_ = false;
+}
+// ----------------------------------------------------------------------------
+uint32_t IndexedFileReader::version() const {
+	return version_;
+}
+// ----------------------------------------------------------------------------
+const std::vector<IndexedStreamDescriptor>& IndexedFileReader::streams() const {
+	return streams_;
+}
+// ----------------------------------------------------------------------------
+const std::vector<IndexedFileEntry>& IndexedFileReader::entries() const {
+	return entries_;
+}
+// ----------------------------------------------------------------------------
+size_t IndexedFileReader::size() const {
+	return entries_.size();
+}
+// ----------------------------------------------------------------------------
+bool IndexedFileReader::recovered() const {
+	return recovered_;
+}
+// ----------------------------------------------------------------------------
+int64_t IndexedFileReader::find_frame(uint32_t stream_id, size_t frame) const {
+	auto it = stream_entries_.find(stream_id);
+	if (it == stream_entries_.end() || frame >= it->second.size()) return -1;
+	return static_cast<int64_t>(it->second[frame]);
+}
+// ----------------------------------------------------------------------------
+int64_t IndexedFileReader::find_time(int64_t timestamp_us,
+	int64_t stream_id) const {
+	// The records are written in order of time
+	if (stream_id < 0) {
+		auto it = std::lower_bound(entries_.begin(), entries_.end(),
+			timestamp_us, [](const IndexedFileEntry &e, int64_t t) {
+				return e.timestamp_us < t; });
+		if (it == entries_.end()) return -1;
+		return static_cast<int64_t>(it - entries_.begin());
+	}
+	auto it_stream = stream_entries_.find(static_cast<uint32_t>(stream_id));
+	if (it_stream == stream_entries_.end()) return -1;
+	const std::vector<size_t> &positions = it_stream->second;
+	auto it = std::lower_bound(positions.begin(), positions.end(),
+		timestamp_us, [this](size_t i, int64_t t) {
+			return entries_[i].timestamp_us < t; });
+	if (it == positions.end()) return -1;
+	return static_cast<int64_t>(*it);
+}
+// ----------------------------------------------------------------------------
+int IndexedFileReader::read(size_t index, std::vector<char> &data) {
+	if (!fin_.is_open()) return kFileIsNotOpen;
+	if (index >= entries_.size()) return kFail;
+	const IndexedFileEntry &entry = entries_[index];
+	data.resize(static_cast<size_t>(entry.size));
+	fin_.clear();
+	fin_.seekg(static_cast<std::streamoff>(entry.offset +
+		IndexedFile::kRecordHeaderBytes));
+	if (entry.size > 0 && !fin_.read(data.data(), entry.size)) {
+		return kFail;
+	}
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+bool IndexedFileReader::load_footer(uint64_t data_begin, uint64_t file_size) {
+	if (file_size < data_begin + IndexedFile::kTrailerBytes) return false;
+	char trailer[IndexedFile::kTrailerBytes];
+	fin_.seekg(static_cast<std::streamoff>(file_size -
+		IndexedFile::kTrailerBytes));
+	if (!fin_.read(trailer, IndexedFile::kTrailerBytes) ||
+		memcmp(trailer + 16, kTrailerMagic, IndexedFile::kMagicBytes) != 0) {
+		return false;
+	}
+	uint64_t index_offset = get_uint(trailer, 8);
+	uint64_t num_entries = get_uint(trailer + 8, 8);
+	if (index_offset < data_begin || index_offset + num_entries *
+		IndexedFile::kIndexEntryBytes + IndexedFile::kTrailerBytes !=
+		file_size) {
+		return false;
+	}
+
+	// The whole index is read at once
+	std::vector<char> index(static_cast<size_t>(num_entries *
+		IndexedFile::kIndexEntryBytes));
+	fin_.seekg(static_cast<std::streamoff>(index_offset));
+	if (!index.empty() && !fin_.read(index.data(), index.size())) {
+		return false;
+	}
+	entries_.resize(static_cast<size_t>(num_entries));
+	const char *p = index.data();
+	for (auto &it : entries_) {
+		it.offset = get_uint(p, 8);
+		it.size = get_uint(p + 8, 8);
+		it.timestamp_us = static_cast<int64_t>(get_uint(p + 16, 8));
+		it.stream_id = static_cast<uint32_t>(get_uint(p + 24, 4));
+		if (it.offset + IndexedFile::kRecordHeaderBytes + it.size >
+			index_offset) {
+			return false;
+		}
+		p += IndexedFile::kIndexEntryBytes;
+	}
+	return true;
+}
+// ----------------------------------------------------------------------------
+void IndexedFileReader::scan_records(uint64_t data_begin, uint64_t file_size) {
+	// Only the record headers are read, the payloads are skipped
+	uint64_t offset = data_begin;
+	char header[IndexedFile::kRecordHeaderBytes];
+	while (offset + IndexedFile::kRecordHeaderBytes <= file_size) {
+		fin_.clear();
+		fin_.seekg(static_cast<std::streamoff>(offset));
+		if (!fin_.read(header, IndexedFile::kRecordHeaderBytes)) break;
+		// Padding of a preallocated file not truncated
+		if (std::all_of(header, header + IndexedFile::kRecordHeaderBytes,
+			[](char c) { return c == 0; })) {
+			break;
+		}
+		IndexedFileEntry entry;
+		entry.offset = offset;
+		entry.stream_id = static_cast<uint32_t>(get_uint(header, 4));
+		entry.timestamp_us = static_cast<int64_t>(get_uint(header + 4, 8));
+		entry.size = get_uint(header + 12, 8);
+		// Truncated record
+		if (entry.size > file_size - offset - IndexedFile::kRecordHeaderBytes) {
+			break;
+		}
+		entries_.push_back(entry);
+		offset += IndexedFile::kRecordHeaderBytes + entry.size;
+	}
+}
+
+} // namespace storedata
@@ -0,0 +1,188 @@
+/* @file mapped_file.cpp
+ * @brief Implementation of the memory mapped reader.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include "record/inc/record/mapped_file.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace storedata
+{
+
+// ----------------------------------------------------------------------------
+MappedFile::MappedFile() {
+	data_ = nullptr;
+	size_ = 0;
+	is_open_ = false;
+#ifdef _WIN32
+	file_ = INVALID_HANDLE_VALUE;
+	mapping_ = nullptr;
+#else
+	fd_ = -1;
+#endif
+}
+// ----------------------------------------------------------------------------
+MappedFile::~MappedFile() {
+	close();
+}
+// ----------------------------------------------------------------------------
+int MappedFile::open(const std::string &filename) {
+	close();
+#ifdef _WIN32
+	file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ |
+		FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file_ == INVALID_HANDLE_VALUE) return kFileIsNotOpen;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_, &file_size)) {
+		close();
+		return kFileIsNotOpen;
+	}
+	size_ = static_cast<size_t>(file_size.QuadPart);
+	is_open_ = true;
+	// An empty file cannot be mapped
+	if (size_ == 0) return kSuccess;
+	mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0,
+		nullptr);
+	if (!mapping_) {
+		close();
+		return kFileIsNotOpen;
+	}
+	data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ,
+		0, 0, 0));
+	if (!data_) {
+		close();
+		return kFileIsNotOpen;
+	}
+	return kSuccess;
+#else
+	fd_ = ::open(filename.c_str(), O_RDONLY);
+	if (fd_ < 0) return kFileIsNotOpen;
+	struct stat st;
+	if (fstat(fd_, &st) != 0) {
+		close();
+		return kFileIsNotOpen;
+	}
+	size_ = static_cast<size_t>(st.st_size);
+	is_open_ = true;
+	// An empty file cannot be mapped
+	if (size_ == 0) return kSuccess;
+	void *ptr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+	if (ptr == MAP_FAILED) {
+		close();
+		return kFileIsNotOpen;
+	}
+	// The records are read in order: larger read ahead, and the pages
+	// already read can be released
+	madvise(ptr, size_, MADV_SEQUENTIAL);
+	data_ = static_cast<const char*>(ptr);
+	return kSuccess;
+#endif
+}
+// ----------------------------------------------------------------------------
+void MappedFile::close() {
+#ifdef _WIN32
+	if (data_) UnmapViewOfFile(data_);
+	if (mapping_) CloseHandle(mapping_);
+	if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+	mapping_ = nullptr;
+	file_ = INVALID_HANDLE_VALUE;
+#else
+	if (data_) munmap(const_cast<char*>(data_), size_);
+	if (fd_ >= 0) ::close(fd_);
+	fd_ = -1;
+#endif
+	data_ = nullptr;
+	size_ = 0;
+	is_open_ = false;
+}
+// ----------------------------------------------------------------------------
+bool MappedFile::is_open() const {
+	return is_open_;
+}
+// ----------------------------------------------------------------------------
+const char* MappedFile::data() const {
+	return data_;
+}
+// ----------------------------------------------------------------------------
+size_t MappedFile::size() const {
+	return size_;
+}
+// ----------------------------------------------------------------------------
+MappedRecordFile::MappedRecordFile() {
+	is_indexed_ = false;
+}
+// ----------------------------------------------------------------------------
+int MappedRecordFile::open(const std::string &filename) {
+	close();
+	int return_status = file_.open(filename);
+	if (return_status != kSuccess) return return_status;
+	is_indexed_ = file_.size() >= IndexedFile::kMagicBytes &&
+		IndexedFile::is_indexed_file(filename);
+	if (is_indexed_) {
+		// Only the header and the footer are read
+		IndexedFileReader reader;
+		return_status = reader.open(filename);
+		if (return_status != kSuccess) {
+			close();
+			return return_status;
+		}
+		entries_ = reader.entries();
+	}
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+void MappedRecordFile::close() {
+	file_.close();
+	is_indexed_ = false;
+	entries_.clear();
+}
+// ----------------------------------------------------------------------------
+bool MappedRecordFile::is_indexed() const {
+	return is_indexed_;
+}
+// ----------------------------------------------------------------------------
+size_t MappedRecordFile::num_chunks() const {
+	if (is_indexed_) return entries_.size();
+	return file_.size() > 0 ? 1 : 0;
+}
+// ----------------------------------------------------------------------------
+RecordView MappedRecordFile::chunk(size_t index) const {
+	if (!is_indexed_) return RecordView(file_.data(), file_.size());
+	const IndexedFileEntry &entry = entries_[index];
+	uint64_t begin = entry.offset + IndexedFile::kRecordHeaderBytes;
+	// The file can be shorter than the index (written while reading)
+	if (begin + entry.size > file_.size()) return RecordView();
+	return RecordView(file_.data() + begin, static_cast<size_t>(entry.size));
+}
+// ----------------------------------------------------------------------------
+const std::vector<IndexedFileEntry>& MappedRecordFile::entries() const {
+	return entries_;
+}
+
+} // namespace storedata
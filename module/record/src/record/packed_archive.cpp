@@ -0,0 +1,277 @@
+/* @file packed_archive.cpp
+ * @brief Implementation of the archive of small files.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include "record/inc/record/packed_archive.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+
+#include "record/inc/record/storedata_time.hpp"
+
+namespace storedata
+{
+
+namespace
+{
+const char kIndexMagic[] = "SDPKIDX1";
+const size_t kIndexMagicSize = 8;
+// Longest name accepted from an index (PATH_MAX on Linux)
+const uint64_t kMaxNameSize = 4096;
+
+// The index is written little endian independently from the platform
+void put_uint(std::string &out, uint64_t v, size_t bytes) {
+	for (size_t i = 0; i < bytes; ++i) {
+		out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+	}
+}
+
+bool get_uint(std::istream &in, uint64_t &v, size_t bytes) {
+	unsigned char b[8];
+	if (!in.read(reinterpret_cast<char*>(b), bytes)) return false;
+	v = 0;
+	for (size_t i = 0; i < bytes; ++i) {
+		v |= static_cast<uint64_t>(b[i]) << (8 * i);
+	}
+	return true;
+}
+} // namespace
+
+// ----------------------------------------------------------------------------
+PackedArchiveWriter::PackedArchiveWriter() {
+	max_segment_bytes_ = 0;
+	sequence_ = 0;
+	segment_size_ = 0;
+}
+// ----------------------------------------------------------------------------
+PackedArchiveWriter::~PackedArchiveWriter() {
+	close();
+}
+// ----------------------------------------------------------------------------
+void PackedArchiveWriter::setup(const std::string &filename_root,
+	size_t max_segment_bytes) {
+	close();
+	filename_root_ = filename_root;
+	max_segment_bytes_ = max_segment_bytes;
+	sequence_ = 0;
+	index_files_.clear();
+	// Get the appendix to add to the archive
+	appendix_ = DateTime::time2string();
+	for (size_t i = 0; i < appendix_.length(); i++)
+	{
+		if (appendix_[i] == ':') appendix_[i] = '_';
+	}
+}
+// ----------------------------------------------------------------------------
+int PackedArchiveWriter::append(const std::string &name,
+	const void *data, size_t size) {
+	// Start a new segment if the data does not fit (a segment contains at
+	// least one entry)
+	if (fpack_.is_open() && segment_size_ > 0 && max_segment_bytes_ > 0 &&
+		segment_size_ + size > max_segment_bytes_) {
+		close();
+	}
+	if (!fpack_.is_open() && open_segment() != kSuccess) {
+		return kFileIsNotOpen;
+	}
+
+	std::string entry;
+	put_uint(entry, name.size(), 4);
+	entry.append(name);
+	put_uint(entry, segment_size_, 8);
+	put_uint(entry, size, 8);
+
+	if (size > 0) fpack_.write(static_cast<const char*>(data), size);
+	fidx_.write(entry.data(), entry.size());
+	segment_size_ += size;
+	return (fpack_.good() && fidx_.good()) ? kSuccess : kFail;
+}
+// ----------------------------------------------------------------------------
+int PackedArchiveWriter::flush() {
+	if (!fpack_.is_open()) return kFileIsNotOpen;
+	// The index must not refer to data not in the segment
+	fpack_.flush();
+	fidx_.flush();
+	return (fpack_.good() && fidx_.good()) ? kSuccess : kFail;
+}
+// ----------------------------------------------------------------------------
+void PackedArchiveWriter::close() {
+	if (fpack_.is_open()) {
+		fpack_.close();
+		fidx_.close();
+	}
+	fpack_.clear();
+	fidx_.clear();
+	segment_size_ = 0;
+}
+// ----------------------------------------------------------------------------
+const std::vector<std::string>& PackedArchiveWriter::index_files() const {
+	return index_files_;
+}
+// ----------------------------------------------------------------------------
+const char* PackedArchiveWriter::magic() {
+	return kIndexMagic;
+}
+// ----------------------------------------------------------------------------
+int PackedArchiveWriter::open_segment() {
+	char seq[16];
+	snprintf(seq, sizeof(seq), "%06d", sequence_);
+	std::string filename = filename_root_ + appendix_ + "_" + seq;
+	fpack_.open((filename + ".pack").c_str(), std::ios::binary);
+	fidx_.open((filename + ".idx").c_str(), std::ios::binary);
+	if (!fpack_.is_open() || !fidx_.is_open()) {
+		close();
+		return kFileIsNotOpen;
+	}
+	fidx_.write(kIndexMagic, kIndexMagicSize);
+	++sequence_;
+	segment_size_ = 0;
+	index_files_.push_back(filename + ".idx");
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+PackedArchiveReader::PackedArchiveReader() {
+}
+// ----------------------------------------------------------------------------
+int PackedArchiveReader::open(const std::string &index_filename) {
+	close();
+	std::ifstream fidx(index_filename.c_str(),
+		std::ios::binary | std::ios::ate);
+	if (!fidx.is_open()) return kFileIsNotOpen;
+	uint64_t index_size = static_cast<uint64_t>(fidx.tellg());
+	fidx.seekg(0, std::ios::beg);
+	char magic[kIndexMagicSize];
+	if (!fidx.read(magic, kIndexMagicSize) ||
+		memcmp(magic, kIndexMagic, kIndexMagicSize) != 0) {
+		return kFail;
+	}
+
+	std::filesystem::path pack(index_filename);
+	pack.replace_extension(".pack");
+	fpack_.open(pack.string().c_str(), std::ios::binary);
+	if (!fpack_.is_open()) return kFileIsNotOpen;
+	fpack_.seekg(0, std::ios::end);
+	uint64_t pack_size = static_cast<uint64_t>(fpack_.tellg());
+
+	// A truncated or corrupted entry (interrupted write) ends the index
+	while (true) {
+		uint64_t name_size = 0;
+		if (!get_uint(fidx, name_size, 4)) break;
+		uint64_t index_left = index_size -
+			static_cast<uint64_t>(fidx.tellg());
+		if (name_size > index_left || name_size > kMaxNameSize) break;
+		PackedArchiveEntry entry;
+		entry.name.resize(static_cast<size_t>(name_size));
+		if (name_size > 0 && !fidx.read(&entry.name[0], name_size)) break;
+		if (!get_uint(fidx, entry.offset, 8)) break;
+		if (!get_uint(fidx, entry.size, 8)) break;
+		if (entry.offset + entry.size > pack_size) break;
+		names_[entry.name] = entries_.size();
+		entries_.push_back(entry);
+	}
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+void PackedArchiveReader::close() {
+	if (fpack_.is_open()) fpack_.close();
+	fpack_.clear();
+	entries_.clear();
+	names_.clear();
+}
+// ----------------------------------------------------------------------------
+const std::vector<PackedArchiveEntry>& PackedArchiveReader::entries() const {
+	return entries_;
+}
+// ----------------------------------------------------------------------------
+int PackedArchiveReader::find(const std::string &name) const {
+	auto it = names_.find(name);
+	if (it == names_.end()) return -1;
+	return static_cast<int>(it->second);
+}
+// ----------------------------------------------------------------------------
+int PackedArchiveReader::read(size_t index, std::vector<char> &data) {
+	if (!fpack_.is_open()) return kFileIsNotOpen;
+	if (index >= entries_.size()) return kFail;
+	const PackedArchiveEntry &entry = entries_[index];
+	data.resize(static_cast<size_t>(entry.size));
+	fpack_.clear();
+	fpack_.seekg(static_cast<std::streamoff>(entry.offset));
+	if (entry.size > 0 && !fpack_.read(data.data(), entry.size)) {
+		return kFail;
+	}
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+int PackedArchiveReader::read(const std::string &name,
+	std::vector<char> &data) {
+	int index = find(name);
+	if (index < 0) return kFail;
+	return read(static_cast<size_t>(index), data);
+}
+// ----------------------------------------------------------------------------
+int PackedArchiveReader::extract(const std::string &name,
+	const std::string &output_dir) {
+	int index = find(name);
+	if (index < 0) return kFail;
+	return extract_entry(static_cast<size_t>(index), output_dir);
+}
+// ----------------------------------------------------------------------------
+size_t PackedArchiveReader::extract_all(const std::string &output_dir) {
+	size_t num_files = 0;
+	// Only the last version of each name is created
+	for (size_t i = 0; i < entries_.size(); ++i) {
+		if (names_[entries_[i].name] != i) continue;
+		if (extract_entry(i, output_dir) == kSuccess) ++num_files;
+	}
+	return num_files;
+}
+// ----------------------------------------------------------------------------
+int PackedArchiveReader::extract_entry(size_t index,
+	const std::string &output_dir) {
+	std::vector<char> data;
+	int return_status = read(index, data);
+	if (return_status != kSuccess) return return_status;
+
+	std::filesystem::path filename(entries_[index].name);
+	if (!output_dir.empty()) {
+		// The name comes from the index: it must not leave output_dir
+		// (i.e. "../../file")
+		std::filesystem::path dir =
+			std::filesystem::path(output_dir).lexically_normal();
+		filename = (dir / filename.relative_path()).lexically_normal();
+		std::filesystem::path relative = filename.lexically_relative(dir);
+		if (relative.empty() || relative == "." ||
+			*relative.begin() == "..") {
+			return kFail;
+		}
+	}
+	std::error_code ec;
+	if (filename.has_parent_path()) {
+		std::filesystem::create_directories(filename.parent_path(), ec);
+	}
+	std::ofstream fout(filename.string().c_str(), std::ios::binary);
+	if (!fout.is_open()) return kFileIsNotOpen;
+	if (!data.empty()) fout.write(data.data(), data.size());
+	return fout.good() ? kSuccess : kFail;
+}
+
+} // namespace storedata
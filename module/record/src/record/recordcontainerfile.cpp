@@ -22,15 +22,37 @@
 
 #include "record/inc/record/recordcontainerfile.hpp"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace storedata
 {
 
 //-----------------------------------------------------------------------------
 RecordContainerFile::RecordContainerFile() {
-	num_threads_ = 0;
-	max_threads_ = 1;
+	max_threads_ = (std::max)(1, static_cast<int>(
+		std::thread::hardware_concurrency()));
+	save_boost_ = false;
 	is_running_ = false;
+	continue_save_ = false;
+	drain_on_stop_ = false;
 	num_elems_microbuffer_approx_ = 0;
+	backend_pending_ = 0;
+	packed_mode_ = false;
+	// The last task of the pool may complete the wait for the empty queue
+	worker_pool_.set_idle_callback([this] { notify_if_empty(); });
+}
+//-----------------------------------------------------------------------------
+RecordContainerFile::~RecordContainerFile() {
+	stop();
+	if (thread_.joinable()) thread_.join();
+	// Release the data not processed
+	while (!container_.empty()) {
+		container_.front().second.dispose();
+		container_.pop();
+	}
 }
 //-----------------------------------------------------------------------------
 void RecordContainerFile::push(
@@ -79,23 +101,49 @@ void RecordContainerFile::push(
 bool RecordContainerFile::start() {
 	std::lock_guard<std::mutex> lk(mtx_);
 	if (is_running_) return false;
+	// Release the thread of the previous session (it is quitting)
+	if (thread_.joinable()) thread_.join();
 	continue_save_ = true;
-	std::thread t1(&RecordContainerFile::internal_thread, this);
-	t1.detach();
+	drain_on_stop_ = false;
+	is_running_ = true;
+	thread_ = std::thread(&RecordContainerFile::internal_thread, this);
 	return true;
 }
 //-----------------------------------------------------------------------------
 void RecordContainerFile::stop() {
-	continue_save_ = false;
-	cond_.notify_one();
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		continue_save_ = false;
+	}
+	cond_.notify_all();
+}
+//-----------------------------------------------------------------------------
+bool RecordContainerFile::drain_and_join(
+	std::chrono::steady_clock::time_point deadline) {
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		drain_on_stop_ = true;
+		continue_save_ = false;
+	}
+	cond_.notify_all();
+
+	bool is_stopped = false;
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		is_stopped = cond_state_.wait_until(lk, deadline,
+			[this] { return !is_running_; });
+		// Too late, quit after the current data
+		if (!is_stopped) drain_on_stop_ = false;
+	}
+	if (is_stopped && thread_.joinable()) thread_.join();
+	return is_stopped;
 }
 //-----------------------------------------------------------------------------
 void RecordContainerFile::close(int num_iterations, int wait_ms) {
-	stop();
-	wait_until_buffer_is_empty(num_iterations, wait_ms);
-	wait_until_is_not_ready(num_iterations, wait_ms);
+	drain_and_join(std::chrono::steady_clock::now() +
+		std::chrono::milliseconds(num_iterations * wait_ms));
 }
-////-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
 //void RecordContainer::internal_thread() {
 // THIS FUNCTION DOES NOT SEEMS TO BE ANY VALID FOR THE FILE ANYMORE
 //	is_running_ = true;
@@ -191,18 +239,29 @@ void RecordContainerFile::close(int num_iterations, int wait_ms) {
 //}
 //-----------------------------------------------------------------------------
 void RecordContainerFile::internal_thread() {
-	is_running_ = true;
-	while (continue_save_) {
+	// True if the last pop left the queue empty (read under mtx_)
+	bool queue_drained = false;
+	while (continue_save_ || drain_on_stop_) {
+
+		// The index of the archive is complete while no data is queued
+		if (packed_mode_ && queue_drained) {
+			std::lock_guard<std::mutex> lk(mtx_archive_);
+			archive_.flush();
+		}
 
 		// Digest the main buffer frames (it it exist)
 		std::pair<std::string, RecordContainerData> tuple;
+		bool save_boost = false;
 		{
 			std::unique_lock<std::mutex> lk(mtx_);
 			// no data to save
 			if (container_.size() == 0) {
+				// Stop requested and all the data is processed
+				if (!continue_save_) break;
 				data_ready_ = false;
 				//std::cout << "wait: " << data_ready_ << std::endl;
-				cond_.wait(lk, [this] { return data_ready_; });
+				cond_.wait(lk, [this] {
+					return data_ready_ || !continue_save_; });
 				//std::cout << "end wait: " << data_ready_ << std::endl;
 			}
 			// Pop the data
@@ -212,21 +271,99 @@ void RecordContainerFile::internal_thread() {
 				tuple = container_.front();
 				container_.pop();
 			}
+			queue_drained = container_.size() == 0;
+			save_boost = save_boost_;
+		}
+
+		if (save_boost && !worker_pool_.is_running()) {
+			std::lock_guard<std::mutex> lk(mtx_);
+			// Each file is independent, no order is required
+			worker_pool_.start(max_threads_, false);
+		} else if (!save_boost && worker_pool_.is_running()) {
+			// The dispatched data is completed before the next one is
+			// processed by this thread
+			worker_pool_.stop();
 		}
 		// Process the data
 		if (tuple.second.data) {
-
-			FILE *fp;
-			fp = fopen(tuple.first.c_str(), "wb");
-			if (fp) {
-				fwrite(tuple.second.data, 1, tuple.second.size_bytes, fp);
-				fclose(fp);
+			if (worker_pool_.is_running()) {
+				auto shared_tuple = std::make_shared<
+					std::pair<std::string, RecordContainerData>>(tuple);
+				worker_pool_.dispatch(tuple.first, [this, shared_tuple] {
+					write_file(*shared_tuple); });
+			} else {
+				write_file(tuple);
 			}
-			// Dispose the data
+		}
+		notify_if_empty();
+	}
+	// Complete the files under writing
+	worker_pool_.stop();
+	{
+		std::lock_guard<std::mutex> lk(mtx_archive_);
+		archive_.close();
+	}
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		cond_backend_.wait(lk, [this] { return backend_pending_ == 0; });
+		is_running_ = false;
+	}
+	cond_state_.notify_all();
+}
+//-----------------------------------------------------------------------------
+void RecordContainerFile::write_file(
+	std::pair<std::string, RecordContainerData> &tuple) {
+	if (packed_mode_) {
+		{
+			std::lock_guard<std::mutex> lk(mtx_archive_);
+			archive_.append(tuple.first, tuple.second.data,
+				tuple.second.size_bytes);
+		}
+		tuple.second.dispose();
+		return;
+	}
+#ifndef _WIN32
+	std::shared_ptr<AsyncWriteBackend> backend;
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		backend = backend_;
+	}
+	if (backend) {
+		int fd = ::open(tuple.first.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+			0644);
+		if (fd < 0) {
 			tuple.second.dispose();
+			return;
+		}
+		// The data is owned by the completion
+		auto data = std::make_shared<RecordContainerData>(tuple.second);
+		tuple.second.data = nullptr;
+		tuple.second.holder.release();
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			++backend_pending_;
+		}
+		auto done = [this, fd, data](int64_t) {
+			::close(fd);
+			data->dispose();
+			std::lock_guard<std::mutex> lk(mtx_);
+			if (--backend_pending_ == 0) cond_backend_.notify_all();
+		};
+		if (backend->submit(fd, data->data, data->size_bytes, 0, done) !=
+			kSuccess) {
+			done(-1);
 		}
+		return;
 	}
-	is_running_ = false;
+#endif
+	FILE *fp;
+	fp = fopen(tuple.first.c_str(), "wb");
+	if (fp) {
+		fwrite(tuple.second.data, 1, tuple.second.size_bytes, fp);
+		fclose(fp);
+	}
+	// Dispose the data
+	tuple.second.dispose();
 }
 //-----------------------------------------------------------------------------
 void RecordContainerFile::set_save_boost(bool save_boost) {
@@ -234,8 +371,27 @@ void RecordContainerFile::set_save_boost(bool save_boost) {
 	save_boost_ = save_boost;
 }
 //-----------------------------------------------------------------------------
+void RecordContainerFile::set_max_threads(int max_threads) {
+	std::lock_guard<std::mutex> lk(mtx_);
+	max_threads_ = (std::max)(1, max_threads);
+}
+//-----------------------------------------------------------------------------
+void RecordContainerFile::set_write_backend(
+	std::shared_ptr<AsyncWriteBackend> backend) {
+	std::lock_guard<std::mutex> lk(mtx_);
+	backend_ = backend;
+}
+//-----------------------------------------------------------------------------
+void RecordContainerFile::set_packed_mode(bool packed,
+	const std::string &archive_root, size_t max_segment_bytes) {
+	std::lock_guard<std::mutex> lk(mtx_archive_);
+	archive_.setup(archive_root, max_segment_bytes);
+	packed_mode_ = packed;
+}
+//-----------------------------------------------------------------------------
 size_t RecordContainerFile::size_about() {
-	return container_.size() + num_elems_microbuffer_approx_;
+	return container_.size() + num_elems_microbuffer_approx_ +
+		worker_pool_.size_about();
 }
 //-----------------------------------------------------------------------------
 size_t RecordContainerFile::size_about_micro() {
@@ -249,31 +405,25 @@ bool RecordContainerFile::is_running() {
 bool RecordContainerFile::wait_until_is_not_ready(
 	size_t num_iterations, 
 	int sleep_ms) {
-	for (size_t i = 0; i < num_iterations; ++i) {
-		if (is_running()) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-		}
-		else {
-			return true;
-		}
-	}
-	return false;
+	auto deadline = wait_deadline(num_iterations, sleep_ms);
+	std::unique_lock<std::mutex> lk(mtx_);
+	return cond_state_.wait_until(lk, deadline,
+		[this] { return !is_running_; });
 }
 //-----------------------------------------------------------------------------
 bool RecordContainerFile::wait_until_buffer_is_empty(
 	size_t num_iterations, 
 	int sleep_ms) {
-	for (size_t i = 0; i < num_iterations; ++i) {
-		//std::cout << "iA: " << i << " " << (size_about() > 0) << " ";
-		if (is_running() && (size_about() > 0)) {
-			//std::cout << size_about() << std::endl;
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-		} else {
-			return true;
-		}
-	}
-	return false;
+	auto deadline = wait_deadline(num_iterations, sleep_ms);
+	std::unique_lock<std::mutex> lk(mtx_);
+	// Woken up when the last data is processed or the thread quits
+	return cond_state_.wait_until(lk, deadline,
+		[this] { return !is_running_ || size_about() == 0; });
+}
+//-----------------------------------------------------------------------------
+void RecordContainerFile::notify_if_empty() {
+	std::lock_guard<std::mutex> lk(mtx_);
+	if (size_about() == 0) cond_state_.notify_all();
 }
-
 
 } // namespace storedata
@@ -27,12 +27,24 @@ namespace storedata
 
 //-----------------------------------------------------------------------------
 RecordContainerVideo::RecordContainerVideo() {
-	num_threads_ = 0;
 	max_threads_ = 1;
+	save_boost_ = false;
 	is_running_ = false;
+	continue_save_ = false;
+	drain_on_stop_ = false;
 	num_elems_microbuffer_approx_ = 0;
 }
 //-----------------------------------------------------------------------------
+RecordContainerVideo::~RecordContainerVideo() {
+	stop();
+	if (thread_.joinable()) thread_.join();
+	// Release the data not processed
+	while (!container_.empty()) {
+		container_.front().second.dispose();
+		container_.pop();
+	}
+}
+//-----------------------------------------------------------------------------
 void RecordContainerVideo::push(
 	const std::string &msg, 
 	RecordContainerData &rcd,
@@ -80,21 +92,47 @@ void RecordContainerVideo::push(
 bool RecordContainerVideo::start() {
 	std::lock_guard<std::mutex> lk(mtx_);
 	if (is_running_) return false;
+	// Release the thread of the previous session (it is quitting)
+	if (thread_.joinable()) thread_.join();
 	continue_save_ = true;
-	std::thread t1(&RecordContainerVideo::internal_thread, this);
-	t1.detach();
+	drain_on_stop_ = false;
+	is_running_ = true;
+	thread_ = std::thread(&RecordContainerVideo::internal_thread, this);
 	return true;
 }
 //-----------------------------------------------------------------------------
 void RecordContainerVideo::stop() {
-	continue_save_ = false;
-	cond_.notify_one();
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		continue_save_ = false;
+	}
+	cond_.notify_all();
+}
+//-----------------------------------------------------------------------------
+bool RecordContainerVideo::drain_and_join(
+	std::chrono::steady_clock::time_point deadline) {
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		drain_on_stop_ = true;
+		continue_save_ = false;
+	}
+	cond_.notify_all();
+
+	bool is_stopped = false;
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		is_stopped = cond_state_.wait_until(lk, deadline,
+			[this] { return !is_running_; });
+		// Too late, quit after the current data
+		if (!is_stopped) drain_on_stop_ = false;
+	}
+	if (is_stopped && thread_.joinable()) thread_.join();
+	return is_stopped;
 }
 //-----------------------------------------------------------------------------
 void RecordContainerVideo::close(int num_iterations, int wait_ms) {
-	stop();
-	if (wait_until_buffer_is_empty(num_iterations, wait_ms) &&
-		wait_until_is_not_ready(num_iterations, wait_ms)) {
+	if (drain_and_join(std::chrono::steady_clock::now() +
+		std::chrono::milliseconds(num_iterations * wait_ms))) {
 		vw_.release();
 		fout_.close();
 		fout_.clear();
@@ -186,8 +224,7 @@ void RecordContainerVideo::internal_thread() {
 
 	}
 
-	is_running_ = true;
-	while (continue_save_) {
+	while (continue_save_ || drain_on_stop_) {
 
 		// Digest the main buffer frames (it it exist)
 		std::pair<std::string, RecordContainerData> tuple;
@@ -195,9 +232,12 @@ void RecordContainerVideo::internal_thread() {
 			std::unique_lock<std::mutex> lk(mtx_);
 			// no data to save
 			if (container_.size() == 0) {
+				// Stop requested and all the data is processed
+				if (!continue_save_) break;
 				data_ready_ = false;
 				//std::cout << "wait: " << data_ready_ << std::endl;
-				cond_.wait(lk, [this] { return data_ready_; });
+				cond_.wait(lk, [this] {
+					return data_ready_ || !continue_save_; });
 				//std::cout << "end wait: " << data_ready_ << std::endl;
 			}
 			// Pop the data
@@ -213,14 +253,17 @@ void RecordContainerVideo::internal_thread() {
 			fname_root_.size() == 0) {
 			std::cout << "[e] size_image_:" << size_image_ <<
 				" fname_root_:" << fname_root_ << std::endl;
+			tuple.second.dispose();
 			continue_save_ = false;
+			drain_on_stop_ = false;
 			continue;
 		}
 
 		// Process the data
 		if (tuple.second.data) {
-			// convert the binary in image
-			cv::Mat img = cv::Mat(size_image_, CV_8UC3, tuple.second.data);
+			// convert the binary in image (or use the shared image)
+			cv::Mat img = !tuple.second.holder.empty() ? tuple.second.holder :
+				cv::Mat(size_image_, CV_8UC3, tuple.second.data);
 			filevideo_push_frame(vw_, fname_root_ + ".avi", img);
 
 			// open a file with the frame information
@@ -256,8 +299,13 @@ void RecordContainerVideo::internal_thread() {
 			// Dispose the data
 			tuple.second.dispose();
 		}
+		notify_if_empty();
 	}
-	is_running_ = false;
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		is_running_ = false;
+	}
+	cond_state_.notify_all();
 }
 //-----------------------------------------------------------------------------
 void RecordContainerVideo::set_save_boost(bool save_boost) {
@@ -277,33 +325,28 @@ bool RecordContainerVideo::is_running() {
 	return is_running_;
 }
 //-----------------------------------------------------------------------------
-bool RecordContainerVideo::wait_until_is_not_ready(size_t num_iterations, int sleep_ms) {
-	for (size_t i = 0; i < num_iterations; ++i) {
-		if (is_running()) {
-			cond_.notify_one();
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-		}
-		else {
-			return true;
-		}
-	}
-	return false;
+bool RecordContainerVideo::wait_until_is_not_ready(
+	size_t num_iterations, 
+	int sleep_ms) {
+	auto deadline = wait_deadline(num_iterations, sleep_ms);
+	std::unique_lock<std::mutex> lk(mtx_);
+	return cond_state_.wait_until(lk, deadline,
+		[this] { return !is_running_; });
 }
 //-----------------------------------------------------------------------------
 bool RecordContainerVideo::wait_until_buffer_is_empty(
 	size_t num_iterations, 
 	int sleep_ms) {
-	for (size_t i = 0; i < num_iterations; ++i) {
-		//std::cout << "iA: " << i << " " << (size_about() > 0) << " ";
-		if (is_running() && (size_about() > 0)) {
-			cond_.notify_one();
-			//std::cout << size_about() << std::endl;
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-		} else {
-			return true;
-		}
-	}
-	return false;
+	auto deadline = wait_deadline(num_iterations, sleep_ms);
+	std::unique_lock<std::mutex> lk(mtx_);
+	// Woken up when the last data is processed or the thread quits
+	return cond_state_.wait_until(lk, deadline,
+		[this] { return !is_running_ || size_about() == 0; });
+}
+//-----------------------------------------------------------------------------
+void RecordContainerVideo::notify_if_empty() {
+	std::lock_guard<std::mutex> lk(mtx_);
+	if (size_about() == 0) cond_state_.notify_all();
 }
 //-----------------------------------------------------------------------------
 void RecordContainerVideo::set_size_image(const cv::Size &size_image) {
@@ -0,0 +1,407 @@
+/* @file replay_engine.cpp
+ * @brief Implementation of the replay of many recorded streams.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include "record/inc/record/replay_engine.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <tuple>
+
+#include "record/inc/record/RawRecorder.hpp"
+#include "record/inc/record/PlayerRecorder.hpp"
+#include "record/inc/record/fixed_slot_file.hpp"
+#include "record/inc/record/indexed_file.hpp"
+#include "record/inc/record/record_reader.hpp"
+#include "record/inc/record/storedata_time.hpp"
+
+namespace storedata
+{
+
+namespace
+{
+/** @brief It returns the last sequence like 2024_01_31_11_59_59 in the name
+           of the file (empty if missing).
+*/
+std::string filename_time(const std::string &filename) {
+	const char kMask[] = "dddd_dd_dd_dd_dd_dd";
+	const size_t kMaskSize = sizeof(kMask) - 1;
+	std::string name = std::filesystem::path(filename).filename().string();
+	for (size_t pos = name.size(); pos-- > 0;) {
+		if (name.size() - pos < kMaskSize) continue;
+		bool is_valid = true;
+		for (size_t i = 0; i < kMaskSize && is_valid; ++i) {
+			unsigned char c = static_cast<unsigned char>(name[pos + i]);
+			is_valid = kMask[i] == 'd' ? isdigit(c) != 0 : c == '_';
+		}
+		if (is_valid) return name.substr(pos, kMaskSize);
+	}
+	return std::string();
+}
+
+/** @brief It returns the time of the first record of an indexed or
+           fixed-slot file (-1 for the other files).
+*/
+int64_t first_record_timestamp_us(const std::string &filename) {
+	if (FixedSlotFile::is_fixed_slot_file(filename)) {
+		FixedSlotReader reader;
+		cv::Mat image;
+		RecordView view;
+		int64_t timestamp_us = -1;
+		if (reader.open(filename) != kSuccess || reader.size() == 0 ||
+			!reader.frame(0, image, view, timestamp_us)) {
+			return -1;
+		}
+		return timestamp_us;
+	}
+	if (IndexedFile::is_indexed_file(filename)) {
+		IndexedFileReader reader;
+		if (reader.open(filename) != kSuccess || reader.size() == 0) {
+			return -1;
+		}
+		return reader.entries().front().timestamp_us;
+	}
+	return -1;
+}
+
+/** @brief It returns the last modification time of the file (-1 if not
+           available).
+*/
+int64_t modification_timestamp_us(const std::string &filename) {
+	std::error_code ec;
+	auto file_time = std::filesystem::last_write_time(filename, ec);
+	if (ec) return -1;
+	// C++17 has no conversion between the file clock and the system clock
+	auto system_time = std::chrono::system_clock::now() +
+		std::chrono::duration_cast<std::chrono::system_clock::duration>(
+			file_time - std::filesystem::file_time_type::clock::now());
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		system_time.time_since_epoch()).count();
+}
+
+/** @brief It returns the time in the name of the file (-1 if missing).
+
+	time2string writes the hour with a 12-hour clock (01-12) without AM/PM,
+	so the names from 1 AM and 1 PM are equal. The half of the day is
+	selected with the time of the first record (indexed and fixed-slot
+	files) or else with the last modification time of the file: the file
+	is created at the name time, so the name time is the latest candidate
+	not after the modification. The hours 00 and 13-23 (24-hour names) are
+	not ambiguous.
+
+	@Warning The modification time must be kept when the segments without
+	         record timestamps are copied (i.e. cp -p), and a segment must
+	         last less than 12 hours.
+*/
+int64_t filename_timestamp_us(const std::string &filename) {
+	std::string time = filename_time(filename);
+	if (time.empty()) return -1;
+	const size_t kHourPos = 11;
+	int hour = std::stoi(time.substr(kHourPos, 2));
+	if (hour == 0 || hour > 12) return DateTime::string2timestamp_us(time);
+
+	char hour_am[3], hour_pm[3];
+	snprintf(hour_am, sizeof(hour_am), "%02d", hour % 12);
+	snprintf(hour_pm, sizeof(hour_pm), "%02d", hour % 12 + 12);
+	int64_t am_us = DateTime::string2timestamp_us(
+		time.replace(kHourPos, 2, hour_am));
+	int64_t pm_us = DateTime::string2timestamp_us(
+		time.replace(kHourPos, 2, hour_pm));
+	if (am_us < 0 || pm_us < 0) return -1;
+
+	int64_t reference_us = first_record_timestamp_us(filename);
+	if (reference_us >= 0) {
+		// The closest one to the first record
+		return std::abs(reference_us - am_us) <=
+			std::abs(reference_us - pm_us) ? am_us : pm_us;
+	}
+	reference_us = modification_timestamp_us(filename);
+	// Some file systems keep the modification time with 2 s resolution
+	const int64_t kResolutionUs = 2000000;
+	if (reference_us >= 0 && pm_us <= reference_us + kResolutionUs) {
+		return pm_us;
+	}
+	return am_us;
+}
+} // namespace
+
+// ----------------------------------------------------------------------------
+ReplayEngine::ReplayEngine() {
+	rate_mode_ = ReplayRateMode::AsFastAsPossible;
+	speed_ = 1.0;
+	queue_size_ = 16;
+	is_running_ = false;
+	first_timestamp_us_ = -1;
+}
+// ----------------------------------------------------------------------------
+ReplayEngine::~ReplayEngine() {
+	stop();
+}
+// ----------------------------------------------------------------------------
+std::vector<std::string> ReplayEngine::find_segments(
+	const std::string &filename_root, const std::string &dot_extension) {
+	std::filesystem::path root(filename_root);
+	std::filesystem::path dir = root.parent_path();
+	if (dir.empty()) dir = ".";
+	std::string prefix = root.filename().string();
+
+	// Order by the time in the name, then by the same second suffix (_N)
+	std::vector<std::tuple<int64_t, size_t, std::string> > segments;
+	std::error_code ec;
+	for (std::filesystem::directory_iterator it(dir, ec), end;
+		!ec && it != end; it.increment(ec)) {
+		if (!it->is_regular_file(ec)) continue;
+		std::string name = it->path().filename().string();
+		if (name.size() < prefix.size() + dot_extension.size() ||
+			name.compare(0, prefix.size(), prefix) != 0 ||
+			name.compare(name.size() - dot_extension.size(),
+				dot_extension.size(), dot_extension) != 0) {
+			continue;
+		}
+		segments.push_back(std::make_tuple(
+			filename_timestamp_us(it->path().string()), name.size(),
+			it->path().string()));
+	}
+	std::sort(segments.begin(), segments.end());
+
+	std::vector<std::string> files;
+	for (auto &it : segments) {
+		files.push_back(std::get<2>(it));
+	}
+	return files;
+}
+// ----------------------------------------------------------------------------
+void ReplayEngine::add_stream(const ReplayStreamParams &params) {
+	std::unique_ptr<Stream> stream(new Stream());
+	stream->params = params;
+	streams_.push_back(std::move(stream));
+}
+// ----------------------------------------------------------------------------
+void ReplayEngine::set_rate(ReplayRateMode mode, double speed) {
+	rate_mode_ = mode;
+	speed_ = speed;
+}
+// ----------------------------------------------------------------------------
+void ReplayEngine::set_queue_size(size_t queue_size) {
+	queue_size_ = (std::max)(static_cast<size_t>(1), queue_size);
+}
+// ----------------------------------------------------------------------------
+int ReplayEngine::start() {
+	stop();
+	if (streams_.empty()) return kFail;
+	is_running_ = true;
+	first_timestamp_us_ = -1;
+	for (auto &it : streams_) {
+		it->queue.clear();
+		it->is_finished = false;
+		it->thr = std::thread(&ReplayEngine::decode_thread, this, it.get());
+	}
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+bool ReplayEngine::next(ReplayRecord &record) {
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		while (true) {
+			if (!is_running_) return false;
+			// The oldest head can be selected only when all the active
+			// streams have a record
+			Stream *oldest = nullptr;
+			bool is_waiting = false;
+			for (auto &it : streams_) {
+				if (it->queue.empty()) {
+					if (!it->is_finished) {
+						is_waiting = true;
+						break;
+					}
+					continue;
+				}
+				if (!oldest || it->queue.front().timestamp_us <
+					oldest->queue.front().timestamp_us) {
+					oldest = it.get();
+				}
+			}
+			if (is_waiting) {
+				cv_data_.wait(lock);
+				continue;
+			}
+			if (!oldest) return false;
+			record = std::move(oldest->queue.front());
+			oldest->queue.pop_front();
+			cv_space_.notify_all();
+			break;
+		}
+	}
+	pace(record.timestamp_us);
+	return true;
+}
+// ----------------------------------------------------------------------------
+size_t ReplayEngine::run(
+	const std::function<bool(const ReplayRecord &record)> &callback) {
+	size_t num_records = 0;
+	ReplayRecord record;
+	while (next(record)) {
+		++num_records;
+		if (!callback(record)) break;
+	}
+	return num_records;
+}
+// ----------------------------------------------------------------------------
+void ReplayEngine::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		is_running_ = false;
+	}
+	cv_data_.notify_all();
+	cv_space_.notify_all();
+	for (auto &it : streams_) {
+		if (it->thr.joinable()) it->thr.join();
+	}
+}
+// ----------------------------------------------------------------------------
+void ReplayEngine::decode_thread(Stream *stream) {
+	size_t index = 0;
+	int64_t timestamp_us = -1;
+	for (auto &it : stream->params.files) {
+		if (!decode_file(stream, it, index, timestamp_us)) break;
+	}
+	std::lock_guard<std::mutex> lock(mtx_);
+	stream->is_finished = true;
+	cv_data_.notify_all();
+}
+// ----------------------------------------------------------------------------
+bool ReplayEngine::decode_file(Stream *stream, const std::string &filename,
+	size_t &index, int64_t &timestamp_us) {
+	const ReplayStreamParams &params = stream->params;
+	// Time of the records without timestamp: it starts at the file name
+	// time, or after the previous segment
+	int64_t file_timestamp_us = (std::max)(filename_timestamp_us(filename),
+		timestamp_us);
+	if (file_timestamp_us < 0) file_timestamp_us = 0;
+	double fps = params.fps;
+	size_t num_records = 0;
+
+	auto record_timestamp = [&](int64_t record_timestamp_us) {
+		if (record_timestamp_us < 0) {
+			record_timestamp_us = file_timestamp_us +
+				static_cast<int64_t>(num_records * 1000000.0 / fps);
+		}
+		++num_records;
+		timestamp_us = record_timestamp_us + 1;
+		return record_timestamp_us;
+	};
+
+	if (params.type == ReplayStreamType::Video) {
+		cv::VideoCapture vc(filename);
+		if (!vc.isOpened()) return true;
+		if (fps <= 0) fps = vc.get(cv::CAP_PROP_FPS);
+		if (fps <= 0) fps = 30;
+		while (true) {
+			ReplayRecord record;
+			if (!vc.read(record.image)) break;
+			record.stream_id = params.stream_id;
+			record.timestamp_us = record_timestamp(-1);
+			record.index = index++;
+			if (!push(stream, std::move(record))) return false;
+		}
+		return true;
+	}
+
+	if (fps <= 0) fps = 30;
+	RecordView view;
+	int64_t record_timestamp_us = 0;
+	if (params.type == ReplayStreamType::Raw) {
+		RecordReader<RawRecordFraming> reader;
+		if (reader.open(filename, queue_size_) != kSuccess) return true;
+		while (reader.next(view, record_timestamp_us)) {
+			ReplayRecord record;
+			record.data.assign(view.data, view.data + view.size);
+			record.stream_id = params.stream_id;
+			record.timestamp_us = record_timestamp(record_timestamp_us);
+			record.index = index++;
+			if (!push(stream, std::move(record))) return false;
+		}
+	} else if (FixedSlotFile::is_fixed_slot_file(filename)) {
+		FixedSlotReader reader;
+		if (reader.open(filename) != kSuccess) return true;
+		cv::Mat image;
+		for (size_t i = 0; i < reader.size(); ++i) {
+			if (!reader.frame(i, image, view, record_timestamp_us)) continue;
+			// The image points to the mapping, the queue needs a copy
+			ReplayRecord record;
+			record.image = image.clone();
+			record.data.assign(view.data, view.data + view.size);
+			record.stream_id = params.stream_id;
+			record.timestamp_us = record_timestamp(record_timestamp_us);
+			record.index = index++;
+			if (!push(stream, std::move(record))) return false;
+		}
+	} else {
+		RecordReader<PlayerRecordFraming> reader;
+		if (reader.open(filename, queue_size_) != kSuccess) return true;
+		while (reader.next(view, record_timestamp_us)) {
+			ReplayRecord record;
+			if (!PlayerRecorder::decode_frame(view, record.image,
+				record.data)) {
+				continue;
+			}
+			record.stream_id = params.stream_id;
+			record.timestamp_us = record_timestamp(record_timestamp_us);
+			record.index = index++;
+			if (!push(stream, std::move(record))) return false;
+		}
+	}
+	return true;
+}
+// ----------------------------------------------------------------------------
+bool ReplayEngine::push(Stream *stream, ReplayRecord &&record) {
+	std::unique_lock<std::mutex> lock(mtx_);
+	cv_space_.wait(lock, [&] {
+		return !is_running_ || stream->queue.size() < queue_size_; });
+	if (!is_running_) return false;
+	stream->queue.push_back(std::move(record));
+	cv_data_.notify_all();
+	return true;
+}
+// ----------------------------------------------------------------------------
+void ReplayEngine::pace(int64_t timestamp_us) {
+	if (rate_mode_ == ReplayRateMode::AsFastAsPossible ||
+		(rate_mode_ == ReplayRateMode::Scaled && speed_ <= 0)) {
+		return;
+	}
+	if (first_timestamp_us_ < 0) {
+		first_timestamp_us_ = timestamp_us;
+		first_time_ = std::chrono::steady_clock::now();
+		return;
+	}
+	double speed = rate_mode_ == ReplayRateMode::Scaled ? speed_ : 1.0;
+	auto target = first_time_ + std::chrono::microseconds(
+		static_cast<int64_t>((timestamp_us - first_timestamp_us_) / speed));
+	// stop interrupts the wait
+	std::unique_lock<std::mutex> lock(mtx_);
+	cv_data_.wait_until(lock, target, [this] { return !is_running_; });
+}
+
+} // namespace storedata
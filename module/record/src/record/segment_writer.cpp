@@ -0,0 +1,382 @@
+/* @file segment_writer.cpp
+ * @brief Implementation of the preallocated segment writer.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include "record/inc/record/segment_writer.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace storedata
+{
+
+const size_t SegmentWriter::kAlignment;
+const int SegmentWriter::kAcquireTimeoutMs;
+
+// ----------------------------------------------------------------------------
+SegmentWriter::SegmentWriter() {
+	fd_ = -1;
+	direct_io_ = false;
+	buffer_ = nullptr;
+	buffer_capacity_ = 0;
+	buffer_used_ = 0;
+	file_offset_ = 0;
+	buffer_index_ = -1;
+	pending_writes_ = 0;
+	write_error_ = false;
+}
+// ----------------------------------------------------------------------------
+SegmentWriter::~SegmentWriter() {
+	close();
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::open(const std::string &filename,
+	size_t preallocate_bytes, bool direct_io, bool append,
+	size_t buffer_bytes) {
+	if (is_open()) return kFail;
+
+	// The buffer contains at least one block
+	buffer_capacity_ = (buffer_bytes + kAlignment - 1) / kAlignment *
+		kAlignment;
+	if (buffer_capacity_ == 0) buffer_capacity_ = kAlignment;
+	write_error_ = false;
+	// With a backend the buffer is taken by the first write
+	if (backend_) {
+		buffer_capacity_ = backend_->buffer_bytes();
+	} else if (alloc_own_buffer() != kSuccess) {
+		return kFail;
+	}
+	buffer_used_ = 0;
+	file_offset_ = 0;
+	direct_io_ = false;
+
+#ifdef _WIN32
+	(void)preallocate_bytes;
+	(void)direct_io;
+	if (append) {
+		fout_.open(filename.c_str(), std::ios::binary | std::ios::app);
+		fout_.seekp(0, std::ios::end);
+		file_offset_ = static_cast<uint64_t>(fout_.tellp());
+	} else {
+		fout_.open(filename.c_str(), std::ios::binary);
+	}
+	if (!fout_.is_open()) {
+		free_buffer();
+		return kFail;
+	}
+	return kSuccess;
+#else
+	// Read access is required to reload the last partial block
+	int flags = O_RDWR | O_CREAT | (append ? 0 : O_TRUNC);
+#ifdef O_DIRECT
+	if (direct_io) {
+		fd_ = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+		direct_io_ = fd_ >= 0;
+	}
+#endif
+	if (fd_ < 0) fd_ = ::open(filename.c_str(), flags, 0644);
+	if (fd_ < 0) {
+		free_buffer();
+		return kFail;
+	}
+
+	if (append) {
+		struct stat st;
+		if (fstat(fd_, &st) != 0) {
+			close();
+			return kFail;
+		}
+		// Restart from the last aligned offset with the partial block in
+		// the buffer
+		uint64_t file_size = static_cast<uint64_t>(st.st_size);
+		file_offset_ = file_size / kAlignment * kAlignment;
+		buffer_used_ = static_cast<size_t>(file_size - file_offset_);
+		if (buffer_ && reload_tail() != kSuccess) {
+			buffer_used_ = 0;
+			close();
+			return kFail;
+		}
+	}
+
+	// Reserve the space of the segment. The file size is not changed, so a
+	// reader sees only the data written.
+	if (preallocate_bytes > file_offset_ + buffer_used_) {
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+		// Not supported by all the file systems (it is only a hint)
+		fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0,
+			static_cast<off_t>(preallocate_bytes));
+#endif
+	}
+	return kSuccess;
+#endif
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::write(const char *data, size_t size) {
+	if (!is_open()) return kFileIsNotOpen;
+	while (size > 0) {
+		if (ensure_buffer() != kSuccess) return kFail;
+		size_t n = (std::min)(size, buffer_capacity_ - buffer_used_);
+		memcpy(buffer_ + buffer_used_, data, n);
+		buffer_used_ += n;
+		data += n;
+		size -= n;
+		if (buffer_used_ == buffer_capacity_) {
+			// Own buffer (no backend or none free): synchronous write
+			if ((buffer_index_ >= 0 ? submit_buffer() : flush_buffer(false))
+				!= kSuccess) {
+				return kFail;
+			}
+		}
+	}
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::flush() {
+	if (!is_open()) return kFileIsNotOpen;
+	return flush_buffer(true);
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::sync() {
+	if (!is_open()) return kFileIsNotOpen;
+	int return_status = flush_buffer(true);
+#ifdef _WIN32
+	fout_.flush();
+#elif defined(__linux__)
+	if (fdatasync(fd_) != 0) return_status = kFail;
+#else
+	if (fsync(fd_) != 0) return_status = kFail;
+#endif
+	return return_status;
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::close() {
+	int return_status = kSuccess;
+#ifdef _WIN32
+	if (fout_.is_open()) {
+		return_status = flush_buffer(true);
+		fout_.close();
+		fout_.clear();
+	}
+#else
+	if (fd_ >= 0) {
+		return_status = flush_buffer(true);
+		// Remove the padding of the last block
+		if (ftruncate(fd_, static_cast<off_t>(size())) != 0) {
+			return_status = kFail;
+		}
+		::close(fd_);
+		fd_ = -1;
+	}
+#endif
+	free_buffer();
+	buffer_used_ = 0;
+	file_offset_ = 0;
+	direct_io_ = false;
+	return return_status;
+}
+// ----------------------------------------------------------------------------
+bool SegmentWriter::is_open() const {
+#ifdef _WIN32
+	return fout_.is_open();
+#else
+	return fd_ >= 0;
+#endif
+}
+// ----------------------------------------------------------------------------
+size_t SegmentWriter::size() const {
+	return static_cast<size_t>(file_offset_ + buffer_used_);
+}
+// ----------------------------------------------------------------------------
+bool SegmentWriter::direct_io() const {
+	return direct_io_;
+}
+// ----------------------------------------------------------------------------
+void SegmentWriter::set_backend(std::shared_ptr<AsyncWriteBackend> backend) {
+	if (is_open()) return;
+	backend_ = backend;
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::submit_buffer() {
+	if (write_error_) return kFail;
+	size_t size = buffer_used_;
+	{
+		std::lock_guard<std::mutex> lk(mtx_pending_);
+		++pending_writes_;
+	}
+	int return_status = backend_->submit_buffer(fd_, buffer_index_, size,
+		file_offset_, [this, size](int64_t result) {
+			if (result != static_cast<int64_t>(size)) write_error_ = true;
+			std::lock_guard<std::mutex> lk(mtx_pending_);
+			if (--pending_writes_ == 0) cond_pending_.notify_all();
+		});
+	if (return_status != kSuccess) {
+		// The buffer is still owned by the writer
+		std::lock_guard<std::mutex> lk(mtx_pending_);
+		--pending_writes_;
+		return kFail;
+	}
+	// The backend releases the buffer after the write. The next write takes
+	// a new one.
+	file_offset_ += size;
+	buffer_used_ = 0;
+	buffer_ = nullptr;
+	buffer_index_ = -1;
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::ensure_buffer() {
+	if (buffer_) return kSuccess;
+	if (!backend_) return kFail;
+	// A bounded wait: the buffers may be held by other segments of the same
+	// thread. Without a free buffer the writer keeps its own until close.
+	buffer_ = backend_->acquire_buffer(buffer_index_, kAcquireTimeoutMs);
+	if (!buffer_ && alloc_own_buffer() != kSuccess) return kFail;
+	return reload_tail();
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::alloc_own_buffer() {
+	buffer_index_ = -1;
+#ifdef _WIN32
+	buffer_ = static_cast<char*>(_aligned_malloc(buffer_capacity_,
+		kAlignment));
+#else
+	void *ptr = nullptr;
+	if (posix_memalign(&ptr, kAlignment, buffer_capacity_) == 0) {
+		buffer_ = static_cast<char*>(ptr);
+	}
+#endif
+	return buffer_ ? kSuccess : kFail;
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::reload_tail() {
+#ifndef _WIN32
+	if (buffer_used_ > 0) {
+		ssize_t n = pread(fd_, buffer_, kAlignment,
+			static_cast<off_t>(file_offset_));
+		if (n < static_cast<ssize_t>(buffer_used_)) return kFail;
+	}
+#endif
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::wait_pending() {
+	std::unique_lock<std::mutex> lk(mtx_pending_);
+	cond_pending_.wait(lk, [this] { return pending_writes_ == 0; });
+	return write_error_ ? kFail : kSuccess;
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::flush_buffer(bool include_tail) {
+#ifdef _WIN32
+	// Sequential stream: all the buffer is written
+	(void)include_tail;
+	if (buffer_used_ > 0) {
+		fout_.write(buffer_, buffer_used_);
+		file_offset_ += buffer_used_;
+		buffer_used_ = 0;
+	}
+	fout_.flush();
+	return fout_.good() ? kSuccess : kFail;
+#else
+	// The data submitted before is written first
+	if (backend_ && wait_pending() != kSuccess) return kFail;
+	// No buffer taken: the partial block (append) is already in the file
+	if (!buffer_) return kSuccess;
+	// Full blocks
+	size_t full = buffer_used_ / kAlignment * kAlignment;
+	if (full > 0) {
+		if (write_at(buffer_, full, file_offset_) != kSuccess) return kFail;
+		file_offset_ += full;
+		buffer_used_ -= full;
+		memmove(buffer_, buffer_ + full, buffer_used_);
+	}
+	// The partial block is kept in the buffer and written again with the
+	// next data. O_DIRECT requires the padding to the block size.
+	if (include_tail && buffer_used_ > 0) {
+		size_t len = buffer_used_;
+		if (direct_io_) {
+			len = kAlignment;
+			memset(buffer_ + buffer_used_, 0, len - buffer_used_);
+		}
+		if (write_at(buffer_, len, file_offset_) != kSuccess) return kFail;
+	}
+	return kSuccess;
+#endif
+}
+// ----------------------------------------------------------------------------
+int SegmentWriter::write_at(const char *data, size_t size, uint64_t offset) {
+#ifdef _WIN32
+	(void)data;
+	(void)size;
+	(void)offset;
+	return kFail;
+#else
+	while (size > 0) {
+		ssize_t n = pwrite(fd_, data, size, static_cast<off_t>(offset));
+		if (n < 0) {
+			if (errno == EINTR) continue;
+#ifdef O_DIRECT
+			// The file system accepted O_DIRECT at open but not the write
+			if (errno == EINVAL && direct_io_) {
+				int flags = fcntl(fd_, F_GETFL);
+				if (flags != -1 &&
+					fcntl(fd_, F_SETFL, flags & ~O_DIRECT) == 0) {
+					direct_io_ = false;
+					continue;
+				}
+			}
+#endif
+			return kFail;
+		}
+		data += n;
+		size -= static_cast<size_t>(n);
+		offset += static_cast<uint64_t>(n);
+	}
+	return kSuccess;
+#endif
+}
+// ----------------------------------------------------------------------------
+void SegmentWriter::free_buffer() {
+#ifdef _WIN32
+	if (buffer_) _aligned_free(buffer_);
+	buffer_index_ = -1;
+#else
+	if (buffer_index_ >= 0) {
+		backend_->release_buffer(buffer_index_);
+		buffer_index_ = -1;
+	} else {
+		free(buffer_);
+	}
+#endif
+	buffer_ = nullptr;
+	buffer_capacity_ = 0;
+}
+
+} // namespace storedata
@@ -22,6 +22,9 @@
 
 #include "record/inc/record/storedata_time.hpp"
 
+#include <chrono>
+#include <cstdio>
+
 namespace storedata
 {
 
@@ -56,5 +59,27 @@ std::string DateTime::time2string() {
 	std::string str(buffer);
 	return str;
 }
+// ----------------------------------------------------------------------------
+int64_t DateTime::timestamp_us() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+// ----------------------------------------------------------------------------
+int64_t DateTime::string2timestamp_us(const std::string &str) {
+	struct tm timeinfo = {};
+	int num_chars = 0;
+	if (sscanf(str.c_str(), "%4d_%2d_%2d_%2d_%2d_%2d%n", &timeinfo.tm_year,
+		&timeinfo.tm_mon, &timeinfo.tm_mday, &timeinfo.tm_hour,
+		&timeinfo.tm_min, &timeinfo.tm_sec, &num_chars) != 6 ||
+		num_chars != 19) {
+		return -1;
+	}
+	timeinfo.tm_year -= 1900;
+	timeinfo.tm_mon -= 1;
+	timeinfo.tm_isdst = -1;
+	time_t rawtime = mktime(&timeinfo);
+	if (rawtime == static_cast<time_t>(-1)) return -1;
+	return static_cast<int64_t>(rawtime) * 1000000;
+}
 
 } // storedata
@@ -0,0 +1,75 @@
+/* @file video_encoder.cpp
+ * @brief Implementation of the video encoders.
+ *
+ * @section LICENSE
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR/AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @author Alessandro Moro <alessandromoro.italy@gmail.com>
+ * @bug No known bugs.
+ * @version 0.1.0.0
+ *
+ */
+
+#include "record/inc/record/video_encoder.hpp"
+
+namespace storedata
+{
+
+// ----------------------------------------------------------------------------
+VideoEncoder::~VideoEncoder() {
+}
+// ----------------------------------------------------------------------------
+VideoEncoderOpenCV::VideoEncoderOpenCV(const VideoEncoderParams &params) :
+	params_(params) {
+}
+// ----------------------------------------------------------------------------
+VideoEncoderOpenCV::~VideoEncoderOpenCV() {
+	release();
+}
+// ----------------------------------------------------------------------------
+int VideoEncoderOpenCV::open(const std::string &filename,
+	const cv::Size &size, double framerate) {
+	if (video_.isOpened()) return kFail;
+	video_ = cv::VideoWriter(filename, params_.fourcc, framerate, size);
+	// the codec or the path is not available
+	return video_.isOpened() ? kSuccess : kFail;
+}
+// ----------------------------------------------------------------------------
+bool VideoEncoderOpenCV::is_open() const {
+	return video_.isOpened();
+}
+// ----------------------------------------------------------------------------
+int VideoEncoderOpenCV::write(const cv::Mat &image) {
+	if (!video_.isOpened()) return kFileIsNotOpen;
+	video_ << image;
+	return kSuccess;
+}
+// ----------------------------------------------------------------------------
+void VideoEncoderOpenCV::release() {
+	video_.release();
+}
+// ----------------------------------------------------------------------------
+std::string VideoEncoderOpenCV::dot_extension() const {
+	return params_.dot_extension.empty() ? ".avi" : params_.dot_extension;
+}
+// ----------------------------------------------------------------------------
+const char* VideoEncoderOpenCV::name() const {
+	return "opencv";
+}
+// ----------------------------------------------------------------------------
+std::unique_ptr<VideoEncoder> create_video_encoder(
+	const VideoEncoderParams &params) {
+	return std::unique_ptr<VideoEncoder>(new VideoEncoderOpenCV(params));
+}
+
+} // namespace storedata
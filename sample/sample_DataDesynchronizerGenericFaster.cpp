@@ -349,7 +349,8 @@ int main(int argc, char* argv[])
 			auto rcd0 = 
 				std::make_unique<storedata::AtomicContainerDataFaster>();
 			rcd0->set_unique_msg(msg);
-			rcd0->copyFrom(m.data, m.cols * m.rows * (m.step / m.cols));
+			// Share the frame (no copy). m is a new image at each capture.
+			rcd0->assignFrom(m);
 			record_container[0].push(rcd0);
 			++num_frame;
 		}
@@ -161,6 +161,15 @@ int main(int argc, char *argv[])
 		pr.read_file("data\\record_PlayerRecorder_file_" + global_fname + ".dat", 60);
 		unsigned int index_start = 0;
 		pr.unpack("data\\record_PlayerRecorder_file_" + global_fname + ".dat", 60, "unpack", index_start);
+
+		// Stream the frames (constant memory, 8 frames read ahead)
+		size_t num_frames = storedata::PlayerRecorder::for_each_frame(
+			"data\\record_PlayerRecorder_file_" + global_fname + ".dat",
+			[](const cv::Mat &image, const std::vector<char> &msg) {
+				if (!image.empty()) cv::imshow("stream", image);
+				return cv::waitKey(1) != 27;
+			}, 8);
+		std::cout << "[!] frames: " << num_frames << std::endl;
 	}
 
 	// example to save video async
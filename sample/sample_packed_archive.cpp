@@ -0,0 +1,59 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "record/inc/record/recordcontainerfile.hpp"
+#include "record/inc/record/packed_archive.hpp"
+
+
+/** @brief It records many small files in a packed archive.
+*/
+void test_packed_record(int num_files) {
+	storedata::RecordContainerFile record_container;
+	// Segments of 4MB
+	record_container.set_packed_mode(true, "data/pack_", 4 * 1024 * 1024);
+	record_container.start();
+
+	std::vector<float> data(1024);
+	for (int i = 0; i < num_files; ++i) {
+		for (size_t j = 0; j < data.size(); ++j) data[j] = i + j * 0.5f;
+		storedata::RecordContainerData rcd;
+		rcd.copyFrom(&data[0], data.size() * sizeof(float));
+		record_container.push("data/F0_" + std::to_string(i) + ".data", rcd,
+			false, -1);
+	}
+	record_container.close(100, 100);
+	std::cout << "Recorded: " << num_files << " in data/pack_*.pack" <<
+		std::endl;
+}
+
+/** @brief It recreates the files of a segment.
+*/
+void test_packed_extract(const std::string &index_filename,
+	const std::string &output_dir) {
+	storedata::PackedArchiveReader reader;
+	if (reader.open(index_filename) != storedata::kSuccess) {
+		std::cout << "[-] Unable to open: " << index_filename << std::endl;
+		return;
+	}
+	std::cout << "Entries: " << reader.entries().size() << std::endl;
+	for (auto &it : reader.entries()) {
+		std::cout << it.name << " " << it.offset << " " << it.size <<
+			std::endl;
+	}
+	std::cout << "Extracted: " << reader.extract_all(output_dir) <<
+		std::endl;
+}
+
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	// sample_packed_archive [index_file output_dir]
+	if (argc > 2) {
+		test_packed_extract(argv[1], argv[2]);
+	} else {
+		test_packed_record(1000);
+	}
+	return 0;
+}
@@ -141,7 +141,8 @@ int main(int argc, char* argv[])
 			std::string fname = "data\\F0_" + std::to_string(num_frame_buffer);
 			// Add the record to save on a separate thread
 			storedata::RecordContainerData rcd0;
-			rcd0.copyFrom(m.data, m.cols * m.rows * (m.step / m.cols));
+			// Share the frame (no copy). m is a new image at each capture.
+			rcd0.assignFrom(m);
 			record_container[0].push(fname, rcd0, true, 0); // <- it allows 
 			                                                // only 1 frame 
 			                                                // buffering.